@@ -0,0 +1,759 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <ctime>
+#include "src/common/Order.h"
+#include "src/common/OrderBook.h"
+#include "src/server/MatchingEngine.h"
+#include "src/common/Journal.h"
+
+// Micro-benchmarks for the order book hot paths. The book logs every trade,
+// so logging is switched off while a measurement runs.
+
+class MutedLog {
+private:
+    LogLevel saved_level;
+
+public:
+    MutedLog() : saved_level(logger().get_level()) { logger().set_level(LogLevel::OFF); }
+    ~MutedLog() { logger().set_level(saved_level); }
+};
+
+// Counts heap allocations so the allocation benchmarks can report them
+static std::atomic<size_t> heap_allocations(0);
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Orders are cache-line aligned, so make_shared<Order> and slabs come through here
+void* operator new(size_t size, std::align_val_t alignment) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+using BenchClock = std::chrono::steady_clock;
+
+static double elapsed_ns(BenchClock::time_point start, BenchClock::time_point end) {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+// Rests `depth` one-lot sell orders at a single price, then sweeps `fills` of
+// them from the front of the queue with one market buy. Returns ns per fill.
+static double bench_fill_at_depth(size_t depth, size_t fills) {
+    OrderBook book("BENCH");
+    const Price price = price_from_double(100.0);
+
+    for (size_t i = 0; i < depth; ++i) {
+        book.add_order(std::make_shared<Order>(i + 1, "BENCH", OrderType::LIMIT, OrderSide::SELL,
+                                               price, 1.0, "maker"));
+    }
+
+    auto taker = std::make_shared<Order>(depth + 1, "BENCH", OrderType::MARKET, OrderSide::BUY,
+                                         0, static_cast<double>(fills), "taker");
+
+    double executed;
+    BenchClock::time_point start, end;
+    {
+        MutedLog muted;
+        start = BenchClock::now();
+        executed = book.execute_market_order(taker, OrderSide::SELL, static_cast<double>(fills));
+        end = BenchClock::now();
+    }
+
+    if (executed != static_cast<double>(fills)) {
+        std::cerr << "unexpected fill count " << executed << " at depth " << depth << std::endl;
+    }
+    return elapsed_ns(start, end) / static_cast<double>(fills);
+}
+
+static void run_fill_depth_benchmark() {
+    std::cout << "\n--- Fill cost vs. queue depth (single price level) ---" << std::endl;
+    std::cout << std::setw(12) << "depth" << std::setw(12) << "fills" << std::setw(16) << "ns/fill" << std::endl;
+
+    const size_t fills = 1000;
+    for (size_t depth : {1000, 10000, 100000, 200000}) {
+        double ns = bench_fill_at_depth(depth, fills);
+        std::cout << std::setw(12) << depth << std::setw(12) << fills
+                  << std::setw(16) << std::fixed << std::setprecision(1) << ns << std::endl;
+    }
+}
+
+// Quoting churn near the touch: each step rests an order within +/-200 ticks
+// of 100.00 on a random side, cancels a random live order, and reads best
+// bid/ask. Returns ns per step.
+static double bench_level_churn(BookBackend backend, size_t steps) {
+    OrderBook book("BENCH", SymbolConfig(price_from_double(0.01), backend));
+    const Price mid = price_from_double(100.0);
+    const Price tick = price_from_double(0.01);
+
+    uint64_t seed = 42;
+    auto next_random = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed >> 33;
+    };
+
+    // Bids strictly below the mid and asks strictly above, so nothing crosses
+    auto make_order = [&](uint64_t id) {
+        bool buy = next_random() % 2;
+        Price distance = static_cast<Price>(1 + next_random() % 200) * tick;
+        return std::make_shared<Order>(id, "BENCH", OrderType::LIMIT,
+                                       buy ? OrderSide::BUY : OrderSide::SELL,
+                                       buy ? mid - distance : mid + distance, 1.0, "maker");
+    };
+
+    std::vector<uint64_t> live_ids;
+    uint64_t next_id = 1;
+    for (size_t i = 0; i < 5000; ++i) {
+        book.add_order(make_order(next_id));
+        live_ids.push_back(next_id++);
+    }
+
+    std::vector<std::shared_ptr<Order>> incoming;
+    std::vector<size_t> cancel_slots;
+    incoming.reserve(steps);
+    cancel_slots.reserve(steps);
+    for (size_t i = 0; i < steps; ++i) {
+        incoming.push_back(make_order(next_id++));
+        cancel_slots.push_back(next_random());
+    }
+
+    double checksum = 0.0;
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < steps; ++i) {
+        book.add_order(incoming[i]);
+        size_t slot = cancel_slots[i] % live_ids.size();
+        book.cancel_order(live_ids[slot]);
+        live_ids[slot] = incoming[i]->id;
+        checksum += book.get_best_bid() + book.get_best_ask();
+    }
+    auto end = BenchClock::now();
+
+    if (checksum <= 0.0) {
+        std::cerr << "empty book during churn benchmark" << std::endl;
+    }
+    return elapsed_ns(start, end) / static_cast<double>(steps);
+}
+
+static void run_backend_benchmark() {
+    std::cout << "\n--- Book backend: add + cancel + best bid/ask near the touch ---" << std::endl;
+    std::cout << std::setw(12) << "backend" << std::setw(12) << "steps" << std::setw(16) << "ns/step" << std::endl;
+
+    const size_t steps = 200000;
+    double map_ns = bench_level_churn(BookBackend::MAP, steps);
+    double dense_ns = bench_level_churn(BookBackend::DENSE, steps);
+    std::cout << std::setw(12) << "MAP" << std::setw(12) << steps
+              << std::setw(16) << std::fixed << std::setprecision(1) << map_ns << std::endl;
+    std::cout << std::setw(12) << "DENSE" << std::setw(12) << steps
+              << std::setw(16) << std::fixed << std::setprecision(1) << dense_ns << std::endl;
+}
+
+// Rests `pending` sell trailing stops trailing by 1.00 to 8.00, then
+// prints `trades` ever-higher trades, each of which reprices every stop.
+// Returns ns per trade including the stop pass.
+static double bench_trailing_reprice(size_t pending, size_t trades) {
+    OrderBook book("BENCH");
+    const Price tick = price_from_double(0.01);
+    uint64_t next_id = 1;
+
+    for (size_t i = 0; i < pending; ++i) {
+        book.add_order(std::make_shared<Order>(next_id++, "BENCH", OrderType::TRAILING_STOP, OrderSide::SELL,
+                                               static_cast<Price>(1 + i % 8) * tick * 100, 1.0, "trailer",
+                                               TrailingStopOrderTag{}));
+    }
+
+    std::vector<std::shared_ptr<Order>> orders;
+    orders.reserve(trades * 2);
+    for (size_t i = 0; i < trades; ++i) {
+        Price price = price_from_double(100.0) + static_cast<Price>(i) * tick;
+        orders.push_back(std::make_shared<Order>(next_id++, "BENCH", OrderType::LIMIT, OrderSide::SELL, price, 1.0, "maker"));
+        orders.push_back(std::make_shared<Order>(next_id++, "BENCH", OrderType::LIMIT, OrderSide::BUY, price, 1.0, "taker"));
+    }
+
+    BenchClock::time_point start, end;
+    {
+        MutedLog muted;
+        start = BenchClock::now();
+        for (size_t i = 0; i < orders.size(); i += 2) {
+            book.add_order(orders[i]);
+            book.add_order(orders[i + 1]);
+            book.check_stop_loss_orders();
+        }
+        end = BenchClock::now();
+    }
+    return elapsed_ns(start, end) / static_cast<double>(trades);
+}
+
+static void run_trailing_benchmark() {
+    std::cout << "\n--- Trade on a new high with pending trailing stops ---" << std::endl;
+    std::cout << std::setw(12) << "pending" << std::setw(12) << "trades" << std::setw(16) << "ns/trade" << std::endl;
+
+    const size_t trades = 2000;
+    for (size_t pending : {0, 1000, 10000, 100000}) {
+        double ns = bench_trailing_reprice(pending, trades);
+        std::cout << std::setw(12) << pending << std::setw(12) << trades
+                  << std::setw(16) << std::fixed << std::setprecision(1) << ns << std::endl;
+    }
+}
+
+struct EntryResult {
+    double ns_per_order;
+    double allocations_per_order;
+};
+
+// Order-entry churn at one live price level: allocate an order, rest it,
+// cancel it and drop the last reference. Orders come from make_shared or from
+// the book's pool.
+static EntryResult bench_order_entry(bool pooled, size_t orders) {
+    OrderBook book("BENCH");
+    const Price price = price_from_double(100.0);
+    // Keeps the level alive so the loop measures the order, not the level
+    book.add_order(book.create_order(0, "BENCH", OrderType::LIMIT, OrderSide::BUY, price, 1.0, "anchor"));
+
+    // Warm the pool and the id map's buckets
+    for (uint64_t id = 1; id <= 64; ++id) {
+        book.add_order(book.create_order(id, "BENCH", OrderType::LIMIT, OrderSide::BUY, price, 1.0, "maker"));
+    }
+    for (uint64_t id = 1; id <= 64; ++id) {
+        book.cancel_order(id);
+    }
+
+    size_t allocations_before = heap_allocations.load();
+    auto start = BenchClock::now();
+    for (uint64_t id = 1; id <= orders; ++id) {
+        auto order = pooled ? book.create_order(id, "BENCH", OrderType::LIMIT, OrderSide::BUY, price, 1.0, "maker")
+                            : std::make_shared<Order>(id, "BENCH", OrderType::LIMIT, OrderSide::BUY, price, 1.0, "maker");
+        book.add_order(std::move(order));
+        book.cancel_order(id);
+    }
+    auto end = BenchClock::now();
+    size_t allocations = heap_allocations.load() - allocations_before;
+
+    return EntryResult{elapsed_ns(start, end) / static_cast<double>(orders),
+                       static_cast<double>(allocations) / static_cast<double>(orders)};
+}
+
+// The same churn through MatchingEngine::submit_order and cancel_order, so
+// the count covers the gateway and shard hand-off as well as the book
+static EntryResult bench_engine_entry(size_t orders) {
+    MutedLog muted;
+    MatchingEngine engine(1);
+    engine.submit_order("BENCH", OrderType::LIMIT, OrderSide::BUY, 100.0, 1.0, "anchor");
+
+    // Warm the pools, the locator's buckets and the shard's task ring
+    for (int i = 0; i < 64; ++i) {
+        engine.cancel_order(engine.submit_order("BENCH", OrderType::LIMIT, OrderSide::BUY, 100.0, 1.0, "maker"), "maker");
+    }
+
+    size_t allocations_before = heap_allocations.load();
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < orders; ++i) {
+        uint64_t id = engine.submit_order("BENCH", OrderType::LIMIT, OrderSide::BUY, 100.0, 1.0, "maker");
+        engine.cancel_order(id, "maker");
+    }
+    auto end = BenchClock::now();
+    size_t allocations = heap_allocations.load() - allocations_before;
+
+    return EntryResult{elapsed_ns(start, end) / static_cast<double>(orders),
+                       static_cast<double>(allocations) / static_cast<double>(orders)};
+}
+
+static void run_order_entry_benchmark() {
+    std::cout << "\n--- Order entry: allocate + rest + cancel ---" << std::endl;
+    std::cout << std::setw(12) << "source" << std::setw(12) << "orders" << std::setw(16) << "ns/order"
+              << std::setw(16) << "allocs/order" << std::endl;
+
+    const size_t orders = 500000;
+    for (bool pooled : {false, true}) {
+        EntryResult result = bench_order_entry(pooled, orders);
+        std::cout << std::setw(12) << (pooled ? "pool" : "make_shared") << std::setw(12) << orders
+                  << std::setw(16) << std::fixed << std::setprecision(1) << result.ns_per_order
+                  << std::setw(16) << std::setprecision(2) << result.allocations_per_order << std::endl;
+    }
+    const size_t engine_orders = 100000;
+    EntryResult result = bench_engine_entry(engine_orders);
+    std::cout << std::setw(12) << "engine" << std::setw(12) << engine_orders
+              << std::setw(16) << std::fixed << std::setprecision(1) << result.ns_per_order
+              << std::setw(16) << std::setprecision(2) << result.allocations_per_order << std::endl;
+}
+
+// Cost to the matching thread of one trade log line: a synchronous ostream
+// write flushed with std::endl, as the book used to do, against a record
+// handed to the async logger. Both sinks are /dev/null.
+static double bench_trade_log(bool async, size_t lines) {
+    std::ofstream sink("/dev/null");
+    logger().set_output(&sink);
+    ClientId buyer = client_directory().intern("buyer");
+    ClientId seller = client_directory().intern("seller");
+
+    // Timed in chunks that fit the ring; the logger drains between chunks
+    const size_t chunk = 4000;
+    double total_ns = 0.0;
+    for (size_t done = 0; done < lines; done += chunk) {
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < chunk; ++i) {
+            double price = 100.0 + static_cast<double>(i % 10);
+            if (async) {
+                logger().log(LogLevel::INFO, LogEvent::TRADE_EXECUTED, buyer, seller, 1.0, price);
+            } else {
+                sink << "Trade executed: " << 1.0 << " @ " << price << " between "
+                     << client_directory().name(buyer) << " and " << client_directory().name(seller) << std::endl;
+            }
+        }
+        total_ns += elapsed_ns(start, BenchClock::now());
+        logger().flush();
+    }
+
+    logger().set_output(&std::cout);
+    return total_ns / static_cast<double>(lines);
+}
+
+static void run_trade_log_benchmark() {
+    std::cout << "\n--- Trade log line: cost on the matching thread ---" << std::endl;
+    std::cout << std::setw(12) << "sink" << std::setw(12) << "lines" << std::setw(16) << "ns/line" << std::endl;
+
+    const size_t lines = 200000;
+    for (bool async : {false, true}) {
+        double ns = bench_trade_log(async, lines);
+        std::cout << std::setw(12) << (async ? "async" : "ostream") << std::setw(12) << lines
+                  << std::setw(16) << std::fixed << std::setprecision(1) << ns << std::endl;
+    }
+}
+
+// Order entry through the engine on a multi-symbol workload: one gateway
+// thread per shard, each trading its own symbols with crossing limit pairs.
+static double bench_sharded_entry(size_t shard_count, size_t orders_per_gateway) {
+    MatchingEngine engine(shard_count);
+    MutedLog muted;
+
+    std::vector<std::thread> gateways;
+    auto start = BenchClock::now();
+    for (size_t g = 0; g < shard_count; ++g) {
+        gateways.emplace_back([&engine, g, orders_per_gateway]() {
+            std::string symbol = "SHARD" + std::to_string(g);
+            for (size_t i = 0; i < orders_per_gateway; i += 2) {
+                engine.submit_order(symbol, OrderType::LIMIT, OrderSide::BUY, 100.0, 1, "buyer");
+                engine.submit_order(symbol, OrderType::LIMIT, OrderSide::SELL, 100.0, 1, "seller");
+            }
+        });
+    }
+    for (auto& gateway : gateways) gateway.join();
+    auto end = BenchClock::now();
+
+    double seconds = elapsed_ns(start, end) / 1e9;
+    return static_cast<double>(orders_per_gateway * shard_count) / seconds;
+}
+
+static void run_sharded_entry_benchmark() {
+    std::cout << "\n--- Engine order entry: shards vs throughput (" << std::thread::hardware_concurrency()
+              << " hardware threads) ---" << std::endl;
+    std::cout << std::setw(12) << "shards" << std::setw(12) << "orders" << std::setw(16) << "orders/s" << std::endl;
+
+    const size_t orders_per_gateway = 40000;
+    for (size_t shards : {1, 2, 4}) {
+        double rate = bench_sharded_entry(shards, orders_per_gateway);
+        std::cout << std::setw(12) << shards << std::setw(12) << orders_per_gateway * shards
+                  << std::setw(16) << std::fixed << std::setprecision(0) << rate << std::endl;
+    }
+}
+
+// Order entry with every pre-trade check enabled against the same flow with
+// none; one gateway per client, crossing pairs so the books stay flat
+static double bench_risk_entry(bool limits, size_t gateways, size_t orders_per_gateway) {
+    MatchingEngine engine(2);
+    MutedLog muted;
+    if (limits) {
+        engine.set_default_risk_limits(RiskLimits(1000, 1e9, 100000, 1e9, 100000000));
+    }
+
+    std::vector<std::thread> threads;
+    auto start = BenchClock::now();
+    for (size_t g = 0; g < gateways; ++g) {
+        threads.emplace_back([&engine, g, orders_per_gateway]() {
+            std::string symbol = "RISK" + std::to_string(g);
+            std::string client = "risk_gateway" + std::to_string(g);
+            for (size_t i = 0; i < orders_per_gateway; i += 2) {
+                engine.submit_order(symbol, OrderType::LIMIT, OrderSide::BUY, 100.0, 1, client);
+                engine.submit_order(symbol, OrderType::LIMIT, OrderSide::SELL, 100.0, 1, client);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    return elapsed_ns(start, BenchClock::now()) / static_cast<double>(gateways * orders_per_gateway);
+}
+
+// The gateway-side checks alone: table lookup, limits, message window and
+// open-order reservation, for one client per thread
+static double bench_risk_checks(size_t threads_count, size_t checks) {
+    ClientRiskTable table;
+    table.set_default_limits(RiskLimits(1000, 1e9, 100000, 1e9, 100000000));
+    std::vector<std::thread> threads;
+    std::atomic<size_t> admitted(0);
+    auto start = BenchClock::now();
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&table, &admitted, t, checks]() {
+            size_t ok = 0;
+            for (size_t i = 0; i < checks; ++i) {
+                ClientRisk& risk = table.at(static_cast<ClientId>(t));
+                risk.in_flight.fetch_add(1, std::memory_order_acquire);
+                const RiskLimits* limits = table.limits_for(risk);
+                uint64_t now = static_cast<uint64_t>(BenchClock::now().time_since_epoch().count());
+                if (ClientRiskTable::admit_message(risk, *limits, now) && 10.0 <= limits->max_order_quantity &&
+                    risk.open_orders.load(std::memory_order_relaxed) + risk.in_flight.load(std::memory_order_relaxed) <=
+                        limits->max_open_orders) {
+                    ++ok;
+                }
+                risk.in_flight.fetch_sub(1, std::memory_order_release);
+            }
+            admitted += ok;
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    return elapsed_ns(start, BenchClock::now()) / static_cast<double>(checks);
+}
+
+static void run_risk_benchmark() {
+    std::cout << "\n--- Pre-trade risk ---" << std::endl;
+    const size_t gateways = 4;
+    const size_t orders_per_gateway = 40000;
+    double without = bench_risk_entry(false, gateways, orders_per_gateway);
+    double with = bench_risk_entry(true, gateways, orders_per_gateway);
+    std::cout << std::fixed << std::setprecision(1) << "engine entry, no limits:  " << without << " ns/order" << std::endl;
+    std::cout << "engine entry, all limits: " << with << " ns/order" << std::endl;
+    for (size_t threads : {1, 4}) {
+        std::cout << "gateway checks, " << threads << " thread(s): " << bench_risk_checks(threads, 2000000)
+                  << " ns/check per thread" << std::endl;
+    }
+}
+
+// Timer wheel with `pending` timers spread over 30 minutes: the cost of
+// scheduling one more, and of advancing the wheel one tick
+// A basket of resting limit orders across many symbols, sent either one
+// submit_order call at a time or as submit_batch calls of `batch_size`.
+static double bench_basket_entry(size_t batch_size, size_t orders) {
+    MatchingEngine engine(2);
+    MutedLog muted;
+
+    const size_t symbols = 50;
+    std::vector<OrderRequest> requests;
+    requests.reserve(orders);
+    for (size_t i = 0; i < orders; ++i) {
+        requests.push_back(OrderRequest{"BASKET" + std::to_string(i % symbols), OrderType::LIMIT, OrderSide::BUY,
+                                        90.0 + static_cast<double>(i % 10), 1, "basket"});
+    }
+
+    auto start = BenchClock::now();
+    if (batch_size <= 1) {
+        for (const auto& request : requests) {
+            engine.submit_order(request.symbol, request.type, request.side, request.price, request.quantity,
+                                request.client_id);
+        }
+    } else {
+        for (size_t begin = 0; begin < orders; begin += batch_size) {
+            std::vector<OrderRequest> batch(requests.begin() + begin,
+                                            requests.begin() + std::min(orders, begin + batch_size));
+            engine.submit_batch(batch);
+        }
+    }
+    auto end = BenchClock::now();
+
+    double seconds = elapsed_ns(start, end) / 1e9;
+    return static_cast<double>(orders) / seconds;
+}
+
+static void run_basket_entry_benchmark() {
+    std::cout << "\n--- Basket entry: single submits vs batches (50 symbols, 2 shards) ---" << std::endl;
+    std::cout << std::setw(12) << "batch" << std::setw(12) << "orders" << std::setw(16) << "orders/s" << std::endl;
+
+    const size_t orders = 100000;
+    for (size_t batch_size : {1, 100, 1000}) {
+        double rate = bench_basket_entry(batch_size, orders);
+        std::cout << std::setw(12) << batch_size << std::setw(12) << orders
+                  << std::setw(16) << std::fixed << std::setprecision(0) << rate << std::endl;
+    }
+}
+
+// A quoter moving one resting bid between two prices behind a fixed queue,
+// either with amend_order or with a cancel and a new order each time
+static double bench_requote(bool amend, size_t requotes) {
+    MatchingEngine engine(1);
+    MutedLog muted;
+    for (int i = 0; i < 100; ++i) {
+        engine.submit_order("QUOTE", OrderType::LIMIT, OrderSide::BUY, 99.0 + (i % 2), 1, "queue");
+    }
+
+    uint64_t order_id = engine.submit_order("QUOTE", OrderType::LIMIT, OrderSide::BUY, 99.0, 10, "quoter");
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < requotes; ++i) {
+        double price = 99.0 + static_cast<double>((i + 1) % 2);
+        if (amend) {
+            engine.amend_order(order_id, price, 10, "quoter");
+        } else {
+            engine.cancel_order(order_id, "quoter");
+            order_id = engine.submit_order("QUOTE", OrderType::LIMIT, OrderSide::BUY, price, 10, "quoter");
+        }
+    }
+    return elapsed_ns(start, BenchClock::now()) / static_cast<double>(requotes);
+}
+
+static void run_requote_benchmark() {
+    std::cout << "\n--- Requoting: amend vs cancel and resubmit ---" << std::endl;
+    const size_t requotes = 200000;
+    std::cout << std::fixed << std::setprecision(1)
+              << "cancel + submit: " << bench_requote(false, requotes) << " ns/requote" << std::endl;
+    std::cout << "amend:           " << bench_requote(true, requotes) << " ns/requote" << std::endl;
+}
+
+static void run_timer_wheel_benchmark() {
+    std::cout << "\n--- Timer wheel: schedule + advance with pending timers ---" << std::endl;
+    std::cout << std::setw(12) << "pending" << std::setw(16) << "ns/schedule" << std::setw(16) << "ns/tick" << std::endl;
+
+    using Clock = TimerWheel::Clock;
+    const auto tick = std::chrono::milliseconds(10);
+    for (size_t pending : {1000, 100000, 1000000}) {
+        Clock::time_point start = Clock::now();
+        TimerWheel wheel(tick, start);
+        size_t fired = 0;
+        const uint64_t horizon = 180000;  // 30 minutes of ticks
+
+        auto schedule_start = BenchClock::now();
+        for (size_t i = 0; i < pending; ++i) {
+            uint64_t ticks = 1 + (i * 7919) % horizon;
+            wheel.schedule_at(start + ticks * tick, [&fired]() { fired++; });
+        }
+        double schedule_ns = elapsed_ns(schedule_start, BenchClock::now()) / static_cast<double>(pending);
+
+        std::vector<TimerWheel::Callback> due;
+        auto advance_start = BenchClock::now();
+        for (uint64_t t = 1; t <= horizon; ++t) {
+            wheel.advance(start + t * tick, due);
+            for (auto& callback : due) callback();
+            due.clear();
+        }
+        double tick_ns = elapsed_ns(advance_start, BenchClock::now()) / static_cast<double>(horizon);
+
+        if (fired != pending) {
+            std::cerr << "timer wheel fired " << fired << " of " << pending << std::endl;
+        }
+        std::cout << std::setw(12) << pending << std::setw(16) << std::fixed << std::setprecision(1) << schedule_ns
+                  << std::setw(16) << tick_ns << std::endl;
+    }
+}
+
+static double percentile(std::vector<double>& samples, double fraction) {
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Order entry latency through the engine, acked only once the order is
+// journalled and synced; gateways submit concurrently so syncs are shared.
+// With `replicated`, a backup engine follows the journal over a Unix socket.
+static void bench_journalled_entry(const std::string& label, const std::string& directory, bool use_mmap,
+                                   std::chrono::microseconds window, size_t gateways, size_t orders_per_gateway,
+                                   bool replicated = false) {
+    MatchingEngine engine(1);
+    MutedLog muted;
+    if (!directory.empty()) {
+        std::filesystem::remove_all(directory);
+        JournalConfig config(directory, 64u << 20, window, 256, use_mmap);
+        if (!engine.enable_journal(config)) {
+            std::cerr << "could not open journal in " << directory << std::endl;
+            return;
+        }
+    }
+    MatchingEngine backup(1);
+    std::thread follower;
+    if (replicated) {
+        std::string endpoint = "unix:" + directory + ".sock";
+        if (!engine.enable_replication(endpoint)) {
+            std::cerr << "could not listen on " << endpoint << std::endl;
+            return;
+        }
+        follower = std::thread([&backup, endpoint]() { backup.follow(endpoint); });
+    }
+
+    std::vector<std::vector<double>> latencies(gateways);
+    std::vector<std::thread> threads;
+    auto start = BenchClock::now();
+    for (size_t g = 0; g < gateways; ++g) {
+        threads.emplace_back([&engine, &latencies, g, orders_per_gateway]() {
+            latencies[g].reserve(orders_per_gateway);
+            for (size_t i = 0; i < orders_per_gateway; ++i) {
+                auto submitted = BenchClock::now();
+                engine.submit_order("JOURNAL", OrderType::LIMIT, i % 2 ? OrderSide::SELL : OrderSide::BUY,
+                                    i % 2 ? 101.0 : 99.0, 1, "gateway" + std::to_string(g));
+                latencies[g].push_back(elapsed_ns(submitted, BenchClock::now()));
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    double seconds = elapsed_ns(start, BenchClock::now()) / 1e9;
+
+    std::vector<double> all;
+    for (auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    double rate = static_cast<double>(all.size()) / seconds;
+    double p50 = percentile(all, 0.50) / 1000.0;
+    double p99 = percentile(all, 0.99) / 1000.0;
+    std::cout << std::setw(14) << label << std::setw(12) << std::fixed << std::setprecision(0) << rate
+              << std::setw(12) << std::setprecision(1) << p50 << std::setw(12) << p99 << std::endl;
+    if (replicated) {
+        auto deadline = BenchClock::now() + std::chrono::seconds(10);
+        while (backup.replicated_sequence() < all.size() && BenchClock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        backup.stop_following();
+        follower.join();
+    }
+    if (!directory.empty()) {
+        std::filesystem::remove_all(directory);
+    }
+}
+
+static void run_journal_benchmark() {
+    std::cout << "\n--- Journalled order entry: 8 gateways, ack after group commit ---" << std::endl;
+    std::cout << std::setw(14) << "journal" << std::setw(12) << "orders/s" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << std::endl;
+
+    std::string directory = (std::filesystem::temp_directory_path() / "engine_journal_bench").string();
+    const size_t gateways = 8;
+    const size_t orders_per_gateway = 20000;
+    using std::chrono::microseconds;
+    bench_journalled_entry("off", "", false, microseconds(0), gateways, orders_per_gateway);
+    bench_journalled_entry("pwrite", directory, false, microseconds(0), gateways, orders_per_gateway);
+    bench_journalled_entry("pwrite/50us", directory, false, microseconds(50), gateways, orders_per_gateway);
+    bench_journalled_entry("mmap", directory, true, microseconds(0), gateways, orders_per_gateway);
+    bench_journalled_entry("pwrite+backup", directory, false, microseconds(0), gateways, orders_per_gateway, true);
+
+    // What the matching path itself pays to encode and copy one record. Thread
+    // CPU time, so the flusher's writes on a shared core are not counted.
+    std::filesystem::remove_all(directory);
+    {
+        Journal journal{JournalConfig(directory)};
+        if (journal.open()) {
+            const size_t records = 1000000;
+            JournalCommand command(JournalRecordType::ORDER);
+            command.symbol = "JOURNAL";
+            command.client_id = "gateway0";
+            command.price = price_from_double(100.0);
+            command.quantity = 1;
+            auto thread_cpu_ns = []() {
+                timespec now;
+                clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+                return static_cast<double>(now.tv_sec) * 1e9 + static_cast<double>(now.tv_nsec);
+            };
+            double append_start = thread_cpu_ns();
+            for (size_t i = 0; i < records; ++i) {
+                command.order_id = i + 1;
+                journal.append(command);
+            }
+            double append_ns = (thread_cpu_ns() - append_start) / static_cast<double>(records);
+            journal.wait_durable(journal.last_sequence());
+            std::cout << "append only: " << std::setprecision(1) << append_ns << " ns/record (thread CPU)" << std::endl;
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Builds books holding `resting` orders through the journal, snapshots them,
+// adds a journal tail of `tail` orders, then times both ways back
+static void run_recovery_benchmark() {
+    std::cout << "\n--- Snapshot and recovery: 4 symbols, 4 shards ---" << std::endl;
+
+    namespace fs = std::filesystem;
+    fs::path root = fs::temp_directory_path() / "engine_recovery_bench";
+    fs::remove_all(root);
+    fs::create_directories(root);
+    std::string journal_dir = (root / "journal").string();
+    std::string snapshot_dir = (root / "snapshots").string();
+
+    const size_t resting = 1000000;
+    const size_t tail = 50000;
+    const char* symbols[] = {"RCVA", "RCVB", "RCVC", "RCVD"};
+    auto enter = [&](MatchingEngine& engine, size_t from, size_t count) {
+        std::vector<OrderRequest> batch;
+        for (size_t i = from; i < from + count; ++i) {
+            // Bids below 100 and asks above it, so everything rests
+            bool buy = (i % 2) == 0;
+            double offset = 0.01 * static_cast<double>(1 + (i / 8) % 200);
+            batch.push_back(OrderRequest{symbols[(i / 2) % 4], OrderType::LIMIT, buy ? OrderSide::BUY : OrderSide::SELL,
+                                         buy ? 100.0 - offset : 100.0 + offset, 1.0,
+                                         "recovery" + std::to_string(i % 16)});
+            if (batch.size() == 1000) {
+                engine.submit_batch(batch);
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) engine.submit_batch(batch);
+    };
+
+    {
+        MatchingEngine engine(4);
+        if (!engine.enable_journal(JournalConfig(journal_dir))) {
+            std::cout << "journal unavailable, skipped" << std::endl;
+            return;
+        }
+        enter(engine, 0, resting);
+
+        auto start = BenchClock::now();
+        std::string path;
+        engine.write_snapshot(snapshot_dir, &path);
+        double snapshot_ms = elapsed_ns(start, BenchClock::now()) / 1e6;
+        std::cout << "snapshot of " << resting << " orders: " << std::fixed << std::setprecision(1) << snapshot_ms
+                  << " ms, " << static_cast<double>(fs::file_size(path)) / (1 << 20) << " MB" << std::endl;
+
+        enter(engine, resting, tail);
+    }
+
+    auto time_recovery = [&](const std::string& label, const std::string& snapshots) {
+        MatchingEngine engine(4);
+        auto start = BenchClock::now();
+        engine.recover(snapshots, journal_dir);
+        double recover_ms = elapsed_ns(start, BenchClock::now()) / 1e6;
+        std::cout << std::setw(28) << std::left << label << std::right << std::setw(10) << std::setprecision(1)
+                  << recover_ms << " ms" << std::endl;
+    };
+    time_recovery("snapshot + 50k journal tail", snapshot_dir);
+    time_recovery("full journal replay", "");
+
+    fs::remove_all(root);
+}
+
+int main() {
+    std::cout << "Starting Order Book Benchmarks..." << std::endl;
+
+    run_fill_depth_benchmark();
+    run_backend_benchmark();
+    run_trailing_benchmark();
+    run_order_entry_benchmark();
+    run_trade_log_benchmark();
+    run_sharded_entry_benchmark();
+    run_risk_benchmark();
+    run_basket_entry_benchmark();
+    run_requote_benchmark();
+    run_timer_wheel_benchmark();
+    run_journal_benchmark();
+    run_recovery_benchmark();
+
+    return 0;
+}
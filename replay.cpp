@@ -0,0 +1,369 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "src/common/Order.h"
+#include "src/common/OrderBook.h"
+#include "src/common/Journal.h"
+#include "src/server/MatchingEngine.h"
+
+// Offline replay: feeds a recorded journal, or a synthetic one, straight into
+// the engine or into bare order books, with no sockets or server in between.
+// Reports throughput, per-event latency and a checksum of the final books.
+// The checksum only depends on the order flow, so two builds (or the two
+// modes) that agree on every fill agree on it.
+
+namespace {
+
+using ReplayClock = std::chrono::steady_clock;
+
+struct ReplayOptions {
+    std::string journal_dir;
+    size_t synthetic_events = 0;
+    size_t symbols = 4;
+    uint64_t seed = 1;
+    std::string write_dir;
+    bool book_mode = false;
+    size_t shards = 0;
+};
+
+void usage() {
+    std::cerr << "usage: replay <journal dir> [options]\n"
+              << "       replay --synthetic <events> [options]\n"
+              << "  --symbols <n>     symbols in the synthetic flow (default 4)\n"
+              << "  --seed <n>        synthetic flow seed (default 1)\n"
+              << "  --write <dir>     also write the synthetic flow as a journal\n"
+              << "  --book            apply to bare OrderBooks on this thread instead of the engine\n"
+              << "  --shards <n>      engine shards (default one per hardware thread)\n";
+}
+
+bool parse_options(int argc, char** argv, ReplayOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--synthetic" && has_value) {
+            options.synthetic_events = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--symbols" && has_value) {
+            options.symbols = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--write" && has_value) {
+            options.write_dir = argv[++i];
+        } else if (arg == "--book") {
+            options.book_mode = true;
+        } else if (arg == "--shards" && has_value) {
+            options.shards = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg.compare(0, 2, "--") != 0 && options.journal_dir.empty()) {
+            options.journal_dir = arg;
+        } else {
+            return false;
+        }
+    }
+    return options.synthetic_events > 0 || !options.journal_dir.empty();
+}
+
+// A seeded mix of passive and marketable limits, market orders, cancels and
+// stops around a random-walking mid price per symbol
+std::vector<JournalCommand> synthesize(size_t events, size_t symbol_count, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    auto below = [&](uint64_t n) { return random() % n; };
+    const Price tick = price_from_double(0.01);
+
+    std::vector<std::string> symbols;
+    std::vector<Price> mids;
+    std::vector<std::vector<uint64_t>> live(symbol_count);
+    for (size_t i = 0; i < symbol_count; ++i) {
+        symbols.push_back("SYN" + std::to_string(i));
+        mids.push_back(price_from_double(100.0));
+    }
+
+    std::vector<JournalCommand> commands;
+    commands.reserve(events);
+    uint64_t next_id = 1;
+    for (size_t i = 0; i < events; ++i) {
+        size_t s = below(symbol_count);
+        if (below(4) == 0) {
+            mids[s] = std::max<Price>(mids[s] + (static_cast<Price>(below(3)) - 1) * tick, 10 * tick);
+        }
+
+        JournalCommand command(JournalRecordType::ORDER);
+        command.sequence = i + 1;
+        command.symbol = symbols[s];
+        command.client_id = "client" + std::to_string(below(32));
+        command.side = below(2) ? OrderSide::BUY : OrderSide::SELL;
+        command.quantity = static_cast<double>(1 + below(100));
+        Price away = static_cast<Price>(below(20)) * tick;
+        Price passive = (command.side == OrderSide::BUY) ? mids[s] - tick - away : mids[s] + tick + away;
+        Price through = (command.side == OrderSide::BUY) ? mids[s] + away / 4 : mids[s] - away / 4;
+
+        uint64_t roll = below(100);
+        if (roll < 25 && !live[s].empty()) {
+            // Cancel a random order of this symbol; it may have filled already
+            size_t pick = below(live[s].size());
+            command.type = JournalRecordType::CANCEL;
+            command.order_id = live[s][pick];
+            live[s][pick] = live[s].back();
+            live[s].pop_back();
+            commands.push_back(command);
+            continue;
+        }
+
+        command.order_id = next_id++;
+        if (roll < 75) {
+            command.order_type = OrderType::LIMIT;
+            command.price = passive;
+        } else if (roll < 87) {
+            command.order_type = OrderType::LIMIT;
+            command.price = std::max(through, tick);
+        } else if (roll < 93) {
+            command.order_type = OrderType::MARKET;
+        } else if (roll < 97) {
+            // Stops on the far side of the mid, limit a few ticks beyond the stop
+            command.type = JournalRecordType::STOP_LIMIT_ORDER;
+            command.order_type = OrderType::STOP_LIMIT;
+            Price distance = (5 + static_cast<Price>(below(20))) * tick;
+            command.price = (command.side == OrderSide::BUY) ? mids[s] + distance : mids[s] - distance;
+            command.limit_price = (command.side == OrderSide::BUY) ? command.price + 2 * tick : command.price - 2 * tick;
+            if (command.price <= 2 * tick) continue;
+        } else {
+            command.type = JournalRecordType::TRAILING_STOP_ORDER;
+            command.order_type = OrderType::TRAILING_STOP;
+            command.price = (5 + static_cast<Price>(below(20))) * tick;
+        }
+        if (command.order_type != OrderType::MARKET) {
+            live[s].push_back(command.order_id);
+        }
+        commands.push_back(command);
+    }
+    return commands;
+}
+
+// Applies commands to bare books the way the engine's shard tasks do
+class BookReplayer {
+private:
+    std::map<std::string, SymbolConfig> configs;
+    std::map<std::string, std::shared_ptr<OrderBook>> books;
+    std::vector<TradeEvent> trades;
+
+public:
+    const std::map<std::string, std::shared_ptr<OrderBook>>& get_books() const { return books; }
+
+    OrderBook& book_for(const std::string& symbol) {
+        auto& book = books[symbol];
+        if (!book) {
+            auto config = configs.find(symbol);
+            book = std::make_shared<OrderBook>(symbol, config != configs.end() ? config->second : SymbolConfig());
+            // Trades are numbered as in the engine, which records them
+            book->enable_trade_events();
+        }
+        return *book;
+    }
+
+    // False for commands that don't touch a book
+    bool apply(const JournalCommand& command) {
+        if (!apply_to_book(command)) return false;
+        trades.clear();
+        books[command.symbol]->drain_trade_events(trades);
+        return true;
+    }
+
+private:
+    bool apply_to_book(const JournalCommand& command) {
+        SymbolId symbol = symbol_directory().intern(command.symbol);
+        ClientId client = client_directory().intern(command.client_id);
+        switch (command.type) {
+        case JournalRecordType::ORDER:
+        case JournalRecordType::VWAP_SLICE: {
+            OrderBook& book = book_for(command.symbol);
+            auto order = book.create_order(command.order_id, symbol, command.order_type, command.side,
+                                           command.price, command.quantity, client);
+            order->time_in_force = command.time_in_force;
+            if (command.order_type == OrderType::MARKET) {
+                OrderSide opposite = (command.side == OrderSide::BUY) ? OrderSide::SELL : OrderSide::BUY;
+                book.execute_market_order(order, opposite, command.quantity);
+                book.check_stop_loss_orders();
+            } else if (!book.add_order(order).empty()) {
+                book.check_stop_loss_orders();
+            }
+            return true;
+        }
+        case JournalRecordType::STOP_LIMIT_ORDER: {
+            OrderBook& book = book_for(command.symbol);
+            if (!book.add_order(book.create_order(command.order_id, symbol, OrderType::STOP_LIMIT, command.side,
+                                                  command.price, command.limit_price, command.quantity, client,
+                                                  StopLimitOrderTag{})).empty()) {
+                book.check_stop_loss_orders();
+            }
+            return true;
+        }
+        case JournalRecordType::TRAILING_STOP_ORDER: {
+            OrderBook& book = book_for(command.symbol);
+            book.add_order(book.create_order(command.order_id, symbol, OrderType::TRAILING_STOP, command.side,
+                                             command.price, command.quantity, client, TrailingStopOrderTag{}));
+            return true;
+        }
+        case JournalRecordType::CANCEL:
+            book_for(command.symbol).cancel_order(command.order_id);
+            return true;
+        case JournalRecordType::AMEND: {
+            OrderBook& book = book_for(command.symbol);
+            std::vector<std::shared_ptr<Order>> matched_orders;
+            if (book.amend_order(command.order_id, command.price, command.quantity, matched_orders) &&
+                !matched_orders.empty()) {
+                book.check_stop_loss_orders();
+            }
+            return true;
+        }
+        case JournalRecordType::SYMBOL_CONFIG:
+            if (books.count(command.symbol) == 0) {
+                configs[command.symbol] = command.config;
+            }
+            return false;
+        case JournalRecordType::VWAP_ORDER:
+            // Parents never rest in a book; their slices are recorded separately
+            return false;
+        }
+        return false;
+    }
+};
+
+// FNV-1a over each book's live orders and trade counters, symbols by name
+class StateChecksum {
+private:
+    uint64_t hash = 1469598103934665603ull;
+
+public:
+    template <typename T>
+    void add(const T& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    void add_book(const std::string& symbol, const BookImage& image) {
+        for (char c : symbol) add(c);
+        add(image.last_trade_price);
+        add(image.next_trade_sequence);
+        for (const auto& order : image.orders) {
+            add(order.id);
+            add(order.sequence);
+            add(order.placement);
+            add(order.price);
+            add(order.quantity);
+            add(order.filled_quantity);
+            add(order.reference);
+        }
+    }
+
+    uint64_t value() const { return hash; }
+};
+
+double percentile(std::vector<double>& samples, double fraction) {
+    if (samples.empty()) return 0.0;
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * static_cast<double>(samples.size())));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!parse_options(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    std::vector<JournalCommand> commands;
+    if (options.synthetic_events > 0) {
+        commands = synthesize(options.synthetic_events, options.symbols, options.seed);
+        if (!options.write_dir.empty()) {
+            Journal journal{JournalConfig(options.write_dir)};
+            if (!journal.open()) {
+                std::cerr << "Failed to open journal in " << options.write_dir << std::endl;
+                return 1;
+            }
+            for (auto command : commands) {
+                journal.append(command);
+            }
+            journal.wait_durable(journal.last_sequence());
+        }
+    } else if (!Journal::replay(options.journal_dir, 0, [&](const JournalCommand& command) {
+                   commands.push_back(command);
+               })) {
+        std::cerr << "Failed to read journal in " << options.journal_dir << std::endl;
+        return 1;
+    }
+
+    // Fill messages would dominate the measurement
+    logger().set_level(LogLevel::WARN);
+
+    std::vector<double> latencies;
+    latencies.reserve(commands.size());
+    StateChecksum checksum;
+    double elapsed_s;
+    size_t shard_count = 0;
+    if (options.book_mode) {
+        BookReplayer replayer;
+        auto start = ReplayClock::now();
+        for (const auto& command : commands) {
+            auto before = ReplayClock::now();
+            if (replayer.apply(command)) {
+                latencies.push_back(std::chrono::duration<double, std::nano>(ReplayClock::now() - before).count());
+            }
+        }
+        elapsed_s = std::chrono::duration<double>(ReplayClock::now() - start).count();
+        for (const auto& [symbol, book] : replayer.get_books()) {
+            BookImage image;
+            book->capture(image);
+            checksum.add_book(symbol, image);
+        }
+    } else {
+        MatchingEngine engine(options.shards);
+        // Latency of an event is the time its shard spent on it since the
+        // previous one finished there
+        std::vector<ReplayClock::time_point> finished(commands.size());
+        auto start = ReplayClock::now();
+        engine.replay(commands, [&](size_t index) { finished[index] = ReplayClock::now(); });
+        elapsed_s = std::chrono::duration<double>(ReplayClock::now() - start).count();
+
+        std::vector<ReplayClock::time_point> shard_clock(engine.shard_count(), start);
+        for (size_t i = 0; i < commands.size(); ++i) {
+            auto& previous = shard_clock[symbol_directory().intern(commands[i].symbol) % engine.shard_count()];
+            latencies.push_back(std::chrono::duration<double, std::nano>(finished[i] - previous).count());
+            previous = finished[i];
+        }
+        shard_count = engine.shard_count();
+        std::map<std::string, bool> symbols;
+        for (const auto& command : commands) {
+            if (command.type != JournalRecordType::SYMBOL_CONFIG && command.type != JournalRecordType::VWAP_ORDER) {
+                symbols[command.symbol] = true;
+            }
+        }
+        for (const auto& entry : symbols) {
+            BookImage image;
+            engine.capture_book(entry.first, image);
+            checksum.add_book(entry.first, image);
+        }
+    }
+
+    std::cout << (options.book_mode ? "book" : "engine") << " replay of " << commands.size() << " events";
+    if (shard_count > 0) std::cout << " (" << shard_count << " shards)";
+    std::cout << std::endl;
+    std::cout << std::fixed << std::setprecision(0)
+              << "throughput: " << static_cast<double>(commands.size()) / elapsed_s << " events/s" << std::endl;
+    std::cout << "latency ns: p50 " << percentile(latencies, 0.50) << "  p90 " << percentile(latencies, 0.90)
+              << "  p99 " << percentile(latencies, 0.99) << "  p99.9 " << percentile(latencies, 0.999)
+              << "  max " << percentile(latencies, 1.0) << std::endl;
+    std::cout << "state checksum: " << std::hex << std::setw(16) << std::setfill('0') << checksum.value() << std::endl;
+    return 0;
+}
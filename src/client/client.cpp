@@ -74,7 +74,7 @@ public:
         std::string input;
         
         while (true) {
-            std::cout << "\nCommands: ORDER, STOP_LIMIT_ORDER, TRAILING_STOP_ORDER, VWAP_ORDER, VWAP_STATUS, CANCEL, BOOK, LOGOUT, QUIT" << std::endl;
+            std::cout << "\nCommands: ORDER, STOP_LIMIT_ORDER, TRAILING_STOP_ORDER, VWAP_ORDER, VWAP_STATUS, BATCH, CANCEL, AMEND, BOOK, DEPTH, LOGOUT, QUIT" << std::endl;
             std::cout << "Enter command: ";
             std::getline(std::cin, input);
             
@@ -93,10 +93,16 @@ public:
                 place_vwap_order();
             } else if (input == "VWAP_STATUS") {
                 get_vwap_status();
+            } else if (input == "BATCH") {
+                place_batch();
             } else if (input == "CANCEL") {
                 cancel_order();
+            } else if (input == "AMEND") {
+                amend_order();
             } else if (input == "BOOK") {
                 get_book();
+            } else if (input == "DEPTH") {
+                get_depth();
             } else if (input == "LOGOUT") {
                 logout();
                 break;
@@ -112,7 +118,7 @@ public:
             return;
         }
         
-        std::string symbol, type, side;
+        std::string symbol, type, side, time_in_force;
         double price, quantity;
         
         std::cout << "Symbol: ";
@@ -125,10 +131,42 @@ public:
         std::cin >> price;
         std::cout << "Quantity: ";
         std::cin >> quantity;
+        std::cout << "Time in force (DAY/IOC/FOK/GTC): ";
+        std::cin >> time_in_force;
         std::cin.ignore();
         
         std::string message = "ORDER " + symbol + " " + type + " " + side + " " + 
-                             std::to_string(price) + " " + std::to_string(quantity) + " " + client_id;
+                             std::to_string(price) + " " + std::to_string(quantity) + " " + client_id + " " +
+                             time_in_force;
+        
+        send_message(message);
+    }
+    
+    void place_batch() {
+        if (!authenticated) {
+            std::cout << "Not authenticated. Please login first." << std::endl;
+            return;
+        }
+        
+        int count;
+        std::cout << "Number of orders: ";
+        std::cin >> count;
+        if (count <= 0) {
+            std::cin.ignore();
+            std::cout << "A batch needs at least one order" << std::endl;
+            return;
+        }
+        
+        std::string message = "BATCH " + client_id + " " + std::to_string(count);
+        for (int i = 0; i < count; ++i) {
+            std::string symbol, type, side;
+            double price, quantity;
+            std::cout << "Order " << (i + 1) << " (symbol type side price quantity): ";
+            std::cin >> symbol >> type >> side >> price >> quantity;
+            message += " " + symbol + " " + type + " " + side + " " +
+                       std::to_string(price) + " " + std::to_string(quantity);
+        }
+        std::cin.ignore();
         
         send_message(message);
     }
@@ -325,6 +363,27 @@ public:
         send_message(message);
     }
     
+    void amend_order() {
+        if (!authenticated) {
+            std::cout << "Not authenticated. Please login first." << std::endl;
+            return;
+        }
+        
+        uint64_t order_id;
+        double price, quantity;
+        std::cout << "Order ID to amend: ";
+        std::cin >> order_id;
+        std::cout << "New price: ";
+        std::cin >> price;
+        std::cout << "New total quantity: ";
+        std::cin >> quantity;
+        std::cin.ignore();
+        
+        std::string message = "AMEND " + std::to_string(order_id) + " " + std::to_string(price) + " " +
+                              std::to_string(quantity) + " " + client_id;
+        send_message(message);
+    }
+    
     void get_book() {
         std::string symbol;
         std::cout << "Symbol: ";
@@ -335,19 +394,38 @@ public:
         send_message(message);
     }
     
+    void get_depth() {
+        std::string symbol;
+        int levels;
+        std::cout << "Symbol: ";
+        std::cin >> symbol;
+        std::cout << "Levels: ";
+        std::cin >> levels;
+        std::cin.ignore();
+        
+        std::string message = "DEPTH " + symbol + " " + std::to_string(levels);
+        send_message(message);
+    }
+    
     std::string send_message(const std::string& message) {
         std::cout << "DEBUG: Sending message: [" << message << "]" << std::endl;
-        send(sock_fd, message.c_str(), message.length(), 0);
+        // The server frames messages on newlines
+        std::string line = message + "\n";
+        send(sock_fd, line.c_str(), line.length(), 0);
         
+        // Responses end with a newline; long ones (BATCH) take several reads
+        std::string response;
         char buffer[1024];
-        int bytes_read = read(sock_fd, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
+        while (response.empty() || response.back() != '\n') {
+            int bytes_read = read(sock_fd, buffer, sizeof(buffer) - 1);
+            if (bytes_read <= 0) break;
             buffer[bytes_read] = '\0';
-            std::string response(buffer);
+            response += buffer;
+        }
+        if (!response.empty()) {
             std::cout << "Server response: " << response;
-            return response;
         }
-        return "";
+        return response;
     }
     
     ~TradingClient() {
@@ -0,0 +1,41 @@
+#include "Binary.h"
+#include <array>
+#include <cstring>
+
+// Eight bytes per step (slicing-by-8, little-endian loads)
+uint32_t crc32(const char* data, size_t size) {
+    using Tables = std::array<std::array<uint32_t, 256>, 8>;
+    static const Tables tables = [] {
+        Tables t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t k = 1; k < 8; ++k) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^
+              tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+              tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^
+              tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = tables[0][(crc ^ static_cast<uint8_t>(*data)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
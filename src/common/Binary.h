@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Helpers for the engine's on-disk formats (journal records, snapshots).
+// Fields are stored as raw host-order bytes; files are not meant to move
+// between machines of different endianness.
+
+// CRC-32 (IEEE)
+uint32_t crc32(const char* data, size_t size);
+
+template <typename T>
+void put(std::vector<char>& out, T value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Length-prefixed; longer strings are cut at 64 KB
+inline void put_string(std::vector<char>& out, const std::string& value) {
+    uint16_t size = static_cast<uint16_t>(std::min<size_t>(value.size(), UINT16_MAX));
+    put(out, size);
+    out.insert(out.end(), value.data(), value.data() + size);
+}
+
+// Reads fields back in the order put() wrote them; fails past the end
+class BinaryReader {
+private:
+    const char* data;
+    size_t size;
+    size_t offset;
+
+public:
+    BinaryReader(const char* _data, size_t _size) : data(_data), size(_size), offset(0) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (size - offset < sizeof(T)) return false;
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    bool get_string(std::string& value) {
+        uint16_t length;
+        if (!get(length) || size - offset < length) return false;
+        value.assign(data + offset, length);
+        offset += length;
+        return true;
+    }
+
+    size_t remaining() const { return size - offset; }
+};
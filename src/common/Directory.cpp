@@ -0,0 +1,109 @@
+#include "Directory.h"
+
+namespace {
+
+std::atomic<uint64_t> next_serial(1);
+
+// Ids this thread has resolved, by directory serial
+thread_local std::unordered_map<uint64_t, std::unordered_map<std::string, uint32_t>> cached_ids;
+
+}
+
+NameDirectory::NameDirectory()
+    : published(new std::atomic<std::atomic<const std::string*>*>[MAX_CHUNKS]()),
+      serial(next_serial.fetch_add(1, std::memory_order_relaxed)) {}
+
+NameDirectory::~NameDirectory() {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        delete[] published[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t NameDirectory::intern(const std::string& name) {
+    uint32_t id;
+    if (find_cached(name, id)) {
+        return id;
+    }
+    
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        cache(name, it->second);
+        return it->second;
+    }
+    id = static_cast<uint32_t>(names.size());
+    names.push_back(name);
+    ids.emplace(name, id);
+    
+    size_t chunk = id >> CHUNK_BITS;
+    if (chunk < MAX_CHUNKS) {
+        auto* entries = published[chunk].load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new std::atomic<const std::string*>[CHUNK_SIZE]();
+            published[chunk].store(entries, std::memory_order_release);
+        }
+        entries[id & (CHUNK_SIZE - 1)].store(&names.back(), std::memory_order_release);
+    }
+    cache(name, id);
+    return id;
+}
+
+bool NameDirectory::find(const std::string& name, uint32_t& id) const {
+    if (find_cached(name, id)) {
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    auto it = ids.find(name);
+    if (it == ids.end()) {
+        return false;
+    }
+    id = it->second;
+    cache(name, id);
+    return true;
+}
+
+const std::string& NameDirectory::name(uint32_t id) const {
+    static const std::string unknown;
+    size_t chunk = id >> CHUNK_BITS;
+    if (chunk < MAX_CHUNKS) {
+        auto* entries = published[chunk].load(std::memory_order_acquire);
+        const std::string* stored = entries ? entries[id & (CHUNK_SIZE - 1)].load(std::memory_order_acquire) : nullptr;
+        return stored ? *stored : unknown;
+    }
+    // Ids past the chunks are only found under the lock
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    return (id < names.size()) ? names[id] : unknown;
+}
+
+size_t NameDirectory::size() const {
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    return names.size();
+}
+
+bool NameDirectory::find_cached(const std::string& name, uint32_t& id) const {
+    auto directory = cached_ids.find(serial);
+    if (directory == cached_ids.end()) return false;
+    auto it = directory->second.find(name);
+    if (it == directory->second.end()) return false;
+    id = it->second;
+    return true;
+}
+
+void NameDirectory::cache(const std::string& name, uint32_t id) const {
+    auto& cached = cached_ids[serial];
+    if (cached.size() >= MAX_CACHED_NAMES) {
+        cached.clear();
+    }
+    cached.emplace(name, id);
+}
+
+NameDirectory& symbol_directory() {
+    static NameDirectory directory;
+    return directory;
+}
+
+NameDirectory& client_directory() {
+    static NameDirectory directory;
+    return directory;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using SymbolId = uint32_t;
+using ClientId = uint32_t;
+
+// Maps names to dense ids in first-seen order. Ids are never reused, so they
+// can index plain arrays, and references returned by name() stay valid.
+// name() never locks: each name is published in a fixed chunk before its id
+// is handed out. Each thread also remembers up to MAX_CACHED_NAMES ids it has
+// looked up, so a name it has seen before is usually resolved without
+// directory_mutex; only names already interned are cached.
+class NameDirectory {
+private:
+    static constexpr size_t CHUNK_BITS = 10;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t MAX_CHUNKS = size_t(1) << 16;
+    // Per thread and directory; a full cache starts over
+    static constexpr size_t MAX_CACHED_NAMES = 4096;
+
+    mutable std::mutex directory_mutex;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::deque<std::string> names;
+    // Chunks are added under directory_mutex and never move
+    std::unique_ptr<std::atomic<std::atomic<const std::string*>*>[]> published;
+    // Tells this directory's entries apart in the per-thread caches
+    uint64_t serial;
+
+public:
+    NameDirectory();
+    ~NameDirectory();
+    NameDirectory(const NameDirectory&) = delete;
+    NameDirectory& operator=(const NameDirectory&) = delete;
+
+    uint32_t intern(const std::string& name);
+    bool find(const std::string& name, uint32_t& id) const;
+    const std::string& name(uint32_t id) const;
+    size_t size() const;
+
+private:
+    bool find_cached(const std::string& name, uint32_t& id) const;
+    void cache(const std::string& name, uint32_t id) const;
+};
+
+// Process-wide directories. Names are interned where they enter the engine;
+// everything past that point carries the ids.
+NameDirectory& symbol_directory();
+NameDirectory& client_directory();
@@ -0,0 +1,470 @@
+#include "Journal.h"
+#include "Binary.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct RecordHeader {
+    uint64_t sequence;
+    uint32_t size;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t crc;
+    uint32_t padding;
+};
+static_assert(sizeof(RecordHeader) == 24, "journal record header layout");
+
+// Records start on 8-byte boundaries
+size_t record_length(uint32_t payload_size) {
+    return sizeof(RecordHeader) + ((payload_size + 7) & ~size_t(7));
+}
+
+void encode(const JournalCommand& command, std::vector<char>& out) {
+    put(out, command.order_id);
+    put(out, command.parent_id);
+    put(out, static_cast<uint8_t>(command.order_type));
+    put(out, static_cast<uint8_t>(command.side));
+    put(out, command.price);
+    put(out, command.limit_price);
+    put(out, command.quantity);
+    put(out, command.start_time);
+    put(out, command.end_time);
+    put(out, command.config.tick_size);
+    put(out, static_cast<uint8_t>(command.config.backend));
+    put(out, static_cast<uint64_t>(command.config.dense_levels));
+    put_string(out, command.symbol);
+    put_string(out, command.client_id);
+    put(out, static_cast<uint8_t>(command.time_in_force));
+}
+
+bool decode(const char* payload, size_t size, JournalCommand& command) {
+    BinaryReader reader(payload, size);
+    uint8_t order_type, side, backend, time_in_force;
+    uint64_t dense_levels;
+    Price tick_size;
+    if (!reader.get(command.order_id) || !reader.get(command.parent_id) ||
+        !reader.get(order_type) || !reader.get(side) ||
+        !reader.get(command.price) || !reader.get(command.limit_price) || !reader.get(command.quantity) ||
+        !reader.get(command.start_time) || !reader.get(command.end_time) ||
+        !reader.get(tick_size) || !reader.get(backend) || !reader.get(dense_levels) ||
+        !reader.get_string(command.symbol) || !reader.get_string(command.client_id) ||
+        !reader.get(time_in_force)) {
+        return false;
+    }
+    // An enum value no build ever wrote means the record isn't ours
+    if (order_type > static_cast<uint8_t>(OrderType::VWAP) || side > static_cast<uint8_t>(OrderSide::SELL) ||
+        backend > static_cast<uint8_t>(BookBackend::DENSE) ||
+        time_in_force > static_cast<uint8_t>(TimeInForce::GTC)) {
+        return false;
+    }
+    command.order_type = static_cast<OrderType>(order_type);
+    command.side = static_cast<OrderSide>(side);
+    command.time_in_force = static_cast<TimeInForce>(time_in_force);
+    command.config = SymbolConfig(tick_size, static_cast<BookBackend>(backend), dense_levels);
+    return true;
+}
+
+std::string segment_path(const std::string& directory, uint64_t first_sequence) {
+    char name[48];
+    std::snprintf(name, sizeof(name), "/journal-%020llu.log", static_cast<unsigned long long>(first_sequence));
+    return directory + name;
+}
+
+// Segments in the directory by first sequence, oldest first
+bool list_segments(const std::string& directory, std::vector<std::pair<uint64_t, std::string>>& segments) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return false;
+    while (dirent* entry = readdir(dir)) {
+        unsigned long long first;
+        char tail[8];
+        if (std::sscanf(entry->d_name, "journal-%20llu.%7s", &first, tail) == 2 && std::strcmp(tail, "log") == 0) {
+            segments.emplace_back(first, directory + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return true;
+}
+
+// Calls `visit` for each intact record of a segment until it returns false;
+// false if the file can't be read
+bool scan_segment(const std::string& path,
+                  const std::function<bool(const RecordHeader&, const char*)>& visit) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(mapped);
+    size_t offset = 0;
+    while (size - offset >= sizeof(RecordHeader)) {
+        RecordHeader header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        if (header.sequence == 0 || header.size == 0 || record_length(header.size) > size - offset) break;
+        const char* payload = data + offset + sizeof(header);
+        if (crc32(payload, header.size) != header.crc) break;
+        if (!visit(header, payload)) break;
+        offset += record_length(header.size);
+    }
+    munmap(mapped, size);
+    return true;
+}
+
+bool sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+}
+
+int64_t journal_time(std::chrono::steady_clock::time_point when) {
+    auto wall = std::chrono::system_clock::now() +
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(when - std::chrono::steady_clock::now());
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(wall.time_since_epoch()).count();
+}
+
+std::chrono::steady_clock::time_point steady_time(int64_t journal_ns) {
+    std::chrono::system_clock::time_point wall(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(journal_ns)));
+    return std::chrono::steady_clock::now() +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(wall - std::chrono::system_clock::now());
+}
+
+Journal::Journal(const JournalConfig& _config)
+    : config(_config), pending_events(0), next_sequence(1), stopping(false), durable(0), failed(false),
+      segment_fd(-1), segment_map(nullptr), segment_offset(0), synced_offset(0) {
+    // A segment must hold at least a few records of the largest size
+    config.segment_size = std::max<size_t>(config.segment_size, 1u << 20);
+}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::open() {
+    if (flusher.joinable()) return false;
+    if (mkdir(config.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    if (!list_segments(config.directory, segments)) return false;
+
+    // Continue after the last intact record; a torn tail is left behind
+    uint64_t last = 0;
+    if (!segments.empty()) {
+        last = segments.back().first - 1;
+        if (!scan_segment(segments.back().second, [&](const RecordHeader& header, const char*) {
+                if (header.sequence != last + 1) return false;
+                last = header.sequence;
+                return true;
+            })) {
+            return false;
+        }
+    }
+    next_sequence = last + 1;
+    durable.store(last);
+
+    if (!open_segment(next_sequence)) return false;
+    stopping = false;
+    failed.store(false);
+    flusher = std::thread(&Journal::run_flusher, this);
+    return true;
+}
+
+void Journal::close() {
+    if (!flusher.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(append_mutex);
+        stopping = true;
+    }
+    flush_wakeup.notify_one();
+    flusher.join();
+    close_segment();
+    durable_wakeup.notify_all();
+}
+
+uint64_t Journal::append(JournalCommand& command) {
+    if (failed.load(std::memory_order_relaxed)) return 0;
+
+    // Encode outside the lock; only the copy into the group is serialised
+    thread_local std::vector<char> payload;
+    payload.clear();
+    encode(command, payload);
+
+    RecordHeader header{};
+    header.size = static_cast<uint32_t>(payload.size());
+    header.type = static_cast<uint16_t>(command.type);
+    header.crc = crc32(payload.data(), payload.size());
+    size_t padding = record_length(header.size) - sizeof(header) - payload.size();
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(append_mutex);
+        if (stopping) return 0;
+        header.sequence = next_sequence++;
+        const char* bytes = reinterpret_cast<const char*>(&header);
+        pending.insert(pending.end(), bytes, bytes + sizeof(header));
+        pending.insert(pending.end(), payload.begin(), payload.end());
+        pending.insert(pending.end(), padding, '\0');
+        ++pending_events;
+        // The flusher sleeps until a group starts, and is cut short when it fills
+        wake = pending_events == 1 || pending_events == config.commit_events;
+    }
+    if (wake) {
+        flush_wakeup.notify_one();
+    }
+
+    command.sequence = header.sequence;
+    return header.sequence;
+}
+
+bool Journal::wait_durable(uint64_t sequence) {
+    if (sequence == 0) return false;
+    if (durable.load(std::memory_order_acquire) >= sequence) return true;
+
+    std::unique_lock<std::mutex> lock(durable_mutex);
+    durable_wakeup.wait(lock, [&] {
+        return durable.load(std::memory_order_acquire) >= sequence || failed.load();
+    });
+    return durable.load(std::memory_order_acquire) >= sequence;
+}
+
+uint64_t Journal::last_sequence() {
+    std::lock_guard<std::mutex> lock(append_mutex);
+    return next_sequence - 1;
+}
+
+void Journal::run_flusher() {
+    std::vector<char> batch;
+    RecordSink sink;
+    for (;;) {
+        uint64_t last;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(append_mutex);
+            flush_wakeup.wait(lock, [&] { return stopping || pending_events > 0; });
+            // Hold the group open for the commit window unless it is full
+            if (!stopping && config.commit_interval.count() > 0 && pending_events < config.commit_events) {
+                flush_wakeup.wait_for(lock, config.commit_interval,
+                                      [&] { return stopping || pending_events >= config.commit_events; });
+            }
+            batch.swap(pending);
+            pending_events = 0;
+            last = next_sequence - 1;
+            stop = stopping;
+            sink = record_sink;
+        }
+        if (sink && !batch.empty()) {
+            sink(batch.data(), batch.size(), last);
+        }
+
+        bool written = batch.empty() || (write_records(batch) && sync_segment());
+        batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(durable_mutex);
+            if (written) {
+                durable.store(last, std::memory_order_release);
+            } else {
+                failed.store(true);
+            }
+        }
+        durable_wakeup.notify_all();
+
+        if (stop || !written) return;
+    }
+}
+
+bool Journal::write_records(const std::vector<char>& records) {
+    size_t run_start = 0;
+    size_t offset = 0;
+    // Copies records [run_start, offset) into the current segment
+    auto write_run = [&]() {
+        size_t length = offset - run_start;
+        if (length == 0) return true;
+        if (segment_map) {
+            std::memcpy(segment_map + segment_offset, records.data() + run_start, length);
+        } else {
+            size_t written = 0;
+            while (written < length) {
+                ssize_t n = pwrite(segment_fd, records.data() + run_start + written, length - written,
+                                   static_cast<off_t>(segment_offset + written));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                written += static_cast<size_t>(n);
+            }
+        }
+        segment_offset += length;
+        run_start = offset;
+        return true;
+    };
+
+    while (offset < records.size()) {
+        RecordHeader header;
+        std::memcpy(&header, records.data() + offset, sizeof(header));
+        size_t length = record_length(header.size);
+
+        if (segment_offset + (offset - run_start) + length > config.segment_size) {
+            // Rotate: what is already in this segment is synced before moving on
+            if (!write_run() || !sync_segment()) return false;
+            close_segment();
+            if (!open_segment(header.sequence)) return false;
+        }
+        offset += length;
+    }
+    return write_run();
+}
+
+bool Journal::open_segment(uint64_t first_sequence) {
+    std::string path = segment_path(config.directory, first_sequence);
+    // A segment already at this path holds no intact record: open() resumes
+    // here only when the first one was torn. Whatever follows it was never
+    // acknowledged and must not be read back behind the new records.
+    segment_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (segment_fd < 0) return false;
+
+    // Preallocate so appends never change the file size and a data sync
+    // never has to write metadata
+    if (posix_fallocate(segment_fd, 0, static_cast<off_t>(config.segment_size)) != 0 &&
+        ftruncate(segment_fd, static_cast<off_t>(config.segment_size)) != 0) {
+        close_segment();
+        return false;
+    }
+
+    if (config.use_mmap) {
+        void* mapped = mmap(nullptr, config.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+        if (mapped == MAP_FAILED) {
+            close_segment();
+            return false;
+        }
+        segment_map = static_cast<char*>(mapped);
+    }
+    segment_offset = 0;
+    synced_offset = 0;
+    return sync_directory(config.directory);
+}
+
+void Journal::close_segment() {
+    if (segment_map) {
+        munmap(segment_map, config.segment_size);
+        segment_map = nullptr;
+    }
+    if (segment_fd >= 0) {
+        ::close(segment_fd);
+        segment_fd = -1;
+    }
+}
+
+bool Journal::sync_segment() {
+    if (segment_offset == synced_offset) return true;
+    bool synced;
+    if (segment_map) {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = synced_offset & ~(page - 1);
+        synced = msync(segment_map + start, segment_offset - start, MS_SYNC) == 0;
+    } else {
+        synced = fdatasync(segment_fd) == 0;
+    }
+    if (synced) {
+        synced_offset = segment_offset;
+    }
+    return synced;
+}
+
+void Journal::set_record_sink(RecordSink sink) {
+    std::lock_guard<std::mutex> lock(append_mutex);
+    record_sink = std::move(sink);
+}
+
+size_t Journal::decode_records(const char* data, size_t size, std::vector<JournalCommand>& out, bool& corrupt) {
+    corrupt = false;
+    size_t offset = 0;
+    while (size - offset >= sizeof(RecordHeader)) {
+        RecordHeader header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        if (header.sequence == 0 && header.size == 0) {
+            offset += sizeof(header);
+            continue;
+        }
+        // No valid record comes near a megabyte; don't wait for one that long
+        if (header.size > (1u << 20)) {
+            corrupt = true;
+            break;
+        }
+        if (record_length(header.size) > size - offset) break;
+        const char* payload = data + offset + sizeof(header);
+        JournalCommand command(static_cast<JournalRecordType>(header.type));
+        command.sequence = header.sequence;
+        if (header.sequence == 0 || crc32(payload, header.size) != header.crc ||
+            !decode(payload, header.size, command)) {
+            corrupt = true;
+            break;
+        }
+        out.push_back(std::move(command));
+        offset += record_length(header.size);
+    }
+    return offset;
+}
+
+bool Journal::replay(const std::string& directory, uint64_t after,
+                     const std::function<void(const JournalCommand&)>& apply, uint64_t through) {
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    if (!list_segments(directory, segments)) {
+        // A journal that was never opened has nothing to replay
+        return errno == ENOENT;
+    }
+
+    uint64_t expected = 0;
+    for (size_t i = 0; i < segments.size() && segments[i].first <= through; ++i) {
+        // Skip segments that end before the first wanted record
+        if (i + 1 < segments.size() && segments[i + 1].first <= after + 1) continue;
+
+        // Set at a gap, an undecodable record or the end of the range
+        bool done = false;
+        JournalCommand command;
+        if (!scan_segment(segments[i].second, [&](const RecordHeader& header, const char* payload) {
+                if ((expected != 0 && header.sequence != expected) || header.sequence > through) {
+                    done = true;
+                    return false;
+                }
+                expected = header.sequence + 1;
+                if (header.sequence <= after) return true;
+
+                command.type = static_cast<JournalRecordType>(header.type);
+                command.sequence = header.sequence;
+                if (!decode(payload, header.size, command)) {
+                    done = true;
+                    return false;
+                }
+                apply(command);
+                return true;
+            })) {
+            return false;
+        }
+        if (done) break;
+    }
+    return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include "Order.h"
+#include "Price.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Engine input the journal records
+enum class JournalRecordType : uint16_t {
+    ORDER = 1,            // submit_order, or one order of a batch
+    STOP_LIMIT_ORDER,
+    TRAILING_STOP_ORDER,
+    VWAP_ORDER,
+    VWAP_SLICE,           // child order the engine placed for a VWAP parent
+    CANCEL,
+    SYMBOL_CONFIG,
+    AMEND,                // new price and total quantity of a resting order
+};
+
+// One accepted command with the order id the engine gave it, so replaying
+// the journal rebuilds the same state. Prices are the engine's fixed-point
+// values; VWAP times are wall-clock nanoseconds so they survive a restart.
+struct JournalCommand {
+    JournalRecordType type;
+    uint64_t sequence;      // assigned by the journal
+    uint64_t order_id;
+    uint64_t parent_id;     // VWAP_SLICE
+    OrderType order_type;
+    OrderSide side;
+    TimeInForce time_in_force;  // ORDER
+    Price price;            // limit, stop, trailing amount, target VWAP or amended price
+    Price limit_price;      // STOP_LIMIT_ORDER
+    double quantity;
+    int64_t start_time;     // VWAP_ORDER
+    int64_t end_time;
+    std::string symbol;
+    std::string client_id;
+    SymbolConfig config;    // SYMBOL_CONFIG
+
+    JournalCommand(JournalRecordType _type = JournalRecordType::ORDER)
+        : type(_type), sequence(0), order_id(0), parent_id(0), order_type(OrderType::LIMIT),
+          side(OrderSide::BUY), time_in_force(TimeInForce::DAY), price(0), limit_price(0), quantity(0.0),
+          start_time(0), end_time(0) {}
+};
+
+// Conversions between the engine's steady clock and journalled wall-clock time
+int64_t journal_time(std::chrono::steady_clock::time_point when);
+std::chrono::steady_clock::time_point steady_time(int64_t journal_ns);
+
+struct JournalConfig {
+    std::string directory;
+    // Segments are preallocated to this size and rotated when full
+    size_t segment_size;
+    // Group commit: a sync covers everything appended within this window,
+    // or is issued early once this many records are waiting. With no window
+    // the flusher syncs as soon as it is free, and whatever arrives during
+    // one sync forms the next group.
+    std::chrono::microseconds commit_interval;
+    size_t commit_events;
+    // Write segments through a shared mapping (msync) instead of pwrite (fdatasync)
+    bool use_mmap;
+
+    JournalConfig(const std::string& _directory = "journal", size_t _segment_size = 64u << 20,
+                  std::chrono::microseconds _commit_interval = std::chrono::microseconds(0),
+                  size_t _commit_events = 256, bool _use_mmap = false)
+        : directory(_directory), segment_size(_segment_size), commit_interval(_commit_interval),
+          commit_events(_commit_events > 0 ? _commit_events : 1), use_mmap(_use_mmap) {}
+};
+
+// Sequenced, append-only binary journal of engine input. append() encodes a
+// record into an in-memory buffer and returns its sequence; a background
+// thread writes the buffer to the current segment and syncs it, one sync per
+// group of records. wait_durable() blocks until a sequence is on disk.
+//
+// Segments are files named journal-<first sequence>.log. A record is a
+// fixed header (sequence, payload size, type, CRC-32 of the payload)
+// followed by the payload. Unwritten space is zero, so a reader stops at
+// the first header with no payload or a bad checksum, which also cuts off
+// a record torn by a crash.
+class Journal {
+public:
+    // Receives each group of encoded records, in sequence order, as the
+    // flusher takes it; `last_sequence` is the group's last record
+    using RecordSink = std::function<void(const char* records, size_t size, uint64_t last_sequence)>;
+
+private:
+    JournalConfig config;
+
+    std::mutex append_mutex;
+    std::condition_variable flush_wakeup;
+    std::vector<char> pending;
+    size_t pending_events;
+    uint64_t next_sequence;
+    bool stopping;
+
+    std::mutex durable_mutex;
+    std::condition_variable durable_wakeup;
+    std::atomic<uint64_t> durable;
+    std::atomic<bool> failed;
+
+    // Current segment; only the flusher touches these once open() returns
+    int segment_fd;
+    char* segment_map;
+    size_t segment_offset;
+    size_t synced_offset;
+
+    std::thread flusher;
+    RecordSink record_sink;
+
+public:
+    explicit Journal(const JournalConfig& _config = JournalConfig());
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Creates the directory if needed and continues after the last intact
+    // record found there; false if the directory or a segment can't be opened
+    bool open();
+    void close();
+
+    // Sets command.sequence and returns it; 0 if the journal has failed
+    uint64_t append(JournalCommand& command);
+    // Returns once `sequence` is durable; false if the journal failed first
+    bool wait_durable(uint64_t sequence);
+
+    const std::string& directory() const { return config.directory; }
+    uint64_t durable_sequence() const { return durable.load(std::memory_order_acquire); }
+    uint64_t last_sequence();
+    bool healthy() const { return !failed.load(std::memory_order_acquire); }
+
+    // Calls `apply` for every intact record after sequence `after`, in order,
+    // up to and including `through`. Stops at the first gap in the sequence;
+    // false if the directory exists but can't be read.
+    static bool replay(const std::string& directory, uint64_t after,
+                       const std::function<void(const JournalCommand&)>& apply,
+                       uint64_t through = UINT64_MAX);
+
+    // Groups go to `sink` before they are written, so a replica can apply
+    // them while the primary syncs. Null stops it.
+    void set_record_sink(RecordSink sink);
+
+    // Decodes the whole records at the front of `data` into `out` and returns
+    // the bytes they took; a partial record at the end is left for later.
+    // A header of zeros is a keep-alive and is skipped. Sets `corrupt` on a
+    // record that fails its checksum.
+    static size_t decode_records(const char* data, size_t size, std::vector<JournalCommand>& out, bool& corrupt);
+
+private:
+    void run_flusher();
+    bool write_records(const std::vector<char>& records);
+    bool open_segment(uint64_t first_sequence);
+    void close_segment();
+    bool sync_segment();
+};
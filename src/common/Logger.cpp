@@ -0,0 +1,298 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+std::atomic<uint64_t> next_logger_instance(1);
+
+// Rings this thread has registered, one per logger it has written to
+struct ThreadRings {
+    std::vector<std::pair<uint64_t, std::shared_ptr<LogRing>>> rings;
+
+    ~ThreadRings() {
+        for (auto& entry : rings) {
+            entry.second->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadRings thread_rings;
+thread_local LogLevel thread_level = LogLevel::DEBUG;
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void copy_text(char (&to)[24], const char* from) {
+    if (!from) {
+        to[0] = '\0';
+        return;
+    }
+    std::strncpy(to, from, sizeof(to) - 1);
+    to[sizeof(to) - 1] = '\0';
+}
+
+const char* side_name(uint64_t side) {
+    return side == static_cast<uint64_t>(OrderSide::BUY) ? "BUY" : "SELL";
+}
+
+}
+
+LogRing::LogRing(size_t capacity) : records(capacity > 0 ? capacity : 1), head(0), tail(0), retired(false) {}
+
+bool LogRing::push(const LogRecord& record) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= records.size()) {
+        return false;
+    }
+    records[h % records.size()] = record;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+size_t LogRing::drain(std::vector<LogRecord>& out) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    for (uint64_t i = t; i < h; ++i) {
+        out.push_back(records[i % records.size()]);
+    }
+    tail.store(h, std::memory_order_release);
+    return static_cast<size_t>(h - t);
+}
+
+bool LogRing::empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+Logger::Logger(size_t _ring_capacity)
+    : level(LogLevel::INFO), output(&std::cout), dropped(0), ring_capacity(_ring_capacity),
+      instance(next_logger_instance.fetch_add(1)), stopping(false), flush_requested(0), flush_completed(0) {
+    writer = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void Logger::set_output(std::ostream* stream) {
+    // Let lines already queued for the old stream reach it first
+    flush();
+    output.store(stream);
+}
+
+void Logger::log(LogLevel at, LogEvent event, uint64_t id0, uint64_t id1,
+                 double v0, double v1, double v2, const char* text0, const char* text1) {
+    if (!enabled(at) || at < thread_level) return;
+
+    LogRecord record;
+    record.timestamp = now_ns();
+    record.event = event;
+    record.level = at;
+    record.ids[0] = id0;
+    record.ids[1] = id1;
+    record.values[0] = v0;
+    record.values[1] = v1;
+    record.values[2] = v2;
+    copy_text(record.text[0], text0);
+    copy_text(record.text[1], text1);
+
+    LogRing* ring = thread_ring();
+    if (!ring || !ring->push(record)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    uint64_t target = ++flush_requested;
+    wake.notify_one();
+    flushed.wait(lock, [&] { return flush_completed >= target; });
+}
+
+LogRing* Logger::thread_ring() {
+    for (auto& entry : thread_rings.rings) {
+        if (entry.first == instance) {
+            return entry.second.get();
+        }
+    }
+
+    // First record from this thread: register a ring (the only allocation)
+    auto ring = std::make_shared<LogRing>(ring_capacity);
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(ring);
+    }
+    thread_rings.rings.emplace_back(instance, ring);
+    return ring.get();
+}
+
+void Logger::run() {
+    std::vector<LogRecord> batch;
+    for (;;) {
+        uint64_t target;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            // Writers never signal; poll often enough that output stays live
+            wake.wait_for(lock, std::chrono::milliseconds(1),
+                          [&] { return stopping || flush_requested != flush_completed; });
+            target = flush_requested;
+            stop = stopping;
+        }
+
+        write_pending(batch);
+
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            flush_completed = target;
+        }
+        flushed.notify_all();
+
+        if (stop) return;
+    }
+}
+
+void Logger::write_pending(std::vector<LogRecord>& batch) {
+    std::vector<std::shared_ptr<LogRing>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        // Rings of exited threads go once everything they wrote is out
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<LogRing>& ring) {
+            return ring->retired.load(std::memory_order_acquire) && ring->empty();
+        }), rings.end());
+        snapshot = rings;
+    }
+
+    batch.clear();
+    for (auto& ring : snapshot) {
+        ring->drain(batch);
+    }
+    if (batch.empty()) return;
+
+    std::stable_sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    std::ostream* out = output.load();
+    for (const auto& record : batch) {
+        format(*out, record);
+    }
+    out->flush();
+}
+
+void Logger::format(std::ostream& out, const LogRecord& record) {
+    const uint64_t* ids = record.ids;
+    const double* values = record.values;
+
+    switch (record.event) {
+        case LogEvent::TRADE_EXECUTED:
+            out << "Trade executed: " << values[0] << " @ " << values[1]
+                << " between " << client_directory().name(static_cast<ClientId>(ids[0]))
+                << " and " << client_directory().name(static_cast<ClientId>(ids[1])) << "\n";
+            break;
+        case LogEvent::STOP_TRIGGERED:
+            out << "Stop order " << ids[0] << " triggered "
+                << (ids[1] ? "immediately" : "due to price movement") << " at price " << values[0] << "\n";
+            break;
+        case LogEvent::STOP_LIMIT_CONVERTED:
+            out << "Stop limit order " << ids[0] << " converted to limit order at price " << values[0] << "\n";
+            break;
+        case LogEvent::STOP_FILLED:
+            out << "Stop loss order " << ids[0] << " fully executed: " << values[0] << " shares\n";
+            break;
+        case LogEvent::STOP_PARTIAL:
+            out << "Stop loss order " << ids[0] << " partially executed: " << values[0] << "/" << values[1] << " shares\n"
+                << "Remaining " << (values[1] - values[0]) << " shares rejected - no liquidity\n";
+            break;
+        case LogEvent::STOP_REJECTED:
+            out << "Stop loss order " << ids[0] << " rejected: no liquidity available\n";
+            break;
+        case LogEvent::TRAILING_REPRICED:
+            out << "Trailing stop group of " << ids[0] << " orders updated: "
+                << (ids[1] == static_cast<uint64_t>(OrderSide::SELL) ? "highest=" : "lowest=") << values[0]
+                << ", stop=" << values[1] << "\n";
+            break;
+        case LogEvent::MARKET_FILLED:
+            out << "Market " << side_name(ids[1]) << " order " << ids[0] << " fully filled: " << values[0] << " shares\n";
+            break;
+        case LogEvent::MARKET_PARTIAL:
+            out << "Market " << side_name(ids[1]) << " order " << ids[0] << " partially filled: "
+                << values[0] << "/" << values[1] << " shares\n";
+            break;
+        case LogEvent::MARKET_REJECTED:
+            out << "Market " << side_name(ids[1]) << " order " << ids[0] << " rejected: no liquidity\n";
+            break;
+        case LogEvent::ORDER_STATUS:
+            out << "Order " << ids[0] << " status: " << (ids[1] ? "FILLED" : "PARTIAL") << "\n";
+            break;
+        case LogEvent::ORDER_EXPIRED:
+            out << (ids[1] == static_cast<uint64_t>(TimeInForce::FOK) ? "FOK" : "IOC") << " order " << ids[0]
+                << " done: " << values[0] << "/" << values[1] << " shares filled, rest cancelled\n";
+            break;
+        case LogEvent::RISK_REJECTED:
+            out << "Order from " << client_directory().name(static_cast<ClientId>(ids[0]))
+                << " rejected by risk check: " << record.text[0] << "\n";
+            break;
+        case LogEvent::VWAP_PROGRESS:
+            out << "VWAP order " << ids[0] << " progress: " << values[0] << "/" << values[1]
+                << " (child order " << ids[1] << " contributed " << values[2] << ")\n";
+            break;
+        case LogEvent::VWAP_COMPLETED:
+            out << "VWAP order " << ids[0] << " completed!\n";
+            break;
+        case LogEvent::VWAP_CANCELLED:
+            out << "VWAP order " << ids[0] << " cancelled with " << ids[1] << " child orders\n";
+            break;
+        case LogEvent::VWAP_SLICE_SKIPPED:
+            out << "VWAP order " << ids[0] << " slice " << ids[1] << " not placed: journal unavailable\n";
+            break;
+        case LogEvent::SERVER_LISTENING:
+            out << "Trading server listening on port " << ids[0] << "\n";
+            break;
+        case LogEvent::SESSION_STORED:
+            out << "DEBUG: Stored authenticated_client_id: [" << record.text[0] << "]\n";
+            break;
+        case LogEvent::SESSION_RECEIVED:
+            out << "DEBUG: Received client_id: [" << record.text[0]
+                << "], authenticated_client_id: [" << record.text[1] << "]\n";
+            break;
+        case LogEvent::CLIENT_LOGGED_IN:
+            out << "Client " << record.text[0] << " logged in (FD: " << ids[0] << ")\n";
+            break;
+        case LogEvent::CLIENT_LOGGED_OUT:
+            out << "Client " << record.text[0] << " logged out (FD: " << ids[0] << ")\n";
+            break;
+    }
+}
+
+void Logger::set_thread_level(LogLevel _level) {
+    thread_level = _level;
+}
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+bool parse_log_level(const std::string& name, LogLevel& level) {
+    static const std::pair<const char*, LogLevel> levels[] = {
+        {"DEBUG", LogLevel::DEBUG}, {"INFO", LogLevel::INFO}, {"WARN", LogLevel::WARN},
+        {"ERROR", LogLevel::ERROR}, {"OFF", LogLevel::OFF},
+    };
+    for (const auto& entry : levels) {
+        if (name == entry.first) {
+            level = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
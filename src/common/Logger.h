@@ -0,0 +1,135 @@
+#pragma once
+#include "Order.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t { DEBUG, INFO, WARN, ERROR, OFF };
+
+// One value per message the engine can emit. The hot path only stores the
+// event and its raw arguments; the text is produced on the logger thread.
+// Comments list the arguments in log() order, ids; values; text. Ids and
+// values left out are passed as 0.
+enum class LogEvent : uint8_t {
+    TRADE_EXECUTED,        // buy client, sell client; quantity, price
+    STOP_TRIGGERED,        // order id, immediate?; last price
+    STOP_LIMIT_CONVERTED,  // order id; limit price
+    STOP_FILLED,           // order id; executed
+    STOP_PARTIAL,          // order id; executed, quantity
+    STOP_REJECTED,         // order id
+    TRAILING_REPRICED,     // order count, side; new reference, new stop
+    MARKET_FILLED,         // order id, side; executed
+    MARKET_PARTIAL,        // order id, side; executed, quantity
+    MARKET_REJECTED,       // order id, side
+    ORDER_STATUS,          // order id, filled?
+    ORDER_EXPIRED,         // order id, TimeInForce; executed, quantity
+    RISK_REJECTED,         // client; text: check name
+    VWAP_PROGRESS,         // vwap id, child id; filled, quantity, contribution
+    VWAP_COMPLETED,        // vwap id
+    VWAP_CANCELLED,        // vwap id, child count
+    VWAP_SLICE_SKIPPED,    // vwap id, child id
+    SERVER_LISTENING,      // port
+    SESSION_STORED,        // text: client name
+    SESSION_RECEIVED,      // text: client name, authenticated name
+    CLIENT_LOGGED_IN,      // fd; text: client name
+    CLIENT_LOGGED_OUT,     // fd; text: client name
+};
+
+// Fixed-size binary record; names from the network are truncated to fit
+struct LogRecord {
+    uint64_t timestamp;
+    LogEvent event;
+    LogLevel level;
+    uint64_t ids[2];
+    double values[3];
+    char text[2][24];
+};
+
+// Single-producer single-consumer ring owned by one logging thread
+class LogRing {
+private:
+    std::vector<LogRecord> records;
+    alignas(64) std::atomic<uint64_t> head;  // next slot the producer writes
+    alignas(64) std::atomic<uint64_t> tail;  // next slot the consumer reads
+
+public:
+    explicit LogRing(size_t capacity);
+
+    bool push(const LogRecord& record);
+    // Appends everything currently published to `out`
+    size_t drain(std::vector<LogRecord>& out);
+    bool empty() const;
+
+    // Set when the owning thread exits; the logger drops the ring once drained
+    std::atomic<bool> retired;
+};
+
+// Asynchronous logger. Threads on the matching path write records into their
+// own ring without locking or formatting; a background thread merges the
+// rings in timestamp order, formats the records and writes them out. A full
+// ring drops the record rather than stall the writer.
+class Logger {
+private:
+    std::atomic<LogLevel> level;
+    std::atomic<std::ostream*> output;
+    std::atomic<uint64_t> dropped;
+    size_t ring_capacity;
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+
+    // Distinguishes loggers in the per-thread ring lookup
+    uint64_t instance;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    bool stopping;
+    uint64_t flush_requested;
+    uint64_t flush_completed;
+    std::thread writer;
+
+public:
+    explicit Logger(size_t _ring_capacity = 8192);
+    ~Logger();
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void set_level(LogLevel _level) { level.store(_level, std::memory_order_relaxed); }
+    LogLevel get_level() const { return level.load(std::memory_order_relaxed); }
+    bool enabled(LogLevel at) const { return at >= level.load(std::memory_order_relaxed); }
+    // A further floor for records logged from the calling thread only
+    static void set_thread_level(LogLevel _level);
+
+    // Where formatted lines go; std::cout unless changed
+    void set_output(std::ostream* stream);
+
+    void log(LogLevel at, LogEvent event, uint64_t id0 = 0, uint64_t id1 = 0,
+             double v0 = 0.0, double v1 = 0.0, double v2 = 0.0,
+             const char* text0 = nullptr, const char* text1 = nullptr);
+
+    // Blocks until every record logged before the call has been written
+    void flush();
+
+    uint64_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+
+    static void format(std::ostream& out, const LogRecord& record);
+
+private:
+    LogRing* thread_ring();
+    void run();
+    void write_pending(std::vector<LogRecord>& batch);
+};
+
+// Process-wide logger used by the engine and server
+Logger& logger();
+
+// Parses DEBUG/INFO/WARN/ERROR/OFF; false if the name is unknown
+bool parse_log_level(const std::string& name, LogLevel& level);
+
@@ -0,0 +1,19 @@
+#include "MarketDepth.h"
+
+LevelUpdateRing::LevelUpdateRing(size_t capacity)
+    : updates(capacity > 0 ? capacity : 1), last_sequence(0) {}
+
+void LevelUpdateRing::push(OrderSide side, double price, double quantity, size_t order_count) {
+    ++last_sequence;
+    updates[last_sequence % updates.size()] = LevelUpdate{last_sequence, side, price, quantity, order_count};
+}
+
+bool LevelUpdateRing::read_since(uint64_t since, std::vector<LevelUpdate>& out) const {
+    if (since >= last_sequence) return true;
+    if (last_sequence - since > updates.size()) return false;
+
+    for (uint64_t seq = since + 1; seq <= last_sequence; ++seq) {
+        out.push_back(updates[seq % updates.size()]);
+    }
+    return true;
+}
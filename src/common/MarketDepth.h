@@ -0,0 +1,48 @@
+#pragma once
+#include "Order.h"
+#include <cstdint>
+#include <vector>
+
+// Aggregate state of one price level
+struct DepthLevel {
+    double price;
+    double quantity;
+    size_t order_count;
+};
+
+// Top-N levels per side, best first. `sequence` is the last level update
+// already reflected, so a client applies only deltas after it.
+struct DepthSnapshot {
+    uint64_t sequence;
+    std::vector<DepthLevel> bids;
+    std::vector<DepthLevel> asks;
+
+    DepthSnapshot() : sequence(0) {}
+};
+
+// New aggregate for one level; quantity and order_count of 0 mean it is gone
+struct LevelUpdate {
+    uint64_t sequence;
+    OrderSide side;
+    double price;
+    double quantity;
+    size_t order_count;
+};
+
+// The most recent level updates, oldest overwritten first. A reader that
+// falls further behind than the capacity has to take a new snapshot.
+class LevelUpdateRing {
+private:
+    std::vector<LevelUpdate> updates;
+    uint64_t last_sequence;
+
+public:
+    explicit LevelUpdateRing(size_t capacity = 4096);
+
+    uint64_t sequence() const { return last_sequence; }
+    void push(OrderSide side, double price, double quantity, size_t order_count);
+
+    // Appends every update after `since` to `out`. Returns false if some of
+    // them have already been overwritten.
+    bool read_since(uint64_t since, std::vector<LevelUpdate>& out) const;
+};
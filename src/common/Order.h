@@ -1,9 +1,13 @@
 #pragma once
+#include "Price.h"
+#include "Directory.h"
 #include <string>
+#include <memory>
+#include <cstdint>
 #include <chrono>
 #include <vector>
 
-enum class OrderType {
+enum class OrderType : uint8_t {
     MARKET,
     LIMIT,
     STOP_LOSS,
@@ -12,12 +16,12 @@ enum class OrderType {
     VWAP
 };
 
-enum class OrderSide {
+enum class OrderSide : uint8_t {
     BUY,
     SELL
 };
 
-enum class OrderStatus {
+enum class OrderStatus : uint8_t {
     PENDING,
     PARTIAL_FILLED,
     FILLED,
@@ -25,80 +29,150 @@ enum class OrderStatus {
     REJECTED
 };
 
+// How long an order may work. DAY and GTC orders rest until filled or
+// cancelled; the engine has no trading session to end a DAY order with.
+// IOC and FOK orders match once on entry and never rest: IOC drops what
+// did not fill, FOK only trades if it can fill in full.
+enum class TimeInForce : uint8_t {
+    DAY,
+    IOC,
+    FOK,
+    GTC
+};
+
+inline bool is_immediate(TimeInForce time_in_force) {
+    return time_in_force == TimeInForce::IOC || time_in_force == TimeInForce::FOK;
+}
+
 struct StopLimitOrderTag {};
+struct TrailingStopGroup;
 struct TrailingStopOrderTag {};
 struct VWAPOrderTag {};
 
-class Order {
+// Stop-limit and trailing-stop parameters, allocated only for those orders
+struct StopOrderState {
+    Price limit_price;
+    Price stop_price;
+    Price trailing_amount;
+    Price highest_price;
+    Price lowest_price;
+    // Group a pending trailing stop shares its reference price with
+    TrailingStopGroup* trailing_group;
+    
+    StopOrderState(Price _stop_price, Price _limit_price, Price _trailing_amount)
+        : limit_price(_limit_price), stop_price(_stop_price), trailing_amount(_trailing_amount),
+          highest_price(0), lowest_price(0), trailing_group(nullptr) {}
+};
+
+// Execution state of a VWAP parent order, allocated only for VWAP orders
+struct VWAPOrderState {
+    Price target_vwap;
+    double vwap_accumulator;
+    double volume_accumulator;
+    std::chrono::steady_clock::time_point execution_start_time;
+    std::chrono::steady_clock::time_point execution_end_time;
+    std::vector<uint64_t> child_order_ids;
+    Price last_child_order_price;
+    std::chrono::steady_clock::time_point last_child_order_time;
+    // Engine timer for the next slice evaluation, 0 if none
+    uint64_t slice_timer;
+    
+    VWAPOrderState(Price _target_vwap, std::chrono::steady_clock::time_point _start_time,
+                   std::chrono::steady_clock::time_point _end_time)
+        : target_vwap(_target_vwap), vwap_accumulator(0.0), volume_accumulator(0.0),
+          execution_start_time(_start_time), execution_end_time(_end_time),
+          last_child_order_price(0), last_child_order_time(std::chrono::steady_clock::now()),
+          slice_timer(0) {}
+};
+
+// Cache-line aligned, so the hot part below never straddles two lines
+class alignas(64) Order {
 public:
+    // Everything matching reads or writes sits in the first 64 bytes; the
+    // rest is only touched on entry, reporting and for special order types.
     uint64_t id;
-    std::string symbol;
+    Price price;
+    double quantity;
+    double filled_quantity;
+    // Arrival order within the book, assigned when the book accepts the order
+    uint64_t sequence;
+    // Intrusive links for the PriceLevel FIFO this order rests in (if any)
+    Order* prev_in_level;
+    Order* next_in_level;
     OrderType type;
     OrderSide side;
-    double price;
-    double quantity;
-    std::string client_id;
     OrderStatus status;
-    double filled_quantity;
+    TimeInForce time_in_force;
+    ClientId client;
+    
+    SymbolId symbol;
     std::chrono::steady_clock::time_point timestamp;
+    std::unique_ptr<StopOrderState> stop;
+    std::unique_ptr<VWAPOrderState> vwap;
     
-    double limit_price;
-    double stop_price;
-    double trailing_amount;
-    double highest_price;
-    double lowest_price;
+    Order(uint64_t _id, SymbolId _symbol, OrderType _type, OrderSide _side, 
+          Price _price, double _quantity, ClientId _client)
+        : id(_id), price(_price), quantity(_quantity), filled_quantity(0.0), sequence(0),
+          prev_in_level(nullptr), next_in_level(nullptr), type(_type), side(_side),
+          status(OrderStatus::PENDING), time_in_force(TimeInForce::DAY), client(_client), symbol(_symbol),
+          timestamp(std::chrono::steady_clock::now()) {}
     
-    double target_vwap;
-    double vwap_accumulator;
-    double volume_accumulator;
-    std::chrono::steady_clock::time_point execution_start_time;
-    std::chrono::steady_clock::time_point execution_end_time;
-    std::vector<uint64_t> child_order_ids;
-    double last_child_order_price;
-    std::chrono::steady_clock::time_point last_child_order_time;
+    Order(uint64_t _id, SymbolId _symbol, OrderType _type, OrderSide _side,
+          Price _stop_price, Price _limit_price, double _quantity, 
+          ClientId _client, StopLimitOrderTag)
+        : Order(_id, _symbol, _type, _side, _stop_price, _quantity, _client) {
+        stop_state().limit_price = _limit_price;
+    }
+    
+    Order(uint64_t _id, SymbolId _symbol, OrderType _type, OrderSide _side,
+          Price _trailing_amount, double _quantity, ClientId _client, TrailingStopOrderTag)
+        : Order(_id, _symbol, _type, _side, 0, _quantity, _client) {
+        stop_state().trailing_amount = _trailing_amount;
+    }
+    
+    Order(uint64_t _id, SymbolId _symbol, OrderType _type, OrderSide _side,
+          Price _target_vwap, double _quantity, 
+          std::chrono::steady_clock::time_point _start_time,
+          std::chrono::steady_clock::time_point _end_time,
+          ClientId _client, VWAPOrderTag)
+        : Order(_id, _symbol, _type, _side, _target_vwap, _quantity, _client) {
+        vwap.reset(new VWAPOrderState(_target_vwap, _start_time, _end_time));
+    }
     
+    // Same constructors by name, interning the symbol and client
     Order(uint64_t _id, const std::string& _symbol, OrderType _type, OrderSide _side, 
-          double _price, double _quantity, const std::string& _client_id)
-        : id(_id), symbol(_symbol), type(_type), side(_side), price(_price), 
-          quantity(_quantity), client_id(_client_id), status(OrderStatus::PENDING),
-          filled_quantity(0.0), timestamp(std::chrono::steady_clock::now()),
-          limit_price(0.0), stop_price(0.0), trailing_amount(0.0), 
-          highest_price(0.0), lowest_price(0.0), target_vwap(0.0),
-          vwap_accumulator(0.0), volume_accumulator(0.0), last_child_order_price(0.0),
-          last_child_order_time(std::chrono::steady_clock::now()) {}
+          Price _price, double _quantity, const std::string& _client_id)
+        : Order(_id, symbol_directory().intern(_symbol), _type, _side, _price, _quantity,
+                client_directory().intern(_client_id)) {}
     
     Order(uint64_t _id, const std::string& _symbol, OrderType _type, OrderSide _side,
-          double _stop_price, double _limit_price, double _quantity, 
-          const std::string& _client_id, StopLimitOrderTag)
-        : id(_id), symbol(_symbol), type(_type), side(_side), price(_stop_price),
-          quantity(_quantity), client_id(_client_id), status(OrderStatus::PENDING),
-          filled_quantity(0.0), timestamp(std::chrono::steady_clock::now()),
-          limit_price(_limit_price), stop_price(_stop_price), trailing_amount(0.0),
-          highest_price(0.0), lowest_price(0.0), target_vwap(0.0),
-          vwap_accumulator(0.0), volume_accumulator(0.0), last_child_order_price(0.0),
-          last_child_order_time(std::chrono::steady_clock::now()) {}
+          Price _stop_price, Price _limit_price, double _quantity, 
+          const std::string& _client_id, StopLimitOrderTag tag)
+        : Order(_id, symbol_directory().intern(_symbol), _type, _side, _stop_price, _limit_price, _quantity,
+                client_directory().intern(_client_id), tag) {}
     
     Order(uint64_t _id, const std::string& _symbol, OrderType _type, OrderSide _side,
-          double _trailing_amount, double _quantity, const std::string& _client_id, TrailingStopOrderTag)
-        : id(_id), symbol(_symbol), type(_type), side(_side), price(0.0),
-          quantity(_quantity), client_id(_client_id), status(OrderStatus::PENDING),
-          filled_quantity(0.0), timestamp(std::chrono::steady_clock::now()),
-          limit_price(0.0), stop_price(0.0), trailing_amount(_trailing_amount),
-          highest_price(0.0), lowest_price(0.0), target_vwap(0.0),
-          vwap_accumulator(0.0), volume_accumulator(0.0), last_child_order_price(0.0),
-          last_child_order_time(std::chrono::steady_clock::now()) {}
+          Price _trailing_amount, double _quantity, const std::string& _client_id, TrailingStopOrderTag tag)
+        : Order(_id, symbol_directory().intern(_symbol), _type, _side, _trailing_amount, _quantity,
+                client_directory().intern(_client_id), tag) {}
     
     Order(uint64_t _id, const std::string& _symbol, OrderType _type, OrderSide _side,
-          double _target_vwap, double _quantity, 
+          Price _target_vwap, double _quantity, 
           std::chrono::steady_clock::time_point _start_time,
           std::chrono::steady_clock::time_point _end_time,
-          const std::string& _client_id, VWAPOrderTag)
-        : id(_id), symbol(_symbol), type(_type), side(_side), price(_target_vwap),
-          quantity(_quantity), client_id(_client_id), status(OrderStatus::PENDING),
-          filled_quantity(0.0), timestamp(std::chrono::steady_clock::now()),
-          limit_price(0.0), stop_price(0.0), trailing_amount(0.0),
-          highest_price(0.0), lowest_price(0.0), target_vwap(_target_vwap),
-          execution_start_time(_start_time), execution_end_time(_end_time),
-          vwap_accumulator(0.0), volume_accumulator(0.0), last_child_order_price(0.0),
-          last_child_order_time(std::chrono::steady_clock::now()) {}
+          const std::string& _client_id, VWAPOrderTag tag)
+        : Order(_id, symbol_directory().intern(_symbol), _type, _side, _target_vwap, _quantity,
+                _start_time, _end_time, client_directory().intern(_client_id), tag) {}
+    
+    const std::string& symbol_name() const { return symbol_directory().name(symbol); }
+    const std::string& client_name() const { return client_directory().name(client); }
+    
+    // Stop parameters, created on first use. A stop-limit submitted without
+    // its own limit price keeps the stop price as the limit.
+    StopOrderState& stop_state() {
+        if (!stop) {
+            stop.reset(new StopOrderState(price, price, 0));
+        }
+        return *stop;
+    }
 };
@@ -2,167 +2,365 @@
 #include <algorithm>
 #include <iostream>
 
-OrderBook::OrderBook(const std::string& _symbol) :  last_trade_price(0.0),symbol(_symbol) {}
+namespace {
 
-void OrderBook::add_order(std::shared_ptr<Order> order) {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    
-    if (order->type == OrderType::STOP_LOSS || order->type == OrderType::STOP_LIMIT || order->type == OrderType::TRAILING_STOP) {
-        if (should_trigger_stop_loss(order)) {
-            execute_stop_loss_order(order, "immediately");
-            return; 
-        }
-        stop_loss_orders.push_back(order);
-        return;
-    }
+bool is_stop_type(OrderType type) {
+    return type == OrderType::STOP_LOSS || type == OrderType::STOP_LIMIT || type == OrderType::TRAILING_STOP;
+}
+
+}
+
+OrderBook::OrderBook(const std::string& _symbol, const SymbolConfig& _config)
+    : symbol(_symbol), symbol_id(symbol_directory().intern(_symbol)), config(_config),
+      buy_orders(OrderSide::BUY, _config), sell_orders(OrderSide::SELL, _config),
+      orders_by_id(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+                   id_node_pool.allocator<OrderIdMap::value_type>()),
+      buy_trailing(OrderSide::BUY),
+      sell_trailing(OrderSide::SELL), last_trade_price(0), next_sequence(0),
+      record_trades(false), next_trade_sequence(0), record_closed(false), risk(nullptr) {}
+
+std::vector<std::shared_ptr<Order>> OrderBook::add_order(std::shared_ptr<Order> order) {
+    std::vector<std::shared_ptr<Order>> matched_orders;
     
-    if (order->side == OrderSide::BUY) {
-        buy_orders[order->price].push_back(order);
+    if (!is_stop_type(order->type)) {
+        match_incoming(order, &matched_orders);
+    } else if (order->type != OrderType::TRAILING_STOP && should_trigger_stop_loss(order.get())) {
+        // A trailing stop starts at the last trade, so it cannot be crossed yet
+        execute_stop_loss_order(order, true, &matched_orders);
     } else {
-        sell_orders[order->price].push_back(order);
+        add_stop_order(order);
     }
+    publish_market_data();
+    return matched_orders;
 }
 
-void OrderBook::cancel_order(uint64_t order_id) {
-    std::lock_guard<std::mutex> lock(book_mutex);
+bool OrderBook::cancel_order(uint64_t order_id) {
+    auto it = orders_by_id.find(order_id);
+    if (it == orders_by_id.end()) {
+        return false;
+    }
     
-    for (auto& [price, orders] : buy_orders) {
-        auto it = std::find_if(orders.begin(), orders.end(),
-            [order_id](const auto& order) { return order->id == order_id; });
-        if (it != orders.end()) {
-            (*it)->status = OrderStatus::CANCELLED;
-            orders.erase(it);
-            if (orders.empty()) buy_orders.erase(price);
-            return;
-        }
+    auto order = remove_order_from_book(it->second.get());
+    order->status = OrderStatus::CANCELLED;
+    publish_market_data();
+    return true;
+}
+
+bool OrderBook::amend_order(uint64_t order_id, Price price, double quantity,
+                            std::vector<std::shared_ptr<Order>>& matched_orders) {
+    auto it = orders_by_id.find(order_id);
+    if (it == orders_by_id.end()) {
+        return false;
+    }
+    Order* order = it->second.get();
+    if (order->type != OrderType::LIMIT || price <= 0 || quantity <= order->filled_quantity) {
+        return false;
     }
     
-    for (auto& [price, orders] : sell_orders) {
-        auto it = std::find_if(orders.begin(), orders.end(),
-            [order_id](const auto& order) { return order->id == order_id; });
-        if (it != orders.end()) {
-            (*it)->status = OrderStatus::CANCELLED;
-            orders.erase(it);
-            if (orders.empty()) sell_orders.erase(price);
-            return;
-        }
+    if (price == order->price && quantity <= order->quantity) {
+        auto& side_orders = (order->side == OrderSide::BUY) ? buy_orders : sell_orders;
+        side_orders.find(order->price)->reduce(order->quantity - quantity);
+        order->quantity = quantity;
+        mark_level_dirty(order->side, order->price);
+    } else {
+        // Out of its level and the id index together, so the order re-enters
+        // through the same path as a new one and the open-order count nets out
+        auto owned = remove_order_from_book(order);
+        owned->price = price;
+        owned->quantity = quantity;
+        match_incoming(std::move(owned), &matched_orders);
+    }
+    publish_market_data();
+    return true;
+}
+
+const Order* OrderBook::find_order(uint64_t order_id) const {
+    auto it = orders_by_id.find(order_id);
+    return it != orders_by_id.end() ? it->second.get() : nullptr;
+}
+
+void OrderBook::check_stop_loss_orders() {
+    if (last_trade_price <= 0) {
+        return;
     }
     
-    auto it = std::find_if(stop_loss_orders.begin(), stop_loss_orders.end(),
-        [order_id](const auto& order) { return order->id == order_id; });
-    if (it != stop_loss_orders.end()) {
-        (*it)->status = OrderStatus::CANCELLED;
-        stop_loss_orders.erase(it);
+    // Triggered stops trade and move the last price, which can trigger more
+    bool triggered = true;
+    while (triggered) {
+        triggered = trigger_trailing_stops();
+        triggered = trigger_stops(OrderSide::SELL) || triggered;
+        triggered = trigger_stops(OrderSide::BUY) || triggered;
     }
+    publish_market_data();
 }
 
-std::vector<std::shared_ptr<Order>> OrderBook::match_orders() {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    std::vector<std::shared_ptr<Order>> matched_orders;
+bool OrderBook::trigger_stops(OrderSide side) {
+    // Sell stops fire once the price trades at or below them, so the highest
+    // one is checked first; buy stops mirror that from the lowest. Only the
+    // stops actually crossed are visited.
+    auto& stops = (side == OrderSide::BUY) ? buy_stops : sell_stops;
+    bool triggered = false;
     
-    while (!buy_orders.empty() && !sell_orders.empty()) {
-        auto best_buy = buy_orders.rbegin(); 
-        auto best_sell = sell_orders.begin(); 
-        
-        if (best_buy->first < best_sell->first) break;
+    while (!stops.empty()) {
+        auto level_it = (side == OrderSide::SELL) ? std::prev(stops.end()) : stops.begin();
+        bool crossed = (side == OrderSide::SELL) ? last_trade_price <= level_it->first
+                                                 : last_trade_price >= level_it->first;
+        if (!crossed) break;
         
-        auto buy_order = best_buy->second.front();
-        auto sell_order = best_sell->second.front();
-        
-        if (buy_order->client_id == sell_order->client_id) {
-            if (buy_order->timestamp < sell_order->timestamp) {
-                best_buy->second.erase(best_buy->second.begin());
-                if (best_buy->second.empty()) {
-                    buy_orders.erase(std::prev(best_buy.base()));
-                }
-            } else {
-                best_sell->second.erase(best_sell->second.begin());
-                if (best_sell->second.empty()) {
-                    sell_orders.erase(best_sell);
-                }
+        auto order = remove_order_from_book(level_it->second.front());
+        execute_stop_loss_order(order, false, nullptr);
+        triggered = true;
+    }
+    return triggered;
+}
+
+bool OrderBook::trigger_trailing_stops() {
+    // Only groups whose reference the last trade improves on are re-keyed,
+    // and only groups whose trigger it has crossed are visited.
+    sell_trailing.reprice(last_trade_price);
+    buy_trailing.reprice(last_trade_price);
+    
+    bool triggered = false;
+    for (TrailingStopIndex* index : {&sell_trailing, &buy_trailing}) {
+        PriceLevel fired;
+        while (index->pop_triggered(last_trade_price, fired)) {
+            while (!fired.empty()) {
+                Order* order = fired.front();
+                fired.pop_front();
+                execute_stop_loss_order(unindex_order(orders_by_id.find(order->id)), false, nullptr);
+                triggered = true;
             }
-            continue;
-        }
-        
-        if (execute_trade(buy_order, sell_order)) {
-            matched_orders.push_back(buy_order);
-            matched_orders.push_back(sell_order);
         }
+    }
+    return triggered;
+}
+
+TopOfBook OrderBook::get_top_of_book() const {
+    return top_of_book.read();
+}
+
+DepthSnapshot OrderBook::get_depth(size_t levels) const {
+    DepthSnapshot snapshot;
+    snapshot.sequence = level_updates.sequence();
+    
+    for (OrderSide side : {OrderSide::BUY, OrderSide::SELL}) {
+        const PriceLadder& ladder = (side == OrderSide::BUY) ? buy_orders : sell_orders;
+        auto& out = (side == OrderSide::BUY) ? snapshot.bids : snapshot.asks;
+        if (ladder.empty()) continue;
         
-        if (buy_order->filled_quantity >= buy_order->quantity) {
-            best_buy->second.erase(best_buy->second.begin());
-            if (best_buy->second.empty()) {
-                buy_orders.erase(std::prev(best_buy.base()));
+        Price price = ladder.best_price();
+        do {
+            const PriceLevel* level = ladder.find(price);
+            out.push_back(DepthLevel{price_to_double(price), level->quantity(), level->size()});
+        } while (out.size() < levels && ladder.next_price(price, price));
+    }
+    return snapshot;
+}
+
+bool OrderBook::get_level_updates(uint64_t since, std::vector<LevelUpdate>& out) const {
+    return level_updates.read_since(since, out);
+}
+
+double OrderBook::get_best_bid() const {
+    return top_of_book.read().bid;
+}
+
+double OrderBook::get_best_ask() const {
+    return top_of_book.read().ask;
+}
+
+double OrderBook::get_last_price() const {
+    return top_of_book.read().last;
+}
+
+void OrderBook::publish_market_data() {
+    // One update per level the operation touched, carrying its final state
+    std::sort(dirty_levels.begin(), dirty_levels.end());
+    dirty_levels.erase(std::unique(dirty_levels.begin(), dirty_levels.end()), dirty_levels.end());
+    for (const auto& [side, price] : dirty_levels) {
+        const PriceLevel* level = (side == OrderSide::BUY) ? buy_orders.find(price) : sell_orders.find(price);
+        level_updates.push(side, price_to_double(price), level ? level->quantity() : 0.0,
+                           level ? level->size() : 0);
+    }
+    dirty_levels.clear();
+    
+    TopOfBook top;
+    if (!buy_orders.empty()) {
+        top.bid = price_to_double(buy_orders.best_price());
+        top.bid_size = buy_orders.best_level().quantity();
+    }
+    if (!sell_orders.empty()) {
+        top.ask = price_to_double(sell_orders.best_price());
+        top.ask_size = sell_orders.best_level().quantity();
+    }
+    top.last = price_to_double(last_trade_price);
+    
+    // Readers only see a new sequence when something they can observe changed
+    if (top.same_quote(published_top)) return;
+    published_top = top;
+    top_of_book.publish(top);
+}
+
+void OrderBook::capture(BookImage& image) const {
+    image.last_trade_price = last_trade_price;
+    image.next_sequence = next_sequence;
+    image.next_trade_sequence = next_trade_sequence;
+    image.orders.clear();
+    image.orders.reserve(orders_by_id.size());
+    
+    for (const PriceLadder* ladder : {&buy_orders, &sell_orders}) {
+        if (ladder->empty()) continue;
+        Price price = ladder->best_price();
+        do {
+            for (const Order* order = ladder->find(price)->front(); order; order = order->next_in_level) {
+                capture_order(order, OrderPlacement::RESTING, 0, image);
             }
-        }
-        
-        if (sell_order->filled_quantity >= sell_order->quantity) {
-            best_sell->second.erase(best_sell->second.begin());
-            if (best_sell->second.empty()) {
-                sell_orders.erase(best_sell);
+        } while (ladder->next_price(price, price));
+    }
+    for (const auto* stops : {&buy_stops, &sell_stops}) {
+        for (const auto& [price, level] : *stops) {
+            for (const Order* order = level.front(); order; order = order->next_in_level) {
+                capture_order(order, OrderPlacement::STOP, 0, image);
             }
         }
     }
-    
-    return matched_orders;
+    for (const TrailingStopIndex* trailing : {&buy_trailing, &sell_trailing}) {
+        trailing->for_each([&](const Order* order, Price reference) {
+            capture_order(order, OrderPlacement::TRAILING, reference, image);
+        });
+    }
 }
 
-void OrderBook::check_stop_loss_orders() {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    if (last_trade_price <= 0.0) {
-        return;
-    }
+void OrderBook::capture_order(const Order* order, OrderPlacement placement, Price reference, BookImage& image) const {
+    OrderImage captured;
+    captured.id = order->id;
+    captured.sequence = order->sequence;
+    captured.type = order->type;
+    captured.side = order->side;
+    captured.status = order->status;
+    captured.placement = placement;
+    captured.time_in_force = order->time_in_force;
+    captured.client = order->client;
+    captured.price = order->price;
+    captured.quantity = order->quantity;
+    captured.filled_quantity = order->filled_quantity;
+    captured.has_stop = order->stop != nullptr;
+    captured.limit_price = captured.has_stop ? order->stop->limit_price : 0;
+    captured.trailing_amount = captured.has_stop ? order->stop->trailing_amount : 0;
+    captured.reference = reference;
+    image.orders.push_back(captured);
+}
+
+bool OrderBook::restore(const BookImage& image) {
+    if (!orders_by_id.empty()) return false;
     
-    for (auto it = stop_loss_orders.begin(); it != stop_loss_orders.end();) {
-        auto order = *it;
-        
-        // Update trailing stop prices if needed
-        if (order->type == OrderType::TRAILING_STOP) {
-            update_trailing_stop_price(order);
+    last_trade_price = image.last_trade_price;
+    next_trade_sequence = image.next_trade_sequence;
+    orders_by_id.reserve(image.orders.size());
+    // Images run level by level, so most orders join the level the one
+    // before them did
+    PriceLevel* level = nullptr;
+    Price level_price = 0;
+    OrderSide level_side = OrderSide::BUY;
+    for (const auto& captured : image.orders) {
+        auto order = order_pool.make_order(captured.id, symbol_id, captured.type, captured.side, captured.price,
+                                           captured.quantity, captured.client);
+        order->filled_quantity = captured.filled_quantity;
+        order->status = captured.status;
+        order->sequence = captured.sequence;
+        order->time_in_force = captured.time_in_force;
+        if (captured.has_stop) {
+            order->stop_state().limit_price = captured.limit_price;
+            order->stop_state().trailing_amount = captured.trailing_amount;
         }
         
-        if (should_trigger_stop_loss(order)) {
-            execute_stop_loss_order(order, "due to price movement");
-            it = stop_loss_orders.erase(it);
+        // Images list each queue front to back, so appending keeps priority
+        if (captured.placement == OrderPlacement::RESTING) {
+            if (!level || level_price != order->price || level_side != order->side) {
+                auto& side_orders = (order->side == OrderSide::BUY) ? buy_orders : sell_orders;
+                level = &side_orders.get_or_create(order->price);
+                level_price = order->price;
+                level_side = order->side;
+                mark_level_dirty(order->side, order->price);
+            }
+            level->push_back(order.get());
+        } else if (captured.placement == OrderPlacement::STOP) {
+            auto& stops = (order->side == OrderSide::BUY) ? buy_stops : sell_stops;
+            stops[order->price].push_back(order.get());
         } else {
-            ++it;
+            auto& trailing = (order->side == OrderSide::BUY) ? buy_trailing : sell_trailing;
+            trailing.add(order.get(), captured.reference);
         }
+        index_order(std::move(order));
     }
+    next_sequence = image.next_sequence;
+    publish_market_data();
+    return true;
 }
 
-double OrderBook::get_best_bid() const {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    return buy_orders.empty() ? 0.0 : buy_orders.rbegin()->first;
+void OrderBook::rest_order(std::shared_ptr<Order> order) {
+    auto& side_orders = (order->side == OrderSide::BUY) ? buy_orders : sell_orders;
+    order->sequence = ++next_sequence;
+    side_orders.get_or_create(order->price).push_back(order.get());
+    mark_level_dirty(order->side, order->price);
+    index_order(std::move(order));
 }
 
-double OrderBook::get_best_ask() const {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    return sell_orders.empty() ? 0.0 : sell_orders.begin()->first;
-}
-
-double OrderBook::get_last_price() const {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    return last_trade_price;
+void OrderBook::add_stop_order(std::shared_ptr<Order> order) {
+    order->sequence = ++next_sequence;
+    if (order->type == OrderType::TRAILING_STOP) {
+        auto& trailing = (order->side == OrderSide::BUY) ? buy_trailing : sell_trailing;
+        trailing.add(order.get(), last_trade_price);
+    } else {
+        auto& stops = (order->side == OrderSide::BUY) ? buy_stops : sell_stops;
+        stops[order->price].push_back(order.get());
+    }
+    index_order(std::move(order));
 }
 
-void OrderBook::set_trade_callback(TradeCallback callback) {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    trade_callback = callback;
+std::shared_ptr<Order> OrderBook::remove_order_from_book(Order* order) {
+    if (order->type == OrderType::TRAILING_STOP) {
+        auto& trailing = (order->side == OrderSide::BUY) ? buy_trailing : sell_trailing;
+        trailing.remove(order);
+    } else if (is_stop_type(order->type)) {
+        auto& stops = (order->side == OrderSide::BUY) ? buy_stops : sell_stops;
+        auto level_it = stops.find(order->price);
+        if (level_it != stops.end()) {
+            level_it->second.erase(order);
+            if (level_it->second.empty()) {
+                stops.erase(level_it);
+            }
+        }
+    } else {
+        auto& side_orders = (order->side == OrderSide::BUY) ? buy_orders : sell_orders;
+        PriceLevel* level = side_orders.find(order->price);
+        if (level) {
+            mark_level_dirty(order->side, order->price);
+            level->erase(order);
+            if (level->empty()) {
+                side_orders.erase(order->price);
+            }
+        }
+    }
+    
+    auto it = orders_by_id.find(order->id);
+    return it != orders_by_id.end() ? unindex_order(it) : nullptr;
 }
 
-bool OrderBook::execute_trade(std::shared_ptr<Order> buy_order, std::shared_ptr<Order> sell_order) {
+double OrderBook::execute_trade(Order* buy_order, Order* sell_order) {
+    // Returns the quantity traded, 0 if either side had nothing left
     double trade_quantity = std::min(buy_order->quantity - buy_order->filled_quantity,
                                    sell_order->quantity - sell_order->filled_quantity);
     
-    if (trade_quantity <= 0) return false;
+    if (trade_quantity <= 0) return 0.0;
     
-    double trade_price;
+    Price trade_price;
     if (buy_order->type == OrderType::MARKET) {
         trade_price = sell_order->price; 
     } else if (sell_order->type == OrderType::MARKET) {
         trade_price = buy_order->price;   
     } else {
-        if (buy_order->timestamp < sell_order->timestamp) {
+        if (buy_order->sequence < sell_order->sequence) {
             trade_price = buy_order->price; 
         } else {
             trade_price = sell_order->price;
@@ -182,114 +380,182 @@ bool OrderBook::execute_trade(std::shared_ptr<Order> buy_order, std::shared_ptr<
     
     last_trade_price = trade_price;
     
-    // Notify VWAP calculator about the trade
-    if (trade_callback) {
-        trade_callback(symbol, trade_price, trade_quantity);
+    if (record_trades.load(std::memory_order_relaxed)) {
+        trade_events.push(TradeEvent{++next_trade_sequence, symbol_id, buy_order->id, sell_order->id,
+                                     buy_order->client, sell_order->client, trade_price, trade_quantity});
     }
     
-    std::cout << "Trade executed: " << trade_quantity << " @ " << trade_price 
-              << " between " << buy_order->client_id << " and " << sell_order->client_id << std::endl;
+    logger().log(LogLevel::INFO, LogEvent::TRADE_EXECUTED, buy_order->client, sell_order->client,
+                 trade_quantity, price_to_double(trade_price));
     
-    return true;
+    return trade_quantity;
 }
 
 double OrderBook::execute_market_order(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity) {
-    std::lock_guard<std::mutex> lock(book_mutex);
-    return execute_market_order_internal(market_order, opposite_side, max_quantity);
+    double executed = 0.0;
+    // A fill-or-kill that can't fill in full is killed before it trades at all
+    if (market_order->time_in_force != TimeInForce::FOK ||
+        can_fill(market_order.get(), opposite_side, std::min(max_quantity, market_order->quantity - market_order->filled_quantity))) {
+        executed = execute_market_order_internal(market_order, opposite_side, max_quantity, nullptr);
+    }
+    if (is_immediate(market_order->time_in_force) && market_order->filled_quantity < market_order->quantity) {
+        // Ends like an immediate limit order: whatever didn't fill expires
+        market_order->status = (market_order->filled_quantity > 0) ? OrderStatus::PARTIAL_FILLED : OrderStatus::CANCELLED;
+        logger().log(LogLevel::INFO, LogEvent::ORDER_EXPIRED, market_order->id,
+                     static_cast<uint64_t>(market_order->time_in_force), market_order->filled_quantity, market_order->quantity);
+    }
+    publish_market_data();
+    return executed;
+}
+
+double OrderBook::execute_market_order_internal(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity,
+                                                std::vector<std::shared_ptr<Order>>* matched_orders) {
+    double executed = take_liquidity(market_order.get(), opposite_side, max_quantity, matched_orders);
+    if (executed > 0 && matched_orders) {
+        matched_orders->push_back(market_order);
+    }
+    return executed;
+}
+
+void OrderBook::match_incoming(std::shared_ptr<Order> order, std::vector<std::shared_ptr<Order>>* matched_orders) {
+    // The incoming order trades against the opposite side first and only its
+    // remainder rests, so the book is never left crossed. Its sequence is
+    // newer than anything resting, so trades print at the resting price.
+    order->sequence = ++next_sequence;
+    OrderSide opposite_side = (order->side == OrderSide::BUY) ? OrderSide::SELL : OrderSide::BUY;
+    double remaining = order->quantity - order->filled_quantity;
+    // A fill-or-kill that can't fill in full is killed before it trades at all
+    if (order->time_in_force == TimeInForce::FOK && !can_fill(order.get(), opposite_side, remaining)) {
+        order->status = OrderStatus::CANCELLED;
+        close_order(order->id);
+        logger().log(LogLevel::INFO, LogEvent::ORDER_EXPIRED, order->id, static_cast<uint64_t>(order->time_in_force),
+                     0.0, order->quantity);
+        return;
+    }
+    double executed = take_liquidity(order.get(), opposite_side, remaining, matched_orders);
+    if (executed > 0 && matched_orders) {
+        matched_orders->push_back(order);
+    }
+    if (order->filled_quantity >= order->quantity) {
+        close_order(order->id);
+    } else if (is_immediate(order->time_in_force)) {
+        // The unfilled rest of an immediate order is dropped, never rested
+        if (order->filled_quantity > 0) {
+            order->status = OrderStatus::PARTIAL_FILLED;
+        } else {
+            order->status = OrderStatus::CANCELLED;
+        }
+        close_order(order->id);
+        logger().log(LogLevel::INFO, LogEvent::ORDER_EXPIRED, order->id, static_cast<uint64_t>(order->time_in_force),
+                     order->filled_quantity, order->quantity);
+    } else {
+        rest_order(order);
+    }
 }
 
-double OrderBook::execute_market_order_internal(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity) {
-    // Note: This function assumes the caller already holds the book_mutex
+bool OrderBook::can_fill(const Order* aggressor, OrderSide opposite_side, double quantity) const {
+    const PriceLadder& opposite_orders = (opposite_side == OrderSide::BUY) ? buy_orders : sell_orders;
+    if (opposite_orders.empty()) return false;
+    bool priced = aggressor->type != OrderType::MARKET;
+    auto crosses = [&](Price price) {
+        return !priced || ((opposite_side == OrderSide::SELL) ? price <= aggressor->price : price >= aggressor->price);
+    };
     
-    double total_executed = 0.0;
+    // Level totals settle most kills without visiting a single order
+    double available = 0.0;
+    Price price = opposite_orders.best_price();
+    do {
+        if (!crosses(price)) break;
+        available += opposite_orders.find(price)->quantity();
+    } while (available < quantity && opposite_orders.next_price(price, price));
+    if (available < quantity) return false;
+    
+    // The aggressor's own orders are passed over when it matches, so they
+    // don't count; this walk stops where the fill would
+    available = 0.0;
+    price = opposite_orders.best_price();
+    do {
+        if (!crosses(price)) break;
+        for (const Order* resting = opposite_orders.find(price)->front(); resting; resting = resting->next_in_level) {
+            if (resting->client == aggressor->client) continue;
+            available += resting->quantity - resting->filled_quantity;
+            if (available >= quantity) return true;
+        }
+    } while (opposite_orders.next_price(price, price));
+    return false;
+}
+
+double OrderBook::take_liquidity(Order* aggressor, OrderSide opposite_side, double max_quantity,
+                                 std::vector<std::shared_ptr<Order>>* matched_orders) {
+    // Market orders sweep until filled or the side is empty; limit orders
+    // stop at the first level their price does not reach. A resting order of
+    // the aggressor's own client is cancelled, except by an IOC or FOK
+    // aggressor, which passes over it and leaves the resting book alone.
     auto& opposite_orders = (opposite_side == OrderSide::BUY) ? buy_orders : sell_orders;
+    bool priced = aggressor->type != OrderType::MARKET;
+    bool keep_own = is_immediate(aggressor->time_in_force);
     
-    if (opposite_side == OrderSide::BUY) {
-        while (total_executed < max_quantity && !opposite_orders.empty()) {
-            auto best_opposite = opposite_orders.rbegin();
-            if (best_opposite->second.empty()) {
-                opposite_orders.erase(std::prev(best_opposite.base()));
-                continue;
-            }
-            auto opposite_order = best_opposite->second.front();
-            if (opposite_order->client_id == market_order->client_id) {
-                best_opposite->second.erase(best_opposite->second.begin());
-                if (best_opposite->second.empty()) {
-                    opposite_orders.erase(std::prev(best_opposite.base()));
-                }
-                continue;
-            }
-            double available_quantity = opposite_order->quantity - opposite_order->filled_quantity;
-            double market_remaining = max_quantity - total_executed;
-            double trade_quantity = std::min(available_quantity, market_remaining);
-            if (trade_quantity <= 0) break;
-            execute_trade(opposite_order, market_order);
-            total_executed += trade_quantity;
-            if (opposite_order->filled_quantity >= opposite_order->quantity) {
-                best_opposite->second.erase(best_opposite->second.begin());
-                if (best_opposite->second.empty()) {
-                    opposite_orders.erase(std::prev(best_opposite.base()));
-                }
-            }
+    double total_executed = 0.0;
+    if (opposite_orders.empty()) return total_executed;
+    Price price = opposite_orders.best_price();
+    do {
+        if (priced) {
+            bool crosses = (opposite_side == OrderSide::SELL) ? price <= aggressor->price : price >= aggressor->price;
+            if (!crosses) break;
         }
-    } else {
-        while (total_executed < max_quantity && !opposite_orders.empty()) {
-            auto best_opposite = opposite_orders.begin();
-            if (best_opposite->second.empty()) {
-                opposite_orders.erase(best_opposite);
-                continue;
-            }
-            auto opposite_order = best_opposite->second.front();
-            if (opposite_order->client_id == market_order->client_id) {
-                best_opposite->second.erase(best_opposite->second.begin());
-                if (best_opposite->second.empty()) {
-                    opposite_orders.erase(best_opposite);
+        
+        // Orders leaving the level may take the level with them, so the next
+        // order is read before each one is handled
+        PriceLevel* opposite_level = opposite_orders.find(price);
+        Order* opposite_order = opposite_level->front();
+        while (opposite_order && total_executed < max_quantity) {
+            Order* next_order = opposite_order->next_in_level;
+            if (opposite_order->client == aggressor->client) {
+                if (!keep_own) {
+                    close_order(opposite_order->id);
+                    remove_order_from_book(opposite_order);
                 }
+                opposite_order = next_order;
                 continue;
             }
             double available_quantity = opposite_order->quantity - opposite_order->filled_quantity;
-            double market_remaining = max_quantity - total_executed;
-            double trade_quantity = std::min(available_quantity, market_remaining);
-            if (trade_quantity <= 0) break;
-            execute_trade(market_order, opposite_order);
-            total_executed += trade_quantity;
+            double trade_quantity = std::min(available_quantity, max_quantity - total_executed);
+            if (trade_quantity <= 0) return total_executed;
+            double traded = (opposite_side == OrderSide::BUY) ? execute_trade(opposite_order, aggressor)
+                                                              : execute_trade(aggressor, opposite_order);
+            opposite_level->reduce(traded);
+            mark_level_dirty(opposite_side, opposite_order->price);
+            total_executed += traded;
+            if (matched_orders && traded > 0) {
+                matched_orders->push_back(orders_by_id[opposite_order->id]);
+            }
             if (opposite_order->filled_quantity >= opposite_order->quantity) {
-                best_opposite->second.erase(best_opposite->second.begin());
-                if (best_opposite->second.empty()) {
-                    opposite_orders.erase(best_opposite);
-                }
+                close_order(opposite_order->id);
+                remove_order_from_book(opposite_order);
             }
+            opposite_order = next_order;
         }
-    }
+    } while (total_executed < max_quantity && opposite_orders.next_price(price, price));
     return total_executed;
 }
 
-bool OrderBook::should_trigger_stop_loss(std::shared_ptr<Order> order) const {
-    if (last_trade_price <= 0.0) {
+bool OrderBook::should_trigger_stop_loss(const Order* order) const {
+    if (last_trade_price <= 0) {
         return false;
     }
     
-    if (order->type == OrderType::TRAILING_STOP) {
-        // For TRAILING_STOP, check if current price has moved against the trailing stop
-        if (order->side == OrderSide::SELL) {
-            return last_trade_price <= order->price;
-        } else if (order->side == OrderSide::BUY) {
-            return last_trade_price >= order->price;
-        }
-    } else {
-        // For STOP_LOSS and STOP_LIMIT, use the original logic
-        if (order->side == OrderSide::SELL && last_trade_price <= order->price) {
-            return true;
-        } else if (order->side == OrderSide::BUY && last_trade_price >= order->price) {
-            return true;
-        }
+    if (order->side == OrderSide::SELL && last_trade_price <= order->price) {
+        return true;
+    } else if (order->side == OrderSide::BUY && last_trade_price >= order->price) {
+        return true;
     }
     
     return false;
 }
 
-void OrderBook::execute_stop_loss_order(std::shared_ptr<Order> order, const std::string& trigger_context) {
-    std::cout << "Stop order " << order->id << " triggered " << trigger_context << " at price " << last_trade_price << std::endl;
+void OrderBook::execute_stop_loss_order(std::shared_ptr<Order> order, bool immediate,
+                                        std::vector<std::shared_ptr<Order>>* matched_orders) {
+    logger().log(LogLevel::INFO, LogEvent::STOP_TRIGGERED, order->id, immediate, price_to_double(last_trade_price));
     
     double executed_quantity = 0.0;
     
@@ -298,61 +564,34 @@ void OrderBook::execute_stop_loss_order(std::shared_ptr<Order> order, const std:
         order->type = OrderType::MARKET;
         executed_quantity = execute_market_order_internal(order, 
             (order->side == OrderSide::BUY) ? OrderSide::SELL : OrderSide::BUY, 
-            order->quantity);
+            order->quantity, matched_orders);
     } else if (order->type == OrderType::STOP_LIMIT) {
-        // Convert to limit order and add to order book
+        // Convert to limit order; it takes what its limit reaches and rests the rest
         order->type = OrderType::LIMIT;
-        order->price = order->limit_price; // Use the limit price for the limit order
+        order->price = order->stop_state().limit_price; // Use the limit price for the limit order
         
-        if (order->side == OrderSide::BUY) {
-            buy_orders[order->price].push_back(order);
-        } else {
-            sell_orders[order->price].push_back(order);
-        }
+        match_incoming(order, matched_orders);
         
-        std::cout << "Stop limit order " << order->id << " converted to limit order at price " << order->price << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::STOP_LIMIT_CONVERTED, order->id, 0, price_to_double(order->price));
         return; // Don't set status yet, let normal matching handle it
     } else if (order->type == OrderType::TRAILING_STOP) {
         // Convert to market order and execute immediately
         order->type = OrderType::MARKET;
         executed_quantity = execute_market_order_internal(order, 
             (order->side == OrderSide::BUY) ? OrderSide::SELL : OrderSide::BUY, 
-            order->quantity);
+            order->quantity, matched_orders);
     }
     
+    // Whatever didn't fill is dropped with the order
+    close_order(order->id);
     if (executed_quantity == order->quantity) {
         order->status = OrderStatus::FILLED;
-        std::cout << "Stop loss order " << order->id << " fully executed: " << executed_quantity << " shares" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::STOP_FILLED, order->id, 0, executed_quantity);
     } else if (executed_quantity > 0) {
         order->status = OrderStatus::PARTIAL_FILLED;
-        std::cout << "Stop loss order " << order->id << " partially executed: " << executed_quantity << "/" << order->quantity << " shares" << std::endl;
-        std::cout << "Remaining " << (order->quantity - executed_quantity) << " shares rejected - no liquidity" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::STOP_PARTIAL, order->id, 0, executed_quantity, order->quantity);
     } else {
         order->status = OrderStatus::REJECTED;
-        std::cout << "Stop loss order " << order->id << " rejected: no liquidity available" << std::endl;
-    }
-}
-
-void OrderBook::update_trailing_stop_price(std::shared_ptr<Order> order) {
-    if (order->type != OrderType::TRAILING_STOP) {
-        return;
-    }
-    
-    if (order->side == OrderSide::SELL) {
-        // For SELL trailing stops, track the highest price and set stop below it
-        if (last_trade_price > order->highest_price) {
-            order->highest_price = last_trade_price;
-            order->price = last_trade_price - order->trailing_amount;
-            std::cout << "Trailing stop " << order->id << " updated: highest=" << order->highest_price 
-                      << ", stop=" << order->price << std::endl;
-        }
-    } else if (order->side == OrderSide::BUY) {
-        // For BUY trailing stops, track the lowest price and set stop above it
-        if (last_trade_price < order->lowest_price || order->lowest_price == 0.0) {
-            order->lowest_price = last_trade_price;
-            order->price = last_trade_price + order->trailing_amount;
-            std::cout << "Trailing stop " << order->id << " updated: lowest=" << order->lowest_price 
-                      << ", stop=" << order->price << std::endl;
-        }
+        logger().log(LogLevel::WARN, LogEvent::STOP_REJECTED, order->id);
     }
 }
@@ -1,43 +1,164 @@
 #pragma once
 #include "Order.h"
+#include "PriceLevel.h"
+#include "PriceLadder.h"
+#include "OrderPool.h"
+#include "TopOfBook.h"
+#include "MarketDepth.h"
+#include "Logger.h"
+#include "TradeRing.h"
+#include "TrailingStopIndex.h"
+#include "Snapshot.h"
+#include "Risk.h"
 #include <map>
+#include <unordered_map>
 #include <vector>
-#include <mutex>
 #include <memory>
-#include <functional>
 
-// Callback function type for trade notifications
-using TradeCallback = std::function<void(const std::string&, double, double)>;
+// Resting and pending orders by id; nodes come from the book's slab pool
+using OrderIdMap = std::unordered_map<uint64_t, std::shared_ptr<Order>, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                      PoolAllocator<std::pair<const uint64_t, std::shared_ptr<Order>>>>;
 
+// One thread drives a book at a time; in the engine that is the symbol's
+// shard, so matching never takes a lock. Only the published reads (top of
+// book, trade events) are safe from other threads.
 class OrderBook {
 private:
     std::string symbol;
-    std::map<double, std::vector<std::shared_ptr<Order>>> buy_orders;
-    std::map<double, std::vector<std::shared_ptr<Order>>> sell_orders;
-    std::vector<std::shared_ptr<Order>> stop_loss_orders;
-    mutable std::mutex book_mutex;
-    double last_trade_price;
-    TradeCallback trade_callback;
+    SymbolId symbol_id;
+    SymbolConfig config;
+    PriceLadder buy_orders;
+    PriceLadder sell_orders;
+    OrderPool order_pool;
+    SlabPool id_node_pool;
+    // Owns every order the book holds: resting limits and pending stops
+    OrderIdMap orders_by_id;
+    // Pending stop/stop-limit orders keyed by trigger price, FIFO per price
+    std::map<Price, PriceLevel> buy_stops;
+    std::map<Price, PriceLevel> sell_stops;
+    // Pending trailing stops, grouped by shared reference price
+    TrailingStopIndex buy_trailing;
+    TrailingStopIndex sell_trailing;
+    Price last_trade_price;
+    uint64_t next_sequence;
+    // Lock-free view for readers, and the writer's copy of what it last published
+    TopOfBookCell top_of_book;
+    TopOfBook published_top;
+    // Levels changed by the current operation, and the feed of their new aggregates
+    std::vector<std::pair<OrderSide, Price>> dirty_levels;
+    LevelUpdateRing level_updates;
+    // Executions for downstream consumers, recorded once enabled
+    TradeRing trade_events;
+    std::atomic<bool> record_trades;
+    uint64_t next_trade_sequence;
+    // Ids of orders the book is done with, kept once enabled
+    std::vector<uint64_t> closed_orders;
+    bool record_closed;
+    // Open-order counts of the owning engine's clients; null if not tracked
+    ClientRiskTable* risk;
 
 public:
-    OrderBook(const std::string& _symbol);
+    OrderBook(const std::string& _symbol, const SymbolConfig& _config = SymbolConfig());
     
-    void add_order(std::shared_ptr<Order> order);
-    void cancel_order(uint64_t order_id);
-    std::vector<std::shared_ptr<Order>> match_orders();
+    // Allocates an order for this book from its pool; takes Order's constructor arguments
+    template <typename... Args>
+    std::shared_ptr<Order> create_order(Args&&... args) {
+        return order_pool.make_order(std::forward<Args>(args)...);
+    }
+    
+    // Limit orders match on entry; returns every order that traded, the
+    // incoming one included, for fill handling. IOC and FOK orders never
+    // rest: they leave the book CANCELLED or PARTIAL_FILLED if not filled.
+    std::vector<std::shared_ptr<Order>> add_order(std::shared_ptr<Order> order);
+    bool cancel_order(uint64_t order_id);
+    // Changes a resting limit order to `price` and a total quantity of
+    // `quantity`, filled part included. Less quantity at the same price is
+    // taken off in place and keeps the order's place in its queue; anything
+    // else requeues it as a new arrival, matching first if it now crosses.
+    // Fills go to `matched_orders` as with add_order. False if the order is
+    // not resting or `quantity` does not exceed what has filled.
+    bool amend_order(uint64_t order_id, Price price, double quantity,
+                     std::vector<std::shared_ptr<Order>>& matched_orders);
+    // The resting or pending order with that id, null if the book has none
+    const Order* find_order(uint64_t order_id) const;
     void check_stop_loss_orders();
+    // An IOC or FOK market order that doesn't fill in full is expired here
+    // (CANCELLED, or PARTIAL_FILLED if it traded), as immediate limit orders
+    // are; any other status is left to the caller
     double execute_market_order(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity);
     
+    // Safe from any thread; they read the last published snapshot
+    TopOfBook get_top_of_book() const;
     double get_best_bid() const;
     double get_best_ask() const;
     double get_last_price() const;
-    void set_trade_callback(TradeCallback callback);
+    // Up to `levels` price levels per side, best first; on the book's thread
+    DepthSnapshot get_depth(size_t levels) const;
+    // Level updates after sequence `since`; false means the caller fell too
+    // far behind and must start again from get_depth
+    bool get_level_updates(uint64_t since, std::vector<LevelUpdate>& out) const;
+    const SymbolConfig& get_config() const { return config; }
+    SymbolId get_symbol_id() const { return symbol_id; }
+    // Start recording trades; a book nobody drains records nothing
+    void enable_trade_events() { record_trades.store(true); }
+    // Appends trades executed since the last drain, oldest first. Safe from
+    // any thread, so consumers run off the matcher's critical section.
+    size_t drain_trade_events(std::vector<TradeEvent>& out) { return trade_events.drain(out); }
+    // Start listing orders that leave the book other than through
+    // cancel_order: filled ones, triggered stops whose unfilled part is
+    // dropped and resting orders cancelled by their own client's aggressor
+    void enable_closed_orders() { record_closed = true; }
+    // Appends the ids listed since the last drain
+    void drain_closed_orders(std::vector<uint64_t>& out) {
+        out.insert(out.end(), closed_orders.begin(), closed_orders.end());
+        closed_orders.clear();
+    }
+    // Counts each client's resting and pending orders in `table`; set before
+    // the first order
+    void track_open_orders(ClientRiskTable* table) { risk = table; }
+    
+    // Copies every live order and the book's counters
+    void capture(BookImage& image) const;
+    // Loads a captured image into this (empty) book; clients in the image
+    // must already be this process's ids. False if the book is not empty.
+    bool restore(const BookImage& image);
     
 private:
-    void remove_order_from_book(std::shared_ptr<Order> order);
-    bool execute_trade(std::shared_ptr<Order> buy_order, std::shared_ptr<Order> sell_order);
-    bool should_trigger_stop_loss(std::shared_ptr<Order> order) const;
-    void execute_stop_loss_order(std::shared_ptr<Order> order, const std::string& trigger_context);
-    void update_trailing_stop_price(std::shared_ptr<Order> order);
-    double execute_market_order_internal(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity);
+    void rest_order(std::shared_ptr<Order> order);
+    void capture_order(const Order* order, OrderPlacement placement, Price reference, BookImage& image) const;
+    void add_stop_order(std::shared_ptr<Order> order);
+    std::shared_ptr<Order> remove_order_from_book(Order* order);
+    double execute_trade(Order* buy_order, Order* sell_order);
+    void mark_level_dirty(OrderSide side, Price price) { dirty_levels.emplace_back(side, price); }
+    void close_order(uint64_t order_id) {
+        if (record_closed) closed_orders.push_back(order_id);
+    }
+    // Every insert into and erase from orders_by_id goes through these
+    void index_order(std::shared_ptr<Order> order) {
+        if (risk) risk->order_opened(order->client);
+        uint64_t id = order->id;
+        orders_by_id[id] = std::move(order);
+    }
+    std::shared_ptr<Order> unindex_order(OrderIdMap::iterator it) {
+        std::shared_ptr<Order> owned = std::move(it->second);
+        orders_by_id.erase(it);
+        if (risk) risk->order_closed(owned->client);
+        return owned;
+    }
+    void publish_market_data();
+    bool should_trigger_stop_loss(const Order* order) const;
+    bool trigger_stops(OrderSide side);
+    bool trigger_trailing_stops();
+    // A stop triggered on arrival reports its fills to `matched_orders`, so the
+    // caller runs the stop cascade its trades may have started
+    void execute_stop_loss_order(std::shared_ptr<Order> order, bool immediate,
+                                 std::vector<std::shared_ptr<Order>>* matched_orders);
+    double execute_market_order_internal(std::shared_ptr<Order> market_order, OrderSide opposite_side, double max_quantity,
+                                         std::vector<std::shared_ptr<Order>>* matched_orders);
+    void match_incoming(std::shared_ptr<Order> order, std::vector<std::shared_ptr<Order>>* matched_orders);
+    // Whether `quantity` of the aggressor can fill against the opposite side
+    // within its price, counting only what its own client doesn't hold
+    bool can_fill(const Order* aggressor, OrderSide opposite_side, double quantity) const;
+    double take_liquidity(Order* aggressor, OrderSide opposite_side, double max_quantity,
+                          std::vector<std::shared_ptr<Order>>* matched_orders);
 };
\ No newline at end of file
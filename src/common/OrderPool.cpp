@@ -0,0 +1,124 @@
+#include "OrderPool.h"
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+namespace {
+
+constexpr size_t BLOCK_ALIGN = alignof(std::max_align_t);
+constexpr unsigned TAG_SHIFT = 48;
+constexpr uint64_t ADDRESS_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+
+static_assert(sizeof(void*) == sizeof(uint64_t), "free list heads pack 64-bit addresses");
+
+inline void* head_block(uint64_t head) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(head & ADDRESS_MASK));
+}
+
+inline uint64_t next_head(uint64_t head, void* block) {
+    uint64_t address = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(block));
+    assert((address & ~ADDRESS_MASK) == 0);
+    return (((head >> TAG_SHIFT) + 1) << TAG_SHIFT) | address;
+}
+
+inline void*& next_block(void* block) {
+    return *static_cast<void**>(block);
+}
+
+// Links first..last in front of the list
+void push_chain(std::atomic<uint64_t>& free_head, void* first, void* last) {
+    uint64_t head = free_head.load(std::memory_order_relaxed);
+    do {
+        next_block(last) = head_block(head);
+    } while (!free_head.compare_exchange_weak(head, next_head(head, first),
+                                              std::memory_order_release, std::memory_order_relaxed));
+}
+
+}
+
+SlabArena::SlabArena(size_t _blocks_per_slab)
+    : blocks_per_slab(_blocks_per_slab > 0 ? _blocks_per_slab : 1), references(1) {
+    for (auto& size_class : classes) {
+        size_class.block_size.store(0, std::memory_order_relaxed);
+        size_class.free_head.store(0, std::memory_order_relaxed);
+    }
+}
+
+void SlabArena::SlabDelete::operator()(char* slab) const {
+    ::operator delete(slab, std::align_val_t(SLAB_ALIGN));
+}
+
+SlabArena::SizeClass* SlabArena::size_class(size_t size, size_t alignment) {
+    if (alignment > SLAB_ALIGN) return nullptr;
+
+    // Every block in a slab then keeps the slab's alignment up to `alignment`
+    size_t align = std::max(alignment, BLOCK_ALIGN);
+    size_t rounded = (size + align - 1) / align * align;
+    for (auto& size_class : classes) {
+        size_t current = size_class.block_size.load(std::memory_order_acquire);
+        if (current == 0 && size_class.block_size.compare_exchange_strong(current, rounded,
+                                                                         std::memory_order_acq_rel)) {
+            return &size_class;
+        }
+        if (current == rounded) return &size_class;
+    }
+    return nullptr;
+}
+
+void* SlabArena::allocate(size_t size, size_t alignment) {
+    SizeClass* size_class = this->size_class(size, alignment);
+    if (!size_class) return nullptr;
+
+    references.fetch_add(1, std::memory_order_relaxed);
+    uint64_t head = size_class->free_head.load(std::memory_order_acquire);
+    for (;;) {
+        void* block = head_block(head);
+        if (!block) {
+            add_slab(*size_class);
+            head = size_class->free_head.load(std::memory_order_acquire);
+            continue;
+        }
+        // Slabs outlive every list operation, so reading a block another
+        // thread has just taken is harmless; the tag makes the exchange fail
+        if (size_class->free_head.compare_exchange_weak(head, next_head(head, next_block(block)),
+                                                        std::memory_order_acquire, std::memory_order_acquire)) {
+            return block;
+        }
+    }
+}
+
+bool SlabArena::deallocate(SlabArena* arena, void* block, size_t size, size_t alignment) {
+    SizeClass* size_class = arena->size_class(size, alignment);
+    if (!size_class) return false;
+
+    push_chain(size_class->free_head, block, block);
+    if (arena->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete arena;
+    }
+    return true;
+}
+
+void SlabArena::release(SlabArena* arena) {
+    if (arena->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete arena;
+    }
+}
+
+size_t SlabArena::slab_count() const {
+    std::lock_guard<std::mutex> lock(slab_mutex);
+    return slabs.size();
+}
+
+void SlabArena::add_slab(SizeClass& size_class) {
+    std::lock_guard<std::mutex> lock(slab_mutex);
+    // Another thread may have refilled the list while this one waited
+    if (head_block(size_class.free_head.load(std::memory_order_acquire))) return;
+
+    size_t size = size_class.block_size.load(std::memory_order_relaxed);
+    slabs.emplace_back(static_cast<char*>(::operator new(size * blocks_per_slab, std::align_val_t(SLAB_ALIGN))));
+    char* slab = slabs.back().get();
+    for (size_t i = 0; i + 1 < blocks_per_slab; ++i) {
+        next_block(slab + i * size) = slab + (i + 1) * size;
+    }
+    push_chain(size_class.free_head, slab, slab + (blocks_per_slab - 1) * size);
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "Order.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Fixed-size blocks carved from slabs and recycled through intrusive free
+// lists, so steady-state allocation never reaches malloc. Each block size
+// gets its own slabs and free list, claimed by the first allocation of that
+// size. Allocation and release are lock-free; only adding a slab takes
+// slab_mutex. Slabs are only returned once the owning pool is gone and every
+// block has come back. Slabs start on a cache line, so a type aligned to one
+// (Order) gets blocks aligned to one.
+class SlabArena {
+public:
+    static const size_t MAX_BLOCK_SIZES = 4;
+    static const size_t SLAB_ALIGN = 64;
+
+private:
+    // Free list head: block address in the low 48 bits, and a count of
+    // updates above it so a block popped and pushed back between a load and
+    // its compare-exchange isn't mistaken for an unchanged list
+    struct SizeClass {
+        std::atomic<size_t> block_size;
+        std::atomic<uint64_t> free_head;
+    };
+
+    struct SlabDelete {
+        void operator()(char* slab) const;
+    };
+
+    SizeClass classes[MAX_BLOCK_SIZES];
+    size_t blocks_per_slab;
+    mutable std::mutex slab_mutex;
+    std::vector<std::unique_ptr<char, SlabDelete>> slabs;
+    // Blocks out, plus one held by the owning pool
+    std::atomic<size_t> references;
+
+public:
+    explicit SlabArena(size_t _blocks_per_slab);
+
+    // nullptr when blocks of this size and alignment aren't served from slabs
+    void* allocate(size_t size, size_t alignment);
+    // False, with nothing done, for a block allocate() didn't serve. Deletes
+    // the arena if it was the last block of a released pool.
+    static bool deallocate(SlabArena* arena, void* block, size_t size, size_t alignment);
+    // Called by the owning pool; the arena lives on while blocks are out
+    static void release(SlabArena* arena);
+
+    size_t slab_count() const;
+    size_t live_count() const { return references.load(std::memory_order_relaxed) - 1; }
+
+private:
+    SizeClass* size_class(size_t size, size_t alignment);
+    void add_slab(SizeClass& size_class);
+};
+
+// Serves single-object allocations (an Order with its shared_ptr control
+// block, a hash map node) from a SlabArena; arrays fall back to operator new.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    SlabArena* arena;
+
+    explicit PoolAllocator(SlabArena* _arena) : arena(_arena) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (n == 1) {
+            if (void* block = arena->allocate(sizeof(T), alignof(T))) {
+                return static_cast<T*>(block);
+            }
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n != 1 || !SlabArena::deallocate(arena, p, sizeof(T), alignof(T))) {
+            ::operator delete(p);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.arena != b.arena; }
+
+// Owner of a SlabArena. Objects allocated through it may outlive the pool.
+class SlabPool {
+protected:
+    SlabArena* arena;
+
+public:
+    explicit SlabPool(size_t objects_per_slab = 1024) : arena(new SlabArena(objects_per_slab)) {}
+    ~SlabPool() { SlabArena::release(arena); }
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    template <typename T>
+    PoolAllocator<T> allocator() const { return PoolAllocator<T>(arena); }
+
+    size_t slab_count() const { return arena->slab_count(); }
+    size_t live_count() const { return arena->live_count(); }
+};
+
+// Per-book source of orders. An order goes back to the pool when its last
+// shared_ptr is dropped, i.e. once it is filled or cancelled and no caller
+// still holds it.
+class OrderPool : public SlabPool {
+public:
+    explicit OrderPool(size_t orders_per_slab = 1024) : SlabPool(orders_per_slab) {}
+
+    template <typename... Args>
+    std::shared_ptr<Order> make_order(Args&&... args) {
+        return std::allocate_shared<Order>(allocator<Order>(), std::forward<Args>(args)...);
+    }
+};
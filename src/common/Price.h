@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+// Fixed-point price: one unit is 1/PRICE_SCALE of a currency unit. Doubles only
+// appear at the edges (client protocol, VWAP maths, reporting getters).
+using Price = int64_t;
+
+constexpr Price PRICE_SCALE = 10000;
+
+inline Price price_from_double(double value) {
+    return static_cast<Price>(std::llround(value * PRICE_SCALE));
+}
+
+inline double price_to_double(Price price) {
+    return static_cast<double>(price) / PRICE_SCALE;
+}
+
+// Storage used for each side of a symbol's book.
+//   MAP   - every level in a std::map keyed by price
+//   DENSE - an array of dense_levels ticks around the touch with an occupancy
+//           bitmap; prices outside the band fall back to the map
+enum class BookBackend {
+    MAP,
+    DENSE
+};
+
+// Per-symbol price grid. Every price entering the engine is snapped to a
+// multiple of tick_size so equal ticks always share one book level.
+struct SymbolConfig {
+    Price tick_size;
+    BookBackend backend;
+    size_t dense_levels;
+
+    SymbolConfig(Price _tick_size = price_from_double(0.01),
+                 BookBackend _backend = BookBackend::MAP, size_t _dense_levels = 4096)
+        : tick_size(_tick_size > 0 ? _tick_size : 1), backend(_backend),
+          dense_levels(_dense_levels) {}
+
+    Price round_to_tick(Price price) const {
+        Price half = tick_size / 2;
+        if (price >= 0) {
+            return ((price + half) / tick_size) * tick_size;
+        }
+        return -(((-price + half) / tick_size) * tick_size);
+    }
+
+    Price to_price(double value) const {
+        return round_to_tick(price_from_double(value));
+    }
+};
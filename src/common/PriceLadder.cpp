@@ -0,0 +1,253 @@
+#include "PriceLadder.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Bits 0..bit inclusive
+inline uint64_t mask_through(unsigned bit) {
+    return bit == 63 ? ~0ULL : ((1ULL << (bit + 1)) - 1);
+}
+
+inline unsigned highest_bit(uint64_t bits) {
+    return 63 - static_cast<unsigned>(__builtin_clzll(bits));
+}
+
+inline unsigned lowest_bit(uint64_t bits) {
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+}
+
+}
+
+OccupancyBitmap::OccupancyBitmap(size_t slots)
+    : words((slots + 63) / 64, 0), summary((words.size() + 63) / 64, 0) {}
+
+void OccupancyBitmap::set(size_t slot) {
+    size_t word = slot >> 6;
+    words[word] |= 1ULL << (slot & 63);
+    summary[word >> 6] |= 1ULL << (word & 63);
+}
+
+void OccupancyBitmap::clear(size_t slot) {
+    size_t word = slot >> 6;
+    words[word] &= ~(1ULL << (slot & 63));
+    if (words[word] == 0) {
+        summary[word >> 6] &= ~(1ULL << (word & 63));
+    }
+}
+
+bool OccupancyBitmap::test(size_t slot) const {
+    return (words[slot >> 6] >> (slot & 63)) & 1ULL;
+}
+
+long OccupancyBitmap::find_prev(size_t end) const {
+    if (end > capacity()) end = capacity();
+    if (end == 0) return -1;
+
+    size_t last = end - 1;
+    size_t word = last >> 6;
+    uint64_t bits = words[word] & mask_through(last & 63);
+    if (bits) {
+        return static_cast<long>((word << 6) + highest_bit(bits));
+    }
+    if (word == 0) return -1;
+
+    size_t prev_word = word - 1;
+    size_t group = prev_word >> 6;
+    uint64_t groups = summary[group] & mask_through(prev_word & 63);
+    for (;;) {
+        if (groups) {
+            size_t found = (group << 6) + highest_bit(groups);
+            return static_cast<long>((found << 6) + highest_bit(words[found]));
+        }
+        if (group == 0) return -1;
+        groups = summary[--group];
+    }
+}
+
+long OccupancyBitmap::find_next(size_t start) const {
+    if (start >= capacity()) return -1;
+
+    size_t word = start >> 6;
+    uint64_t bits = words[word] & (~0ULL << (start & 63));
+    if (bits) {
+        return static_cast<long>((word << 6) + lowest_bit(bits));
+    }
+
+    size_t next_word = word + 1;
+    if (next_word >= words.size()) return -1;
+    size_t group = next_word >> 6;
+    uint64_t groups = summary[group] & (~0ULL << (next_word & 63));
+    for (;;) {
+        if (groups) {
+            size_t found = (group << 6) + lowest_bit(groups);
+            return static_cast<long>((found << 6) + lowest_bit(words[found]));
+        }
+        if (++group >= summary.size()) return -1;
+        groups = summary[group];
+    }
+}
+
+PriceLadder::PriceLadder(OrderSide _side, const SymbolConfig& config)
+    : side(_side), tick_size(config.tick_size), base_price(0), dense_count(0) {
+    if (config.backend == BookBackend::DENSE && config.dense_levels > 0) {
+        size_t slots = ((config.dense_levels + 63) / 64) * 64;
+        dense.resize(slots);
+        occupancy = OccupancyBitmap(slots);
+    }
+}
+
+Price PriceLadder::best_price() const {
+    Price best = 0;
+    bool found = dense_best(best);
+    if (!sparse.empty()) {
+        Price sparse_best = (side == OrderSide::BUY) ? sparse.rbegin()->first : sparse.begin()->first;
+        if (!found || is_better(sparse_best, best)) {
+            best = sparse_best;
+        }
+    }
+    return best;
+}
+
+PriceLevel& PriceLadder::best_level() {
+    return *find(best_price());
+}
+
+PriceLevel* PriceLadder::find(Price price) {
+    size_t index;
+    if (dense_index(price, index)) {
+        return occupancy.test(index) ? &dense[index] : nullptr;
+    }
+    auto it = sparse.find(price);
+    return (it != sparse.end()) ? &it->second : nullptr;
+}
+
+PriceLevel& PriceLadder::get_or_create(Price price) {
+    size_t index;
+    if (!dense.empty() && !dense_index(price, index) && off_band_touch(price)) {
+        anchor(price);
+    }
+    if (dense_index(price, index)) {
+        if (!occupancy.test(index)) {
+            occupancy.set(index);
+            ++dense_count;
+        }
+        return dense[index];
+    }
+    return sparse[price];
+}
+
+void PriceLadder::erase(Price price) {
+    size_t index;
+    if (dense_index(price, index)) {
+        if (occupancy.test(index)) {
+            occupancy.clear(index);
+            dense[index] = PriceLevel();
+            --dense_count;
+        }
+        return;
+    }
+    sparse.erase(price);
+}
+
+bool PriceLadder::next_price(Price price, Price& next) const {
+    bool found = false;
+
+    if (dense_count > 0) {
+        long index;
+        if (side == OrderSide::BUY) {
+            // Slots priced strictly below `price`
+            size_t end = 0;
+            if (price > base_price) {
+                Price slots = (price - base_price + tick_size - 1) / tick_size;
+                end = static_cast<size_t>(std::min<Price>(slots, static_cast<Price>(dense.size())));
+            }
+            index = occupancy.find_prev(end);
+        } else {
+            // Slots priced strictly above `price`
+            size_t start = 0;
+            if (price >= base_price) {
+                Price slots = (price - base_price) / tick_size + 1;
+                start = static_cast<size_t>(std::min<Price>(slots, static_cast<Price>(dense.size())));
+            }
+            index = occupancy.find_next(start);
+        }
+        if (index >= 0) {
+            next = dense_price(static_cast<size_t>(index));
+            found = true;
+        }
+    }
+
+    if (side == OrderSide::BUY) {
+        auto it = sparse.lower_bound(price);
+        if (it != sparse.begin()) {
+            Price candidate = std::prev(it)->first;
+            if (!found || candidate > next) {
+                next = candidate;
+                found = true;
+            }
+        }
+    } else {
+        auto it = sparse.upper_bound(price);
+        if (it != sparse.end()) {
+            Price candidate = it->first;
+            if (!found || candidate < next) {
+                next = candidate;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool PriceLadder::dense_index(Price price, size_t& index) const {
+    if (dense.empty()) return false;
+    Price offset = price - base_price;
+    if (offset < 0 || offset % tick_size != 0) return false;
+    Price slot = offset / tick_size;
+    if (slot >= static_cast<Price>(dense.size())) return false;
+    index = static_cast<size_t>(slot);
+    return true;
+}
+
+bool PriceLadder::dense_best(Price& price) const {
+    if (dense_count == 0) return false;
+    long index = (side == OrderSide::BUY) ? occupancy.find_prev(dense.size()) : occupancy.find_next(0);
+    price = dense_price(static_cast<size_t>(index));
+    return true;
+}
+
+bool PriceLadder::off_band_touch(Price price) const {
+    if (dense_count == 0) return true;
+    if ((price - base_price) % tick_size != 0) return false;
+    // Only a price past the band on the aggressive side, where the touch went
+    return side == OrderSide::BUY ? price >= dense_price(dense.size()) : price < base_price;
+}
+
+void PriceLadder::anchor(Price price) {
+    // Park whatever the old band still holds; the loop below pulls back the
+    // levels that land inside the new one.
+    for (long index = occupancy.find_next(0); index >= 0;
+         index = occupancy.find_next(static_cast<size_t>(index) + 1)) {
+        size_t slot = static_cast<size_t>(index);
+        sparse.emplace(dense_price(slot), dense[slot]);
+        dense[slot] = PriceLevel();
+        occupancy.clear(slot);
+    }
+    dense_count = 0;
+    base_price = price - static_cast<Price>(dense.size() / 2) * tick_size;
+
+    Price band_end = dense_price(dense.size());
+    auto it = sparse.lower_bound(base_price);
+    while (it != sparse.end() && it->first < band_end) {
+        size_t index;
+        if (dense_index(it->first, index)) {
+            dense[index] = it->second;
+            occupancy.set(index);
+            ++dense_count;
+            it = sparse.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "Order.h"
+#include "PriceLevel.h"
+#include <map>
+#include <vector>
+#include <cstdint>
+
+// Two-level occupancy bitmap: bit i of words marks slot i as occupied, and bit
+// w of summary marks words[w] as non-zero. Searches touch one summary word and
+// one slot word in the common case.
+class OccupancyBitmap {
+private:
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> summary;
+
+public:
+    explicit OccupancyBitmap(size_t slots = 0);
+
+    void set(size_t slot);
+    void clear(size_t slot);
+    bool test(size_t slot) const;
+
+    // Highest occupied slot below `end`, or -1
+    long find_prev(size_t end) const;
+    // Lowest occupied slot at or above `start`, or -1
+    long find_next(size_t start) const;
+
+    size_t capacity() const { return words.size() * 64; }
+};
+
+// One side of an order book: price levels ordered from best to worst.
+// With BookBackend::DENSE the levels within dense_levels ticks of where the
+// side was anchored live in a flat array indexed by tick, and the occupancy
+// bitmap gives best/next level without walking a tree. Anything outside the
+// band, or off the tick grid, goes to the sparse map. The band re-centres on
+// the incoming price whenever it is empty or that price is a new touch past
+// its edge, so the dense slots follow the market as it drifts.
+class PriceLadder {
+private:
+    OrderSide side;
+    Price tick_size;
+    std::vector<PriceLevel> dense;
+    OccupancyBitmap occupancy;
+    Price base_price;
+    size_t dense_count;
+    std::map<Price, PriceLevel> sparse;
+
+public:
+    PriceLadder(OrderSide _side, const SymbolConfig& config);
+
+    bool empty() const { return dense_count == 0 && sparse.empty(); }
+    size_t level_count() const { return dense_count + sparse.size(); }
+
+    // Requires !empty()
+    Price best_price() const;
+    PriceLevel& best_level();
+
+    PriceLevel* find(Price price);
+    const PriceLevel* find(Price price) const { return const_cast<PriceLadder*>(this)->find(price); }
+    PriceLevel& get_or_create(Price price);
+    // Drops the level at `price`; call once it has emptied
+    void erase(Price price);
+
+    // Next occupied price strictly worse than `price` (lower for bids, higher
+    // for asks). Returns false when there is none.
+    bool next_price(Price price, Price& next) const;
+
+private:
+    bool is_better(Price a, Price b) const { return side == OrderSide::BUY ? a > b : a < b; }
+    bool dense_index(Price price, size_t& index) const;
+    Price dense_price(size_t index) const { return base_price + static_cast<Price>(index) * tick_size; }
+    bool dense_best(Price& price) const;
+    bool off_band_touch(Price price) const;
+    void anchor(Price price);
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include "Order.h"
+#include <cstddef>
+
+// FIFO of resting orders at one price. Orders are linked intrusively through
+// Order::prev_in_level/next_in_level, so push_back, pop_front and erase from
+// the middle are all O(1). The level does not own its orders; OrderBook keeps
+// the owning shared_ptr for every resting order. It also keeps the open
+// quantity of its orders, which the book must reduce() as they fill.
+class PriceLevel {
+private:
+    Order* head;
+    Order* tail;
+    size_t order_count;
+    double open_quantity;
+
+public:
+    PriceLevel() : head(nullptr), tail(nullptr), order_count(0), open_quantity(0.0) {}
+
+    Order* front() const { return head; }
+    bool empty() const { return head == nullptr; }
+    size_t size() const { return order_count; }
+    double quantity() const { return open_quantity; }
+
+    // Records a fill against one of the queued orders
+    void reduce(double filled) { open_quantity -= filled; }
+
+    void push_back(Order* order) {
+        order->prev_in_level = tail;
+        order->next_in_level = nullptr;
+        if (tail) {
+            tail->next_in_level = order;
+        } else {
+            head = order;
+        }
+        tail = order;
+        ++order_count;
+        open_quantity += order->quantity - order->filled_quantity;
+    }
+
+    void pop_front() {
+        if (head) erase(head);
+    }
+
+    // Moves every order of `other` to the back of this queue, keeping order
+    void append(PriceLevel& other) {
+        if (other.empty()) return;
+        if (tail) {
+            tail->next_in_level = other.head;
+            other.head->prev_in_level = tail;
+        } else {
+            head = other.head;
+        }
+        tail = other.tail;
+        order_count += other.order_count;
+        open_quantity += other.open_quantity;
+        other.head = nullptr;
+        other.tail = nullptr;
+        other.order_count = 0;
+        other.open_quantity = 0.0;
+    }
+
+    // Moves every order of `other` into this queue. Both must be in sequence
+    // order, and so is the result; when `other` arrived entirely after this
+    // queue it is spliced on the end without a walk.
+    void merge(PriceLevel& other) {
+        if (other.empty()) return;
+        if (empty() || tail->sequence < other.head->sequence) {
+            append(other);
+            return;
+        }
+        Order* at = head;
+        Order* order = other.head;
+        while (order) {
+            Order* next = order->next_in_level;
+            while (at && at->sequence < order->sequence) {
+                at = at->next_in_level;
+            }
+            if (!at) {
+                // Everything left in `other` is newer than this queue
+                order->prev_in_level = tail;
+                tail->next_in_level = order;
+                tail = other.tail;
+                break;
+            }
+            order->prev_in_level = at->prev_in_level;
+            order->next_in_level = at;
+            if (at->prev_in_level) {
+                at->prev_in_level->next_in_level = order;
+            } else {
+                head = order;
+            }
+            at->prev_in_level = order;
+            order = next;
+        }
+        order_count += other.order_count;
+        open_quantity += other.open_quantity;
+        other.head = nullptr;
+        other.tail = nullptr;
+        other.order_count = 0;
+        other.open_quantity = 0.0;
+    }
+
+    void erase(Order* order) {
+        if (order->prev_in_level) {
+            order->prev_in_level->next_in_level = order->next_in_level;
+        } else {
+            head = order->next_in_level;
+        }
+        if (order->next_in_level) {
+            order->next_in_level->prev_in_level = order->prev_in_level;
+        } else {
+            tail = order->prev_in_level;
+        }
+        order->prev_in_level = nullptr;
+        order->next_in_level = nullptr;
+        --order_count;
+        // Reset rather than subtract on the last order so rounding cannot accumulate
+        open_quantity = head ? open_quantity - (order->quantity - order->filled_quantity) : 0.0;
+    }
+};
@@ -0,0 +1,351 @@
+#include "Replication.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const char HANDSHAKE_MAGIC[8] = {'C', 'T', 'E', 'R', 'E', 'P', 'L', '1'};
+// Replies to a handshake
+constexpr uint64_t JOIN_OK = 0;
+constexpr uint64_t JOIN_TOO_OLD = 1;     // the records after `after` are gone
+constexpr uint64_t JOIN_AHEAD = 2;       // the backup holds more than the primary
+
+constexpr auto KEEP_ALIVE = std::chrono::milliseconds(100);
+constexpr size_t KEEP_ALIVE_SIZE = 24;   // one zero record header
+constexpr time_t SEND_TIMEOUT_SECONDS = 5;
+
+struct Handshake {
+    char magic[8];
+    uint64_t value;
+};
+
+// Creates a socket for `endpoint` and binds (listening) or connects it; -1 on failure
+int open_endpoint(const std::string& endpoint, bool listening, std::string* unix_path) {
+    if (endpoint.compare(0, 5, "unix:") == 0) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::string path = endpoint.substr(5);
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) return -1;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (listening) {
+            ::unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 8) != 0) {
+                ::close(fd);
+                return -1;
+            }
+            if (unix_path) *unix_path = path;
+        } else if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = endpoint.rfind(':');
+    if (colon == std::string::npos) return -1;
+    std::string host = endpoint.substr(0, colon);
+    std::string port = endpoint.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found) != 0 || !found) return -1;
+
+    int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    bool ok = fd >= 0;
+    if (ok && listening) {
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        ok = bind(fd, found->ai_addr, found->ai_addrlen) == 0 && ::listen(fd, 8) == 0;
+    } else if (ok) {
+        ok = connect(fd, found->ai_addr, found->ai_addrlen) == 0;
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+    freeaddrinfo(found);
+    if (!ok && fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+void set_receive_timeout(int fd, std::chrono::milliseconds timeout) {
+    timeval tv{};
+    tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+bool send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool receive_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}
+
+ReplicationPublisher::ReplicationPublisher(size_t _history_limit)
+    : history_limit(_history_limit), listen_fd(-1), history_base(0), history_bytes(0), last_sequence(0),
+      stopping(false) {}
+
+ReplicationPublisher::~ReplicationPublisher() {
+    close();
+}
+
+bool ReplicationPublisher::listen(const std::string& endpoint, uint64_t _last_sequence) {
+    if (listen_fd >= 0) return false;
+    listen_fd = open_endpoint(endpoint, true, &unix_path);
+    if (listen_fd < 0) return false;
+    last_sequence = _last_sequence;
+    stopping = false;
+    acceptor = std::thread(&ReplicationPublisher::run_acceptor, this);
+    return true;
+}
+
+void ReplicationPublisher::close() {
+    if (listen_fd < 0) return;
+    {
+        // Senders finish what has been published, so a clean shutdown
+        // leaves backups with the primary's last group
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        shutdown(listen_fd, SHUT_RDWR);
+    }
+    published.notify_all();
+    acceptor.join();
+    for (auto& sender : senders) {
+        sender->thread.join();
+    }
+    senders.clear();
+    ::close(listen_fd);
+    listen_fd = -1;
+    if (!unix_path.empty()) {
+        ::unlink(unix_path.c_str());
+    }
+}
+
+void ReplicationPublisher::publish(const char* records, size_t size, uint64_t group_last_sequence) {
+    auto group = std::make_shared<Group>();
+    std::memcpy(&group->first_sequence, records, sizeof(uint64_t));
+    group->last_sequence = group_last_sequence;
+    group->records.assign(records, records + size);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        history.push_back(std::move(group));
+        history_bytes += size;
+        last_sequence = group_last_sequence;
+        while (history_bytes > history_limit && history.size() > 1) {
+            history_bytes -= history.front()->records.size();
+            history.pop_front();
+            ++history_base;
+        }
+    }
+    published.notify_all();
+}
+
+size_t ReplicationPublisher::backup_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return backup_fds.size();
+}
+
+void ReplicationPublisher::run_acceptor() {
+    for (;;) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        // A backup that stops reading is dropped rather than holding up close()
+        timeval send_timeout{SEND_TIMEOUT_SECONDS, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        set_receive_timeout(fd, std::chrono::milliseconds(1000));
+        Handshake request;
+        if (!receive_all(fd, reinterpret_cast<char*>(&request), sizeof(request)) ||
+            std::memcmp(request.magic, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC)) != 0) {
+            ::close(fd);
+            continue;
+        }
+
+        Handshake reply;
+        std::memcpy(reply.magic, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC));
+        uint64_t after = request.value;
+        uint64_t cursor = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                ::close(fd);
+                return;
+            }
+            uint64_t first_kept = history.empty() ? last_sequence + 1 : history.front()->first_sequence;
+            reply.value = (after > last_sequence) ? JOIN_AHEAD : (after + 1 < first_kept) ? JOIN_TOO_OLD : JOIN_OK;
+            if (reply.value == JOIN_OK) {
+                backup_fds.push_back(fd);
+                // Start at the first group with anything the backup lacks,
+                // fixed here so a trim before the sender runs can't skip any
+                size_t skip = 0;
+                while (skip < history.size() && history[skip]->last_sequence <= after) {
+                    ++skip;
+                }
+                cursor = history_base + skip;
+            }
+        }
+        if (!send_all(fd, reinterpret_cast<const char*>(&reply), sizeof(reply)) || reply.value != JOIN_OK) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(backup_fds.begin(), backup_fds.end(), fd);
+            if (it != backup_fds.end()) backup_fds.erase(it);
+            ::close(fd);
+            continue;
+        }
+        reap_senders();
+        auto sender = std::make_unique<Sender>();
+        sender->thread = std::thread(&ReplicationPublisher::run_sender, this, sender.get(), fd, cursor);
+        senders.push_back(std::move(sender));
+    }
+}
+
+void ReplicationPublisher::reap_senders() {
+    for (size_t i = 0; i < senders.size();) {
+        if (senders[i]->done.load(std::memory_order_acquire)) {
+            senders[i]->thread.join();
+            senders[i] = std::move(senders.back());
+            senders.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void ReplicationPublisher::run_sender(Sender* sender, int fd, uint64_t cursor) {
+    const char keep_alive[KEEP_ALIVE_SIZE] = {};
+    std::vector<std::shared_ptr<const Group>> ready;
+
+    for (;;) {
+        ready.clear();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            published.wait_for(lock, KEEP_ALIVE, [&] { return stopping || cursor < history_base + history.size(); });
+            // Fell behind what the history keeps; it has to rejoin
+            if (cursor < history_base) break;
+            for (; cursor < history_base + history.size(); ++cursor) {
+                ready.push_back(history[cursor - history_base]);
+            }
+            if (ready.empty() && stopping) break;
+        }
+
+        bool sent = true;
+        if (ready.empty()) {
+            sent = send_all(fd, keep_alive, sizeof(keep_alive));
+        }
+        for (const auto& group : ready) {
+            if (!sent) break;
+            sent = send_all(fd, group->records.data(), group->records.size());
+        }
+        if (!sent) break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(backup_fds.begin(), backup_fds.end(), fd);
+        if (it != backup_fds.end()) backup_fds.erase(it);
+        ::close(fd);
+    }
+    sender->done.store(true, std::memory_order_release);
+}
+
+bool follow_primary(const std::string& endpoint, uint64_t after, std::chrono::milliseconds silence,
+                    const std::atomic<bool>& stop, const std::function<void(std::vector<JournalCommand>&)>& apply) {
+    int fd = open_endpoint(endpoint, false, nullptr);
+    if (fd < 0) return false;
+
+    set_receive_timeout(fd, std::max(silence, std::chrono::milliseconds(1000)));
+    Handshake request;
+    std::memcpy(request.magic, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC));
+    request.value = after;
+    Handshake reply;
+    if (!send_all(fd, reinterpret_cast<const char*>(&request), sizeof(request)) ||
+        !receive_all(fd, reinterpret_cast<char*>(&reply), sizeof(reply)) ||
+        std::memcmp(reply.magic, HANDSHAKE_MAGIC, sizeof(HANDSHAKE_MAGIC)) != 0 || reply.value != JOIN_OK) {
+        ::close(fd);
+        return false;
+    }
+
+    // Short receive timeouts so `stop` and silence are noticed promptly
+    set_receive_timeout(fd, KEEP_ALIVE);
+    std::vector<char> buffer(1u << 20);
+    size_t filled = 0;
+    std::vector<JournalCommand> batch;
+    auto last_heard = std::chrono::steady_clock::now();
+    while (!stop.load()) {
+        if (filled == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = recv(fd, buffer.data() + filled, buffer.size() - filled, 0);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+            if (std::chrono::steady_clock::now() - last_heard > silence) break;
+            continue;
+        }
+        last_heard = std::chrono::steady_clock::now();
+        filled += static_cast<size_t>(n);
+
+        bool corrupt;
+        batch.clear();
+        size_t used = Journal::decode_records(buffer.data(), filled, batch, corrupt);
+        std::memmove(buffer.data(), buffer.data() + used, filled - used);
+        filled -= used;
+        // A group may start before what the backup holds
+        batch.erase(std::remove_if(batch.begin(), batch.end(),
+                                   [&](const JournalCommand& command) { return command.sequence <= after; }),
+                    batch.end());
+        // Past that, records must follow on without a gap, as in
+        // Journal::replay; whatever comes after one is not applied
+        size_t contiguous = 0;
+        while (contiguous < batch.size() && batch[contiguous].sequence == after + 1 + contiguous) {
+            ++contiguous;
+        }
+        bool gap = contiguous < batch.size();
+        batch.resize(contiguous);
+        if (!batch.empty()) {
+            after = batch.back().sequence;
+            apply(batch);
+        }
+        if (corrupt || gap) break;
+    }
+    ::close(fd);
+    return true;
+}
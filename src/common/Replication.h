@@ -0,0 +1,90 @@
+#pragma once
+#include "Journal.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Replication endpoints are "unix:<path>" for a Unix-domain socket or
+// "<host>:<port>" for TCP.
+//
+// The stream is the journal itself: after a handshake (the backup sends the
+// last sequence it holds, the primary answers whether it can serve from
+// there) the primary sends journal records exactly as they are laid out on
+// disk, plus zero headers as keep-alives while idle.
+
+// Primary side. Takes the journal's record groups as the flusher hands them
+// over and streams them to each connected backup from a thread of its own,
+// so a slow backup only delays itself and order entry pays for one copy of
+// each group. Recent groups are kept so a backup can join or rejoin from the
+// sequence it has; one that falls further behind than that is dropped.
+class ReplicationPublisher {
+private:
+    struct Group {
+        uint64_t first_sequence;
+        uint64_t last_sequence;
+        std::vector<char> records;
+    };
+
+    // Set by the sender thread as it exits, so the acceptor can join it
+    struct Sender {
+        std::thread thread;
+        std::atomic<bool> done;
+
+        Sender() : done(false) {}
+    };
+
+    size_t history_limit;
+    int listen_fd;
+    std::string unix_path;
+
+    std::mutex mutex;
+    std::condition_variable published;
+    std::deque<std::shared_ptr<const Group>> history;
+    uint64_t history_base;      // index of history.front() among all groups
+    size_t history_bytes;
+    uint64_t last_sequence;
+    bool stopping;
+    std::vector<int> backup_fds;
+    // Only the acceptor (and close(), once it has stopped) touches these
+    std::vector<std::unique_ptr<Sender>> senders;
+    std::thread acceptor;
+
+public:
+    explicit ReplicationPublisher(size_t _history_limit = 256u << 20);
+    ~ReplicationPublisher();
+    ReplicationPublisher(const ReplicationPublisher&) = delete;
+    ReplicationPublisher& operator=(const ReplicationPublisher&) = delete;
+
+    // `last_sequence` is the journal's last record so far; backups join
+    // from there or from anything still in the history
+    bool listen(const std::string& endpoint, uint64_t _last_sequence);
+    void close();
+
+    // A journal record group; see Journal::RecordSink
+    void publish(const char* records, size_t size, uint64_t group_last_sequence);
+    size_t backup_count();
+
+private:
+    void run_acceptor();
+    // Joins the senders whose backups have gone
+    void reap_senders();
+    // `cursor` indexes the first group to send among all groups
+    void run_sender(Sender* sender, int fd, uint64_t cursor);
+};
+
+// Backup side: connects to `endpoint`, asks for the records after `after`
+// and hands them to `apply` in batches, in sequence order. Returns once the
+// primary closes the stream, stays silent for `silence`, sends a record out
+// of sequence (the stream is lost, as if the primary had gone), or `stop` is
+// set; false if no stream was established (unreachable, or the primary no
+// longer has the records after `after`).
+bool follow_primary(const std::string& endpoint, uint64_t after, std::chrono::milliseconds silence,
+                    const std::atomic<bool>& stop, const std::function<void(std::vector<JournalCommand>&)>& apply);
@@ -0,0 +1,56 @@
+#include "Risk.h"
+
+ClientRiskTable::ClientRiskTable()
+    : chunks(new std::atomic<ClientRisk*>[MAX_CHUNKS]()), default_limits(nullptr) {}
+
+ClientRiskTable::~ClientRiskTable() {
+    for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+        delete[] chunks[i].load(std::memory_order_relaxed);
+    }
+}
+
+ClientRisk* ClientRiskTable::allocate_chunk(size_t chunk) {
+    ClientRisk* fresh = new ClientRisk[CHUNK_SIZE];
+    ClientRisk* expected = nullptr;
+    if (chunks[chunk].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) {
+        return fresh;
+    }
+    // Another thread published this chunk first
+    delete[] fresh;
+    return expected;
+}
+
+void ClientRiskTable::set_limits(ClientId client, const RiskLimits& limits) {
+    std::lock_guard<std::mutex> lock(limits_mutex);
+    limits_store.push_back(limits);
+    at(client).limits.store(&limits_store.back(), std::memory_order_release);
+}
+
+void ClientRiskTable::set_default_limits(const RiskLimits& limits) {
+    std::lock_guard<std::mutex> lock(limits_mutex);
+    limits_store.push_back(limits);
+    default_limits.store(&limits_store.back(), std::memory_order_release);
+}
+
+bool ClientRiskTable::admit_message(ClientRisk& risk, const RiskLimits& limits, uint64_t now_ns) {
+    if (limits.max_messages_per_second == 0) return true;
+    // Whoever moves the window on resets its count; a message racing the
+    // reset may land in either second
+    uint64_t window = now_ns / 1000000000u;
+    uint64_t seen = risk.window.load(std::memory_order_relaxed);
+    if (seen != window && risk.window.compare_exchange_strong(seen, window, std::memory_order_relaxed)) {
+        risk.window_messages.store(0, std::memory_order_relaxed);
+    }
+    return risk.window_messages.fetch_add(1, std::memory_order_relaxed) < limits.max_messages_per_second;
+}
+
+const char* risk_check_name(RiskCheck check) {
+    switch (check) {
+        case RiskCheck::ORDER_QUANTITY: return "order quantity";
+        case RiskCheck::NOTIONAL: return "notional";
+        case RiskCheck::OPEN_ORDERS: return "open orders";
+        case RiskCheck::POSITION: return "position";
+        case RiskCheck::MESSAGE_RATE: return "message rate";
+    }
+    return "unknown";
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Directory.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Pre-trade limits for one client; 0 leaves a limit off
+struct RiskLimits {
+    double max_order_quantity;
+    double max_notional;            // price x quantity of a single order
+    uint32_t max_open_orders;       // resting orders and pending stops, all symbols
+    double max_position;            // absolute net position in any one symbol
+    uint32_t max_messages_per_second;
+
+    RiskLimits(double _max_order_quantity = 0.0, double _max_notional = 0.0, uint32_t _max_open_orders = 0,
+               double _max_position = 0.0, uint32_t _max_messages_per_second = 0)
+        : max_order_quantity(_max_order_quantity), max_notional(_max_notional), max_open_orders(_max_open_orders),
+          max_position(_max_position), max_messages_per_second(_max_messages_per_second) {}
+};
+
+// Which check turned an order away
+enum class RiskCheck : uint8_t {
+    ORDER_QUANTITY,
+    NOTIONAL,
+    OPEN_ORDERS,
+    POSITION,
+    MESSAGE_RATE,
+};
+
+// Counters of one client, on a cache line of their own so gateways serving
+// different clients never share one. Books keep open_orders (an order counts
+// while it rests or waits as a stop); gateways keep the rest.
+struct alignas(64) ClientRisk {
+    std::atomic<const RiskLimits*> limits;   // null: the table's defaults
+    std::atomic<int64_t> open_orders;
+    // Orders past the checks but not yet in a book
+    std::atomic<int64_t> in_flight;
+    std::atomic<uint64_t> window;            // current one-second message window
+    std::atomic<uint32_t> window_messages;
+
+    ClientRisk() : limits(nullptr), open_orders(0), in_flight(0), window(0), window_messages(0) {}
+};
+
+// Per-client risk state indexed by ClientId. Lookups never lock: entries
+// live in fixed chunks that are allocated on first use and published with a
+// CAS, so an entry's address never changes. Limits are immutable once set
+// and swapped by pointer; replaced ones are kept until the table goes.
+class ClientRiskTable {
+private:
+    static constexpr size_t CHUNK_BITS = 10;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t MAX_CHUNKS = size_t(1) << 16;
+
+    std::unique_ptr<std::atomic<ClientRisk*>[]> chunks;
+    // Shared by any ids past MAX_CHUNKS * CHUNK_SIZE
+    ClientRisk overflow;
+    std::atomic<const RiskLimits*> default_limits;
+    std::mutex limits_mutex;
+    std::deque<RiskLimits> limits_store;
+
+public:
+    ClientRiskTable();
+    ~ClientRiskTable();
+    ClientRiskTable(const ClientRiskTable&) = delete;
+    ClientRiskTable& operator=(const ClientRiskTable&) = delete;
+
+    ClientRisk& at(ClientId client) {
+        size_t chunk = client >> CHUNK_BITS;
+        if (chunk >= MAX_CHUNKS) return overflow;
+        ClientRisk* entries = chunks[chunk].load(std::memory_order_acquire);
+        if (!entries) entries = allocate_chunk(chunk);
+        return entries[client & (CHUNK_SIZE - 1)];
+    }
+
+    // Null when neither the client nor the table has limits
+    const RiskLimits* limits_for(ClientRisk& risk) const {
+        const RiskLimits* limits = risk.limits.load(std::memory_order_acquire);
+        return limits ? limits : default_limits.load(std::memory_order_acquire);
+    }
+
+    void set_limits(ClientId client, const RiskLimits& limits);
+    void set_default_limits(const RiskLimits& limits);
+
+    // Called by books as orders come to rest or leave
+    void order_opened(ClientId client) { at(client).open_orders.fetch_add(1, std::memory_order_relaxed); }
+    void order_closed(ClientId client) { at(client).open_orders.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Counts one message against the client's rate; false once the current
+    // second is over its limit
+    static bool admit_message(ClientRisk& risk, const RiskLimits& limits, uint64_t now_ns);
+
+private:
+    ClientRisk* allocate_chunk(size_t chunk);
+};
+
+const char* risk_check_name(RiskCheck check);
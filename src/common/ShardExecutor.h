@@ -0,0 +1,145 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// One worker thread fed through a ring of preallocated task slots, in FIFO
+// order. call() runs a task and waits for it without allocating: its slot
+// points at the caller's task and completion flag, both on the caller's
+// stack. post() and enqueue() carry a std::function for work nobody waits
+// on in place. The ring only grows when more tasks wait than it holds.
+// Tasks must not throw.
+class ShardExecutor {
+private:
+    // A call() in flight; lives on the calling thread's stack
+    struct Call {
+        void (*invoke)(void*);
+        void* task;
+        bool done;
+        std::condition_variable finished;
+    };
+    struct Slot {
+        Call* call;
+        std::function<void()> posted;
+    };
+
+    std::vector<Slot> slots;
+    size_t head;   // next slot to run
+    size_t count;  // slots waiting
+    std::mutex queue_mutex;
+    std::condition_variable not_empty;
+    bool stop;
+    std::thread worker;
+
+public:
+    explicit ShardExecutor(size_t capacity = 1024)
+        : slots(capacity > 0 ? capacity : 1), head(0), count(0), stop(false), worker([this] { run(); }) {}
+
+    // Runs what is already queued, then stops the worker
+    ~ShardExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        not_empty.notify_one();
+        worker.join();
+    }
+
+    ShardExecutor(const ShardExecutor&) = delete;
+    ShardExecutor& operator=(const ShardExecutor&) = delete;
+
+    // Runs `task` on the worker and returns its result
+    template <typename F>
+    auto call(F&& task) -> decltype(task()) {
+        using Result = decltype(task());
+        if constexpr (std::is_void<Result>::value) {
+            run_in_place(task);
+        } else {
+            Result result{};
+            auto store = [&]() { result = task(); };
+            run_in_place(store);
+            return result;
+        }
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            push(nullptr, std::move(task));
+        }
+        not_empty.notify_one();
+    }
+
+    // For fanning one task out to several shards and waiting on them together
+    template <typename F>
+    auto enqueue(F&& task) -> std::future<decltype(task())> {
+        auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+        auto result = packaged->get_future();
+        post([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+private:
+    template <typename F>
+    void run_in_place(F& task) {
+        Call call;
+        call.invoke = [](void* target) { (*static_cast<F*>(target))(); };
+        call.task = &task;
+        call.done = false;
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        push(&call, nullptr);
+        not_empty.notify_one();
+        call.finished.wait(lock, [&call] { return call.done; });
+    }
+
+    // Holding queue_mutex
+    void push(Call* call, std::function<void()> posted) {
+        if (stop) throw std::runtime_error("task for a stopped ShardExecutor");
+        if (count == slots.size()) {
+            std::vector<Slot> grown(slots.size() * 2);
+            for (size_t i = 0; i < count; ++i) {
+                grown[i] = std::move(slots[(head + i) % slots.size()]);
+            }
+            slots.swap(grown);
+            head = 0;
+        }
+        Slot& slot = slots[(head + count) % slots.size()];
+        slot.call = call;
+        slot.posted = std::move(posted);
+        ++count;
+    }
+
+    void run() {
+        for (;;) {
+            Call* call;
+            std::function<void()> posted;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                not_empty.wait(lock, [this] { return stop || count > 0; });
+                if (count == 0) return;
+                Slot& slot = slots[head];
+                call = slot.call;
+                posted.swap(slot.posted);
+                head = (head + 1) % slots.size();
+                --count;
+            }
+            if (!call) {
+                posted();
+                continue;
+            }
+            call->invoke(call->task);
+            // Signalled under the lock: the caller can't see `done` and
+            // return, taking `call` with it, before notify_one is through
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            call->done = true;
+            call->finished.notify_one();
+        }
+    }
+};
@@ -0,0 +1,305 @@
+#include "Snapshot.h"
+#include "Binary.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'C', 'T', 'E', 'S', 'N', 'A', 'P', '1'};
+
+void encode_order(const OrderImage& order, std::vector<char>& out) {
+    put(out, order.id);
+    put(out, order.sequence);
+    put(out, static_cast<uint8_t>(order.type));
+    put(out, static_cast<uint8_t>(order.side));
+    put(out, static_cast<uint8_t>(order.status));
+    put(out, static_cast<uint8_t>(order.placement));
+    put(out, static_cast<uint8_t>(order.time_in_force));
+    put(out, order.client);
+    put(out, order.price);
+    put(out, order.quantity);
+    put(out, order.filled_quantity);
+    put(out, static_cast<uint8_t>(order.has_stop));
+    if (order.has_stop) {
+        put(out, order.limit_price);
+        put(out, order.trailing_amount);
+        put(out, order.reference);
+    }
+}
+
+bool decode_order(BinaryReader& reader, OrderImage& order) {
+    uint8_t type, side, status, placement, time_in_force, has_stop;
+    if (!reader.get(order.id) || !reader.get(order.sequence) || !reader.get(type) || !reader.get(side) ||
+        !reader.get(status) || !reader.get(placement) || !reader.get(time_in_force) || !reader.get(order.client) ||
+        !reader.get(order.price) || !reader.get(order.quantity) || !reader.get(order.filled_quantity) ||
+        !reader.get(has_stop)) {
+        return false;
+    }
+    order.type = static_cast<OrderType>(type);
+    order.side = static_cast<OrderSide>(side);
+    order.status = static_cast<OrderStatus>(status);
+    order.placement = static_cast<OrderPlacement>(placement);
+    order.time_in_force = static_cast<TimeInForce>(time_in_force);
+    order.has_stop = has_stop != 0;
+    order.limit_price = order.trailing_amount = order.reference = 0;
+    if (order.has_stop) {
+        return reader.get(order.limit_price) && reader.get(order.trailing_amount) && reader.get(order.reference);
+    }
+    return true;
+}
+
+void encode_vwap(const VWAPImage& vwap, std::vector<char>& out) {
+    put(out, vwap.id);
+    put(out, vwap.client);
+    put(out, static_cast<uint8_t>(vwap.side));
+    put(out, static_cast<uint8_t>(vwap.status));
+    put(out, vwap.target_vwap);
+    put(out, vwap.quantity);
+    put(out, vwap.filled_quantity);
+    put(out, vwap.start_time);
+    put(out, vwap.end_time);
+    put(out, vwap.last_child_price);
+    put(out, vwap.last_child_time);
+    put(out, static_cast<uint64_t>(vwap.child_ids.size()));
+    for (uint64_t child_id : vwap.child_ids) {
+        put(out, child_id);
+    }
+    put(out, static_cast<uint64_t>(vwap.live_children.size()));
+    for (const auto& child : vwap.live_children) {
+        put(out, child.id);
+        put(out, child.quantity);
+        put(out, child.filled_quantity);
+    }
+}
+
+bool decode_vwap(BinaryReader& reader, VWAPImage& vwap) {
+    uint8_t side, status;
+    uint64_t child_count, live_count;
+    if (!reader.get(vwap.id) || !reader.get(vwap.client) || !reader.get(side) || !reader.get(status) ||
+        !reader.get(vwap.target_vwap) || !reader.get(vwap.quantity) || !reader.get(vwap.filled_quantity) ||
+        !reader.get(vwap.start_time) || !reader.get(vwap.end_time) || !reader.get(vwap.last_child_price) ||
+        !reader.get(vwap.last_child_time) || !reader.get(child_count) ||
+        child_count > reader.remaining() / sizeof(uint64_t)) {
+        return false;
+    }
+    vwap.side = static_cast<OrderSide>(side);
+    vwap.status = static_cast<OrderStatus>(status);
+    vwap.child_ids.resize(child_count);
+    for (auto& child_id : vwap.child_ids) {
+        if (!reader.get(child_id)) return false;
+    }
+    if (!reader.get(live_count) || live_count > reader.remaining() / sizeof(VWAPChildImage)) return false;
+    vwap.live_children.resize(live_count);
+    for (auto& child : vwap.live_children) {
+        if (!reader.get(child.id) || !reader.get(child.quantity) || !reader.get(child.filled_quantity)) return false;
+    }
+    return true;
+}
+
+void encode(const EngineSnapshot& snapshot, std::vector<char>& out) {
+    out.insert(out.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC));
+    put(out, snapshot.journal_sequence);
+    put(out, snapshot.next_order_id);
+    put(out, static_cast<uint64_t>(snapshot.clients.size()));
+    for (const auto& client : snapshot.clients) {
+        put_string(out, client);
+    }
+    put(out, static_cast<uint64_t>(snapshot.symbols.size()));
+    for (const auto& symbol : snapshot.symbols) {
+        put_string(out, symbol.symbol);
+        put(out, symbol.config.tick_size);
+        put(out, static_cast<uint8_t>(symbol.config.backend));
+        put(out, static_cast<uint64_t>(symbol.config.dense_levels));
+        put(out, symbol.journal_sequence);
+        put(out, static_cast<uint8_t>(symbol.has_book));
+        if (symbol.has_book) {
+            const BookImage& book = symbol.book;
+            put(out, book.last_trade_price);
+            put(out, book.next_sequence);
+            put(out, book.next_trade_sequence);
+            put(out, static_cast<uint64_t>(book.orders.size()));
+            for (const auto& order : book.orders) {
+                encode_order(order, out);
+            }
+        }
+        put(out, static_cast<uint64_t>(symbol.vwap_orders.size()));
+        for (const auto& vwap : symbol.vwap_orders) {
+            encode_vwap(vwap, out);
+        }
+        put(out, static_cast<uint64_t>(symbol.positions.size()));
+        for (const auto& position : symbol.positions) {
+            put(out, position.client);
+            put(out, position.quantity);
+        }
+    }
+    uint32_t crc = crc32(out.data(), out.size());
+    put(out, crc);
+}
+
+bool decode(const char* data, size_t size, EngineSnapshot& snapshot) {
+    if (size < sizeof(SNAPSHOT_MAGIC) + sizeof(uint32_t) ||
+        std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return false;
+    }
+    uint32_t crc;
+    std::memcpy(&crc, data + size - sizeof(crc), sizeof(crc));
+    if (crc32(data, size - sizeof(crc)) != crc) return false;
+
+    BinaryReader reader(data + sizeof(SNAPSHOT_MAGIC), size - sizeof(SNAPSHOT_MAGIC) - sizeof(crc));
+    uint64_t client_count, symbol_count;
+    if (!reader.get(snapshot.journal_sequence) || !reader.get(snapshot.next_order_id) ||
+        !reader.get(client_count) || client_count > reader.remaining()) {
+        return false;
+    }
+    snapshot.clients.resize(client_count);
+    for (auto& client : snapshot.clients) {
+        if (!reader.get_string(client)) return false;
+    }
+    if (!reader.get(symbol_count) || symbol_count > reader.remaining()) return false;
+    snapshot.symbols.resize(symbol_count);
+    for (auto& symbol : snapshot.symbols) {
+        Price tick_size;
+        uint8_t backend, has_book;
+        uint64_t dense_levels, vwap_count;
+        if (!reader.get_string(symbol.symbol) || !reader.get(tick_size) || !reader.get(backend) ||
+            !reader.get(dense_levels) || !reader.get(symbol.journal_sequence) || !reader.get(has_book)) {
+            return false;
+        }
+        symbol.config = SymbolConfig(tick_size, static_cast<BookBackend>(backend), dense_levels);
+        symbol.has_book = has_book != 0;
+        if (symbol.has_book) {
+            BookImage& book = symbol.book;
+            uint64_t order_count;
+            if (!reader.get(book.last_trade_price) || !reader.get(book.next_sequence) ||
+                !reader.get(book.next_trade_sequence) || !reader.get(order_count) ||
+                order_count > reader.remaining()) {
+                return false;
+            }
+            book.orders.resize(order_count);
+            for (auto& order : book.orders) {
+                if (!decode_order(reader, order)) return false;
+            }
+        }
+        if (!reader.get(vwap_count) || vwap_count > reader.remaining()) return false;
+        symbol.vwap_orders.resize(vwap_count);
+        for (auto& vwap : symbol.vwap_orders) {
+            if (!decode_vwap(reader, vwap)) return false;
+        }
+        uint64_t position_count;
+        if (!reader.get(position_count) ||
+            position_count > reader.remaining() / (sizeof(ClientId) + sizeof(double))) {
+            return false;
+        }
+        symbol.positions.resize(position_count);
+        for (auto& position : symbol.positions) {
+            if (!reader.get(position.client) || !reader.get(position.quantity)) return false;
+        }
+    }
+    return reader.remaining() == 0;
+}
+
+bool write_file(const std::string& path, const std::vector<char>& data) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    bool synced = fdatasync(fd) == 0;
+    return ::close(fd) == 0 && synced;
+}
+
+bool sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+}
+
+bool save_snapshot(const std::string& directory, const EngineSnapshot& snapshot, std::string* path) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    size_t orders = 0;
+    for (const auto& symbol : snapshot.symbols) {
+        orders += symbol.book.orders.size();
+    }
+    std::vector<char> data;
+    data.reserve(4096 + orders * sizeof(OrderImage));
+    encode(snapshot, data);
+
+    char name[48];
+    std::snprintf(name, sizeof(name), "/snapshot-%020llu.snap",
+                  static_cast<unsigned long long>(snapshot.journal_sequence));
+    std::string final_path = directory + name;
+    std::string temp_path = final_path + ".tmp";
+    if (!write_file(temp_path, data) || std::rename(temp_path.c_str(), final_path.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    if (!sync_directory(directory)) return false;
+    if (path) *path = final_path;
+    return true;
+}
+
+bool load_snapshot(const std::string& path, EngineSnapshot& snapshot) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    std::vector<char> data(static_cast<size_t>(info.st_size));
+    size_t read_bytes = 0;
+    while (read_bytes < data.size()) {
+        ssize_t n = ::read(fd, data.data() + read_bytes, data.size() - read_bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        read_bytes += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    if (read_bytes != data.size()) return false;
+
+    snapshot = EngineSnapshot();
+    return decode(data.data(), data.size(), snapshot);
+}
+
+std::vector<std::string> list_snapshots(const std::string& directory) {
+    std::vector<std::pair<uint64_t, std::string>> found;
+    if (DIR* dir = opendir(directory.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            unsigned long long sequence;
+            char tail[8];
+            if (std::sscanf(entry->d_name, "snapshot-%20llu.%7s", &sequence, tail) == 2 &&
+                std::strcmp(tail, "snap") == 0) {
+                found.emplace_back(sequence, directory + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(found.rbegin(), found.rend());
+
+    std::vector<std::string> paths;
+    for (auto& entry : found) {
+        paths.push_back(std::move(entry.second));
+    }
+    return paths;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "Order.h"
+#include "Price.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where a captured order sits in its book
+enum class OrderPlacement : uint8_t {
+    RESTING,    // price ladder
+    STOP,       // stop / stop-limit trigger level
+    TRAILING,   // trailing stop group
+};
+
+// One live order of a book, as restore() needs it back
+struct OrderImage {
+    uint64_t id;
+    uint64_t sequence;
+    OrderType type;
+    OrderSide side;
+    OrderStatus status;
+    OrderPlacement placement;
+    TimeInForce time_in_force;
+    ClientId client;
+    Price price;            // level or trigger price
+    double quantity;
+    double filled_quantity;
+    // Only present for orders that carry stop state
+    bool has_stop;
+    Price limit_price;
+    Price trailing_amount;
+    Price reference;        // the trailing group's reference price
+};
+
+// Everything an OrderBook holds. Orders are listed queue by queue in FIFO
+// order (bids, asks, stops, trailing groups), so restoring them in sequence
+// rebuilds the same time priority.
+struct BookImage {
+    Price last_trade_price;
+    uint64_t next_sequence;
+    uint64_t next_trade_sequence;
+    std::vector<OrderImage> orders;
+
+    BookImage() : last_trade_price(0), next_sequence(0), next_trade_sequence(0) {}
+};
+
+struct VWAPChildImage {
+    uint64_t id;
+    double quantity;
+    double filled_quantity;
+};
+
+// A live VWAP parent; times are wall-clock ns (see journal_time)
+struct VWAPImage {
+    uint64_t id;
+    ClientId client;
+    OrderSide side;
+    OrderStatus status;
+    Price target_vwap;
+    double quantity;
+    double filled_quantity;
+    int64_t start_time;
+    int64_t end_time;
+    Price last_child_price;
+    int64_t last_child_time;
+    std::vector<uint64_t> child_ids;
+    // Children still counting towards the parent
+    std::vector<VWAPChildImage> live_children;
+};
+
+// A client's net filled quantity in one symbol
+struct PositionImage {
+    ClientId client;
+    double quantity;
+};
+
+struct SymbolImage {
+    std::string symbol;
+    SymbolConfig config;
+    // Journal records for this symbol up to here are reflected in the image
+    uint64_t journal_sequence;
+    bool has_book;
+    BookImage book;
+    std::vector<VWAPImage> vwap_orders;
+    std::vector<PositionImage> positions;
+
+    SymbolImage() : journal_sequence(0), has_book(false) {}
+};
+
+// Engine state at one point. Each symbol is captured on its own, so symbols
+// may cover different journal positions; every record after
+// journal_sequence is at or past all of them.
+struct EngineSnapshot {
+    uint64_t journal_sequence;
+    uint64_t next_order_id;
+    // Client names by the ClientId the images use
+    std::vector<std::string> clients;
+    std::vector<SymbolImage> symbols;
+
+    EngineSnapshot() : journal_sequence(0), next_order_id(1) {}
+};
+
+// Snapshots are files named snapshot-<journal sequence>.snap. Saving writes
+// a temporary file, syncs it and renames it into place, so a crash leaves
+// either the old set of snapshots or the new one. The file ends in a CRC-32
+// of its contents; load() rejects a file that doesn't match.
+bool save_snapshot(const std::string& directory, const EngineSnapshot& snapshot, std::string* path = nullptr);
+bool load_snapshot(const std::string& path, EngineSnapshot& snapshot);
+// Snapshot files in `directory`, newest first
+std::vector<std::string> list_snapshots(const std::string& directory);
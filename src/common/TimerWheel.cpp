@@ -0,0 +1,164 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+namespace {
+
+// A TimerId packs the node index with its generation, so an id of a timer
+// that fired (and whose node was reused) never cancels the new one
+TimerId make_id(int32_t index, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(index);
+}
+
+}
+
+TimerWheel::TimerWheel(Clock::duration _tick, Clock::time_point _start)
+    : tick(_tick > Clock::duration::zero() ? _tick : Clock::duration(1)), start(_start),
+      current_tick(0), pending_count(0), free_nodes(NONE) {
+    for (auto& level : slots) {
+        level.fill(NONE);
+    }
+}
+
+TimerId TimerWheel::schedule_at(Clock::time_point when, Callback callback) {
+    int32_t index;
+    if (free_nodes != NONE) {
+        index = free_nodes;
+        free_nodes = nodes[index].next;
+    } else {
+        index = static_cast<int32_t>(nodes.size());
+        nodes.push_back(Node{0, 1, NONE, NONE, 0, 0, nullptr});
+    }
+
+    Node& node = nodes[index];
+    // Never due before the next tick the wheel processes
+    node.expiry = std::max(tick_of(when), current_tick + 1);
+    node.callback = std::move(callback);
+    link(index);
+    ++pending_count;
+    return make_id(index, node.generation);
+}
+
+TimerId TimerWheel::schedule_after(Clock::duration delay, Callback callback) {
+    return schedule_at(start + (current_tick * tick) + delay, std::move(callback));
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    int32_t index = static_cast<int32_t>(id & 0xffffffffu);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index < 0 || static_cast<size_t>(index) >= nodes.size()) return false;
+
+    Node& node = nodes[index];
+    if (node.generation != generation || !node.callback) return false;
+
+    unlink(index);
+    release(index);
+    --pending_count;
+    return true;
+}
+
+size_t TimerWheel::advance(Clock::time_point now, std::vector<Callback>& due) {
+    uint64_t target = tick_of(now);
+    if (target <= current_tick) return 0;
+
+    size_t fired = 0;
+    while (current_tick < target) {
+        if (pending_count == 0) {
+            // Nothing to cascade or fire; jump straight there
+            current_tick = target;
+            break;
+        }
+        ++current_tick;
+
+        // Higher levels first, so timers they hand down to a slot that is
+        // also due this tick get handed down again
+        for (int level = LEVELS - 1; level > 0; --level) {
+            uint64_t low_bits = current_tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1);
+            if (low_bits == 0) {
+                cascade(level, (current_tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+            }
+        }
+
+        int32_t index = slots[0][current_tick & (SLOTS - 1)];
+        slots[0][current_tick & (SLOTS - 1)] = NONE;
+        while (index != NONE) {
+            int32_t next = nodes[index].next;
+            if (nodes[index].expiry > current_tick) {
+                // Parked beyond the wheel's horizon; place it again
+                link(index);
+            } else {
+                due.push_back(std::move(nodes[index].callback));
+                release(index);
+                --pending_count;
+                ++fired;
+            }
+            index = next;
+        }
+    }
+    return fired;
+}
+
+uint64_t TimerWheel::tick_of(Clock::time_point when) const {
+    if (when <= start) return 0;
+    // Round up: a timer never fires early
+    return static_cast<uint64_t>((when - start + tick - Clock::duration(1)) / tick);
+}
+
+void TimerWheel::link(int32_t index) {
+    Node& node = nodes[index];
+
+    // The level is set by the highest slot digit in which the expiry differs
+    // from now; past the top level's range it waits in the top level's last slot
+    int level = 0;
+    for (int l = LEVELS - 1; l > 0; --l) {
+        if ((node.expiry >> (SLOT_BITS * l)) != (current_tick >> (SLOT_BITS * l))) {
+            level = l;
+            break;
+        }
+    }
+    uint64_t slot;
+    if ((node.expiry >> (SLOT_BITS * LEVELS)) != (current_tick >> (SLOT_BITS * LEVELS))) {
+        level = LEVELS - 1;
+        slot = ((current_tick >> (SLOT_BITS * level)) + SLOTS - 1) & (SLOTS - 1);
+    } else {
+        slot = (node.expiry >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+
+    node.level = static_cast<int16_t>(level);
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = NONE;
+    node.next = slots[level][slot];
+    if (node.next != NONE) {
+        nodes[node.next].prev = index;
+    }
+    slots[level][slot] = index;
+}
+
+void TimerWheel::unlink(int32_t index) {
+    Node& node = nodes[index];
+    if (node.prev != NONE) {
+        nodes[node.prev].next = node.next;
+    } else {
+        slots[node.level][node.slot] = node.next;
+    }
+    if (node.next != NONE) {
+        nodes[node.next].prev = node.prev;
+    }
+}
+
+void TimerWheel::cascade(int level, uint64_t slot) {
+    int32_t index = slots[level][slot];
+    slots[level][slot] = NONE;
+    while (index != NONE) {
+        int32_t next = nodes[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::release(int32_t index) {
+    Node& node = nodes[index];
+    node.callback = nullptr;
+    ++node.generation;
+    node.next = free_nodes;
+    free_nodes = index;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+using TimerId = uint64_t;
+
+// Hierarchical timing wheel: four levels of 256 slots each, so scheduling and
+// cancelling are O(1) and advancing costs O(1) per tick plus the timers that
+// move or fire. Timers live in one node array recycled through a free list.
+// Not thread-safe; one owner schedules and advances it.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    explicit TimerWheel(Clock::duration _tick = std::chrono::milliseconds(10),
+                        Clock::time_point _start = Clock::now());
+
+    // Timers fire on the first advance at or after `when`, rounded up to a tick
+    TimerId schedule_at(Clock::time_point when, Callback callback);
+    // Relative to the time of the last advance
+    TimerId schedule_after(Clock::duration delay, Callback callback);
+    // False if the timer already fired or was cancelled
+    bool cancel(TimerId id);
+
+    // Moves the wheel to `now` and appends the callbacks that came due, tick
+    // by tick, to `due`. The caller runs them and is free to schedule more.
+    size_t advance(Clock::time_point now, std::vector<Callback>& due);
+
+    size_t pending() const { return pending_count; }
+    Clock::duration tick_length() const { return tick; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint64_t SLOTS = 1u << SLOT_BITS;
+    static constexpr int32_t NONE = -1;
+
+    struct Node {
+        uint64_t expiry;
+        uint32_t generation;
+        int32_t prev;
+        int32_t next;
+        int16_t level;
+        uint16_t slot;
+        Callback callback;
+    };
+
+    Clock::duration tick;
+    Clock::time_point start;
+    uint64_t current_tick;
+    size_t pending_count;
+    std::vector<Node> nodes;
+    int32_t free_nodes;
+    std::array<std::array<int32_t, SLOTS>, LEVELS> slots;
+
+    uint64_t tick_of(Clock::time_point when) const;
+    void link(int32_t index);
+    void unlink(int32_t index);
+    void cascade(int level, uint64_t slot);
+    void release(int32_t index);
+};
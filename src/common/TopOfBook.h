@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Best bid/ask with the open quantity at each, and the last trade price.
+// Prices are 0 when the side is empty or nothing has traded.
+struct TopOfBook {
+    double bid;
+    double bid_size;
+    double ask;
+    double ask_size;
+    double last;
+    // Bumped on every change the book publishes
+    uint64_t sequence;
+
+    TopOfBook() : bid(0.0), bid_size(0.0), ask(0.0), ask_size(0.0), last(0.0), sequence(0) {}
+
+    bool same_quote(const TopOfBook& other) const {
+        return bid == other.bid && bid_size == other.bid_size && ask == other.ask &&
+               ask_size == other.ask_size && last == other.last;
+    }
+};
+
+// Single-writer seqlock around a TopOfBook. The book's thread publishes;
+// readers never take a lock and never block the writer, they retry if a
+// publish overlapped their read. Fields are relaxed atomics so the racing
+// reads are well defined.
+class TopOfBookCell {
+private:
+    std::atomic<uint64_t> version;
+    std::atomic<double> bid;
+    std::atomic<double> bid_size;
+    std::atomic<double> ask;
+    std::atomic<double> ask_size;
+    std::atomic<double> last;
+
+public:
+    TopOfBookCell() : version(0), bid(0.0), bid_size(0.0), ask(0.0), ask_size(0.0), last(0.0) {}
+
+    // Writer side; callers must serialize publishes
+    void publish(const TopOfBook& top) {
+        uint64_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bid.store(top.bid, std::memory_order_relaxed);
+        bid_size.store(top.bid_size, std::memory_order_relaxed);
+        ask.store(top.ask, std::memory_order_relaxed);
+        ask_size.store(top.ask_size, std::memory_order_relaxed);
+        last.store(top.last, std::memory_order_relaxed);
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    TopOfBook read() const {
+        TopOfBook top;
+        uint64_t before, after;
+        do {
+            before = version.load(std::memory_order_acquire);
+            top.bid = bid.load(std::memory_order_relaxed);
+            top.bid_size = bid_size.load(std::memory_order_relaxed);
+            top.ask = ask.load(std::memory_order_relaxed);
+            top.ask_size = ask_size.load(std::memory_order_relaxed);
+            top.last = last.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = version.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+        top.sequence = before / 2;
+        return top;
+    }
+};
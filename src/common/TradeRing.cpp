@@ -0,0 +1,39 @@
+#include "TradeRing.h"
+
+TradeRing::TradeRing(size_t capacity)
+    : events(capacity > 0 ? capacity : 1), head(0), tail(0), spilling(false) {}
+
+void TradeRing::push(const TradeEvent& event) {
+    if (!spilling.load(std::memory_order_acquire)) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) < events.size()) {
+            events[h % events.size()] = event;
+            head.store(h + 1, std::memory_order_release);
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex);
+    spilling.store(true, std::memory_order_release);
+    overflow.push_back(event);
+}
+
+size_t TradeRing::drain(std::vector<TradeEvent>& out) {
+    // Consumers serialize here; the producer only waits on this while spilling
+    std::lock_guard<std::mutex> lock(overflow_mutex);
+    size_t before = out.size();
+
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    for (uint64_t i = t; i < h; ++i) {
+        out.push_back(events[i % events.size()]);
+    }
+    tail.store(h, std::memory_order_release);
+
+    if (spilling.load(std::memory_order_relaxed)) {
+        out.insert(out.end(), overflow.begin(), overflow.end());
+        overflow.clear();
+        spilling.store(false, std::memory_order_release);
+    }
+    return out.size() - before;
+}
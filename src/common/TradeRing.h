@@ -0,0 +1,45 @@
+#pragma once
+#include "Order.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// One execution as the book recorded it
+struct TradeEvent {
+    uint64_t sequence;
+    SymbolId symbol;
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    ClientId buyer;
+    ClientId seller;
+    Price price;
+    double quantity;
+};
+
+// Trades from one book, in execution order. The book's thread is the only
+// producer and never blocks on a consumer: if the ring is full the trade goes
+// to an overflow list until the next drain picks it up, so nothing is lost.
+// Consumers drain in batches from any thread.
+class TradeRing {
+private:
+    std::vector<TradeEvent> events;
+    alignas(64) std::atomic<uint64_t> head;  // next slot the producer writes
+    alignas(64) std::atomic<uint64_t> tail;  // next slot a consumer reads
+
+    // Set while the producer is writing to overflow; every later trade goes
+    // there too, so ring entries always precede overflow entries
+    std::mutex overflow_mutex;
+    std::atomic<bool> spilling;
+    std::vector<TradeEvent> overflow;
+
+public:
+    explicit TradeRing(size_t capacity = 4096);
+
+    // Producer side
+    void push(const TradeEvent& event);
+
+    // Consumer side; safe to call from several threads. Appends every trade
+    // pushed so far to `out` and returns how many there were.
+    size_t drain(std::vector<TradeEvent>& out);
+};
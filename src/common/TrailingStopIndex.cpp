@@ -0,0 +1,127 @@
+#include "TrailingStopIndex.h"
+#include "Logger.h"
+#include <iterator>
+
+void TrailingStopIndex::add(Order* order, Price reference) {
+    StopOrderState& state = order->stop_state();
+    GroupKey key(reference, state.trailing_amount);
+    auto it = groups.find(key);
+    if (it == groups.end()) {
+        it = groups.emplace(key, TrailingStopGroup{state.trailing_amount, reference, PriceLevel()}).first;
+        insert_trigger(it->second);
+    }
+
+    state.trailing_group = &it->second;
+    it->second.orders.push_back(order);
+}
+
+void TrailingStopIndex::remove(Order* order) {
+    StopOrderState& state = order->stop_state();
+    TrailingStopGroup* group = state.trailing_group;
+    if (!group) return;
+
+    group->orders.erase(order);
+    state.trailing_group = nullptr;
+    if (group->orders.empty()) {
+        erase_trigger(*group);
+        groups.erase(GroupKey(group->reference, group->amount));
+    }
+}
+
+void TrailingStopIndex::reprice(Price last_price) {
+    if (last_price <= 0) return;
+
+    if (side == OrderSide::SELL) {
+        // Unreferenced groups (reference 0) sort first and are picked up here too
+        while (!groups.empty() && groups.begin()->first.first < last_price) {
+            move_group(groups.begin(), last_price);
+        }
+    } else {
+        while (!groups.empty() && groups.begin()->first.first == 0) {
+            move_group(groups.begin(), last_price);
+        }
+        while (!groups.empty() && std::prev(groups.end())->first.first > last_price) {
+            move_group(std::prev(groups.end()), last_price);
+        }
+    }
+}
+
+bool TrailingStopIndex::pop_triggered(Price last_price, PriceLevel& triggered) {
+    if (triggers.empty() || last_price <= 0) return false;
+
+    // Sell stops fire at or below their trigger, highest trigger first;
+    // buy stops at or above, lowest first.
+    auto it = (side == OrderSide::SELL) ? std::prev(triggers.end()) : triggers.begin();
+    bool crossed = (side == OrderSide::SELL) ? last_price <= it->first.first
+                                             : last_price >= it->first.first;
+    if (!crossed) return false;
+
+    TrailingStopGroup* group = it->second;
+    Price trigger = it->first.first;
+    triggers.erase(it);
+
+    for (Order* order = group->orders.front(); order; order = order->next_in_level) {
+        StopOrderState& state = order->stop_state();
+        if (side == OrderSide::SELL) {
+            state.highest_price = group->reference;
+        } else {
+            state.lowest_price = group->reference;
+        }
+        order->price = trigger;
+        state.trailing_group = nullptr;
+    }
+    triggered.append(group->orders);
+    groups.erase(GroupKey(group->reference, group->amount));
+    return true;
+}
+
+void TrailingStopIndex::insert_trigger(TrailingStopGroup& group) {
+    // Groups without a reference cannot trigger yet
+    if (group.reference > 0) {
+        triggers[TriggerKey(trigger_price(group), group.amount)] = &group;
+    }
+}
+
+void TrailingStopIndex::erase_trigger(const TrailingStopGroup& group) {
+    if (group.reference > 0) {
+        triggers.erase(TriggerKey(trigger_price(group), group.amount));
+    }
+}
+
+void TrailingStopIndex::move_group(std::map<GroupKey, TrailingStopGroup>::iterator it, Price reference) {
+    erase_trigger(it->second);
+
+    // The node (and so every order's pointer to the group) survives re-keying
+    auto node = groups.extract(it);
+    node.mapped().reference = reference;
+    logger().log(LogLevel::DEBUG, LogEvent::TRAILING_REPRICED, node.mapped().orders.size(),
+                 static_cast<uint64_t>(side), price_to_double(reference), price_to_double(trigger_price(node.mapped())));
+    node.key() = GroupKey(reference, node.mapped().amount);
+
+    auto existing = groups.find(node.key());
+    if (existing == groups.end()) {
+        auto inserted = groups.insert(std::move(node));
+        insert_trigger(inserted.position->second);
+        return;
+    }
+
+    TrailingStopGroup& resident = existing->second;
+    if (node.mapped().orders.size() <= resident.orders.size()) {
+        absorb(resident, node.mapped());
+        return;
+    }
+
+    // The moving group is larger: fold the resident group into it instead
+    erase_trigger(resident);
+    absorb(node.mapped(), resident);
+    groups.erase(existing);
+    auto inserted = groups.insert(std::move(node));
+    insert_trigger(inserted.position->second);
+}
+
+void TrailingStopIndex::absorb(TrailingStopGroup& into, TrailingStopGroup& from) {
+    for (Order* order = from.orders.front(); order; order = order->next_in_level) {
+        order->stop_state().trailing_group = &into;
+    }
+    into.orders.merge(from.orders);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "Order.h"
+#include "PriceLevel.h"
+#include <map>
+#include <utility>
+
+// Trailing stops that share a trailing amount and a reference price (the best
+// trade seen since they were placed: highest for sells, lowest for buys).
+// Their trigger price is derived from the group; an order's own price and
+// highest/lowest fields are only written once it fires.
+struct TrailingStopGroup {
+    Price amount;
+    Price reference;    // 0 until the symbol has traded
+    PriceLevel orders;
+};
+
+// Pending trailing stops for one side of a book. A new high (or low) only
+// re-keys the groups whose reference it moves; groups with the same amount
+// that land on the same reference merge, smaller into larger, interleaving
+// their orders by sequence so they still fire in arrival order. Groups are
+// also ordered by trigger price, so firing visits only the groups that trigger.
+class TrailingStopIndex {
+private:
+    using GroupKey = std::pair<Price, Price>;   // (reference, amount)
+    using TriggerKey = std::pair<Price, Price>; // (trigger price, amount)
+
+    OrderSide side;
+    std::map<GroupKey, TrailingStopGroup> groups;
+    std::map<TriggerKey, TrailingStopGroup*> triggers;
+
+public:
+    explicit TrailingStopIndex(OrderSide _side) : side(_side) {}
+
+    bool empty() const { return groups.empty(); }
+    size_t group_count() const { return groups.size(); }
+
+    // `reference` is the last trade price, or 0 if the symbol has not traded
+    void add(Order* order, Price reference);
+    void remove(Order* order);
+
+    // Moves every group the trade at `last_price` improves on to that price
+    void reprice(Price last_price);
+
+    // Detaches the next group whose trigger `last_price` has crossed and
+    // appends its orders to `triggered`, with price set to the trigger.
+    bool pop_triggered(Price last_price, PriceLevel& triggered);
+
+    // Calls visit(order, reference) for every pending order, group by group
+    // and in FIFO order within a group
+    template <typename Visit>
+    void for_each(Visit visit) const {
+        for (const auto& [key, group] : groups) {
+            for (Order* order = group.orders.front(); order; order = order->next_in_level) {
+                visit(order, group.reference);
+            }
+        }
+    }
+
+private:
+    Price trigger_price(const TrailingStopGroup& group) const {
+        return (side == OrderSide::SELL) ? group.reference - group.amount : group.reference + group.amount;
+    }
+    void insert_trigger(TrailingStopGroup& group);
+    void erase_trigger(const TrailingStopGroup& group);
+    void move_group(std::map<GroupKey, TrailingStopGroup>::iterator it, Price reference);
+    void absorb(TrailingStopGroup& into, TrailingStopGroup& from);
+};
@@ -63,13 +63,13 @@ VWAPCalculator::ChildOrderParams VWAPCalculator::calculate_child_order_params(
         return params;
     }
     
-    if (now < vwap_order->execution_start_time || now > vwap_order->execution_end_time) {
+    if (now < vwap_order->vwap->execution_start_time || now > vwap_order->vwap->execution_end_time) {
         params.should_place = false;
         return params;
     }
     
     auto time_remaining = std::chrono::duration_cast<std::chrono::seconds>(
-        vwap_order->execution_end_time - now).count();
+        vwap_order->vwap->execution_end_time - now).count();
     
     if (time_remaining <= 0) {
         params.should_place = false;
@@ -106,9 +106,9 @@ VWAPCalculator::ChildOrderParams VWAPCalculator::calculate_child_order_params(
     }
     
     auto time_since_last = std::chrono::duration_cast<std::chrono::seconds>(
-        now - vwap_order->last_child_order_time).count();
+        now - vwap_order->vwap->last_child_order_time).count();
     
-    double price_change = std::abs(params.limit_price - vwap_order->last_child_order_price);
+    double price_change = std::abs(params.limit_price - price_to_double(vwap_order->vwap->last_child_order_price));
     double price_change_pct = price_change / target_vwap;
     
     params.should_place = (time_since_last >= 30) || (price_change_pct >= 0.001);
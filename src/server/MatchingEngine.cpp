@@ -1,47 +1,494 @@
 #include "MatchingEngine.h"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <thread>
 #include <chrono>
 
-MatchingEngine::MatchingEngine() : next_order_id(1) {}
+namespace {
+
+// Journal entry for an order the engine has accepted and priced
+JournalCommand order_command(JournalRecordType type, uint64_t order_id, SymbolId symbol, ClientId client,
+                             OrderType order_type, OrderSide side, Price price, double quantity) {
+    JournalCommand command(type);
+    command.order_id = order_id;
+    command.symbol = symbol_directory().name(symbol);
+    command.client_id = client_directory().name(client);
+    command.order_type = order_type;
+    command.side = side;
+    command.price = price;
+    command.quantity = quantity;
+    return command;
+}
+
+bool is_default_config(const SymbolConfig& config) {
+    SymbolConfig defaults;
+    return config.tick_size == defaults.tick_size && config.backend == defaults.backend &&
+           config.dense_levels == defaults.dense_levels;
+}
+
+uint64_t steady_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Whether an order can end up resting, and so needs an open-order slot and a location
+bool can_rest(const OrderRequest& request) {
+    return request.type != OrderType::MARKET && !is_immediate(request.time_in_force);
+}
+
+// The price a market order's notional is checked at: the best price on the
+// side it takes from, or 0 if that side is empty
+double market_reference(const OrderBook& book, OrderSide side) {
+    return side == OrderSide::BUY ? book.get_best_ask() : book.get_best_bid();
+}
+
+// Journal records applied per round of recovery tasks
+constexpr size_t REPLAY_CHUNK = 65536;
+
+}
+
+MatchingEngine::MatchingEngine(size_t shard_count)
+    : book_slots(new std::atomic<std::atomic<SymbolSlot*>*>[MAX_SLOT_CHUNKS]()),
+      next_order_id(1), stopping(false), applied_sequence(0), stop_following_requested(false) {
+    if (shard_count == 0) {
+        shard_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(std::make_unique<MatchingShard>());
+    }
+    timer_thread = std::thread(&MatchingEngine::run_timers, this);
+}
+
+MatchingEngine::~MatchingEngine() {
+    // Let the shards finish what they have queued; nothing new gets posted
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex);
+        stopping = true;
+    }
+    timer_wakeup.notify_all();
+    timer_thread.join();
+    shards.clear();
+    // The journal's last group still goes out to backups
+    if (journal) {
+        journal->close();
+    }
+    if (publisher) {
+        publisher->close();
+    }
+    for (size_t i = 0; i < MAX_SLOT_CHUNKS; ++i) {
+        delete[] book_slots[i].load(std::memory_order_relaxed);
+    }
+}
+
+bool MatchingEngine::enable_journal(const JournalConfig& config) {
+    if (journal) return false;
+    auto opened = std::make_unique<Journal>(config);
+    if (!opened->open()) return false;
+    journal = std::move(opened);
+    return true;
+}
+
+bool MatchingEngine::enable_replication(const std::string& endpoint) {
+    if (!journal || publisher) return false;
+    auto opened = std::make_unique<ReplicationPublisher>();
+    if (!opened->listen(endpoint, journal->last_sequence())) return false;
+    publisher = std::move(opened);
+    ReplicationPublisher* target = publisher.get();
+    journal->set_record_sink([target](const char* records, size_t size, uint64_t last_sequence) {
+        target->publish(records, size, last_sequence);
+    });
+    return true;
+}
+
+bool MatchingEngine::follow(const std::string& endpoint, std::chrono::milliseconds silence) {
+    if (journal) return false;
+    stop_following_requested = false;
+    
+    // As in recovery, the fills were logged where they happened
+    LogLevel log_level = logger().get_level();
+    logger().set_level(std::max(log_level, LogLevel::WARN));
+    bool followed = follow_primary(endpoint, applied_sequence.load(), silence, stop_following_requested,
+                                   [this](std::vector<JournalCommand>& batch) {
+        uint64_t last = batch.back().sequence;
+        if (!covered_sequences.empty()) {
+            batch.erase(std::remove_if(batch.begin(), batch.end(), [this](const JournalCommand& command) {
+                auto it = covered_sequences.find(symbol_directory().intern(command.symbol));
+                return it != covered_sequences.end() && command.sequence <= it->second;
+            }), batch.end());
+        }
+        replay(batch);
+        applied_sequence.store(last);
+    });
+    logger().set_level(log_level);
+    return followed;
+}
+
+void MatchingEngine::stop_following() {
+    stop_following_requested = true;
+}
+
+bool MatchingEngine::write_snapshot(const std::string& directory, std::string* path) {
+    EngineSnapshot snapshot;
+    // Read before the symbols are listed: any symbol that shows up later has
+    // no journal records before this point
+    snapshot.journal_sequence = captured_sequence();
+    
+    std::vector<SymbolId> symbol_ids;
+    {
+        std::lock_guard<std::mutex> lock(symbols_mutex);
+        for (SymbolId id = 0; id < symbols.size(); ++id) {
+            if (symbols[id].book || !is_default_config(symbols[id].config)) {
+                symbol_ids.push_back(id);
+            }
+        }
+    }
+    
+    // One capture task per symbol; shards copy their books in parallel and
+    // interleave the copies with normal work
+    snapshot.symbols.resize(symbol_ids.size());
+    std::vector<std::future<void>> captures;
+    for (size_t i = 0; i < symbol_ids.size(); ++i) {
+        SymbolId symbol_id = symbol_ids[i];
+        SymbolImage* image = &snapshot.symbols[i];
+        image->symbol = symbol_directory().name(symbol_id);
+        captures.push_back(shard_for(symbol_id).executor.enqueue([this, symbol_id, image]() {
+            capture_symbol(symbol_id, *image);
+        }));
+    }
+    for (auto& capture : captures) {
+        capture.get();
+    }
+    
+    // Taken after the captures, so it is past every id they hold
+    snapshot.next_order_id = next_order_id.load();
+    NameDirectory& clients = client_directory();
+    size_t client_count = clients.size();
+    snapshot.clients.reserve(client_count);
+    for (ClientId id = 0; id < client_count; ++id) {
+        snapshot.clients.push_back(clients.name(id));
+    }
+    
+    return save_snapshot(directory, snapshot, path);
+}
+
+bool MatchingEngine::write_snapshot_from_journal(const std::string& directory, std::string* path) {
+    if (!journal) return false;
+    uint64_t through = journal->last_sequence();
+    if (through != 0 && !journal->wait_durable(through)) return false;
+    
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    if (!snapshot_shadow) {
+        // A standby, so its VWAP orders stay idle; the fills it replays were
+        // logged here already
+        auto shadow = std::make_unique<MatchingEngine>(shards.size());
+        if (!shadow->recover(directory, "", true)) return false;
+        shadow->set_shard_log_level(LogLevel::WARN);
+        snapshot_shadow = std::move(shadow);
+    }
+    // Stopping at `through` keeps the snapshot's sequence true to its contents
+    if (!snapshot_shadow->replay_journal(journal->directory(), snapshot_shadow->applied_sequence.load(), through)) {
+        snapshot_shadow.reset();
+        return false;
+    }
+    return snapshot_shadow->write_snapshot(directory, path);
+}
+
+void MatchingEngine::set_shard_log_level(LogLevel level) {
+    for (auto& shard : shards) {
+        shard->executor.call([level]() { Logger::set_thread_level(level); });
+    }
+}
+
+bool MatchingEngine::recover(const std::string& snapshot_directory, const std::string& journal_directory,
+                             bool standby) {
+    if (journal) return false;
+    
+    EngineSnapshot snapshot;
+    if (!snapshot_directory.empty()) {
+        // A snapshot torn by a crash fails its checksum; fall back to the one before
+        for (const auto& path : list_snapshots(snapshot_directory)) {
+            if (load_snapshot(path, snapshot)) break;
+            snapshot = EngineSnapshot();
+        }
+    }
+    
+    std::vector<ClientId> clients;
+    clients.reserve(snapshot.clients.size());
+    for (const auto& name : snapshot.clients) {
+        clients.push_back(client_directory().intern(name));
+    }
+    
+    size_t restored_orders = 0;
+    for (const auto& image : snapshot.symbols) {
+        restored_orders += image.book.orders.size() + image.vwap_orders.size();
+    }
+    for (auto& stripe : location_stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        stripe.locations.reserve(stripe.locations.size() + restored_orders / LOCATION_STRIPES);
+    }
+    
+    std::unordered_map<SymbolId, uint64_t>& covered = covered_sequences;
+    std::vector<std::future<void>> restores;
+    for (auto& image : snapshot.symbols) {
+        SymbolId symbol_id = symbol_directory().intern(image.symbol);
+        covered[symbol_id] = image.journal_sequence;
+        SymbolImage* restored = &image;
+        restores.push_back(shard_for(symbol_id).executor.enqueue([this, symbol_id, restored, &clients]() {
+            restore_symbol(symbol_id, *restored, clients);
+        }));
+    }
+    for (auto& restore : restores) {
+        restore.get();
+    }
+    next_order_id.store(std::max(next_order_id.load(), snapshot.next_order_id));
+    
+    applied_sequence.store(snapshot.journal_sequence);
+    bool replayed = true;
+    if (!journal_directory.empty()) {
+        // Fills being replayed were logged when they first happened. Only
+        // the shards are quietened, as another engine may share the logger.
+        set_shard_log_level(LogLevel::WARN);
+        replayed = replay_journal(journal_directory, snapshot.journal_sequence, UINT64_MAX);
+        set_shard_log_level(LogLevel::DEBUG);
+    }
+    
+    // A standby's VWAP slices arrive from its primary
+    if (!standby) {
+        resume_vwap_orders();
+    }
+    return replayed;
+}
+
+bool MatchingEngine::replay_journal(const std::string& journal_directory, uint64_t after, uint64_t through) {
+    const std::unordered_map<SymbolId, uint64_t>& covered = covered_sequences;
+    uint64_t last_sequence = after;
+    std::vector<JournalCommand> chunk;
+    bool replayed = Journal::replay(journal_directory, after, [&](const JournalCommand& command) {
+        last_sequence = command.sequence;
+        auto it = covered.find(symbol_directory().intern(command.symbol));
+        if (it != covered.end() && command.sequence <= it->second) return;
+        chunk.push_back(command);
+        if (chunk.size() >= REPLAY_CHUNK) {
+            replay(chunk);
+            chunk.clear();
+        }
+    }, through);
+    replay(chunk);
+    applied_sequence.store(last_sequence);
+    return replayed;
+}
+
+void MatchingEngine::resume_vwap_orders() {
+    for (auto& shard : shards) {
+        MatchingShard* owner = shard.get();
+        owner->executor.call([this, owner]() {
+            for (const auto& [order_id, order] : owner->vwap_orders) {
+                SymbolId symbol_id = order->symbol;
+                uint64_t id = order_id;
+                post_to_shard(symbol_id, [this, symbol_id, id]() { process_vwap_order(symbol_id, id); });
+            }
+        });
+    }
+}
+
+void MatchingEngine::replay(const std::vector<JournalCommand>& commands, const std::function<void(size_t)>& applied) {
+    // Each shard takes its symbols' commands in journal order
+    std::vector<SymbolId> symbol_ids(commands.size());
+    std::vector<std::vector<size_t>> by_shard(shards.size());
+    uint64_t next_id = next_order_id.load();
+    for (size_t i = 0; i < commands.size(); ++i) {
+        symbol_ids[i] = symbol_directory().intern(commands[i].symbol);
+        by_shard[symbol_ids[i] % shards.size()].push_back(i);
+        next_id = std::max(next_id, commands[i].order_id + 1);
+    }
+    // Ids issued after the replay continue past every recorded one
+    next_order_id.store(next_id);
+    
+    std::vector<std::future<void>> tasks;
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        if (by_shard[shard].empty()) continue;
+        const std::vector<size_t>* indices = &by_shard[shard];
+        tasks.push_back(shards[shard]->executor.enqueue([&, indices]() {
+            for (size_t i : *indices) {
+                apply_command(symbol_ids[i], commands[i]);
+                if (applied) applied(i);
+            }
+        }));
+    }
+    for (auto& task : tasks) {
+        task.get();
+    }
+}
 
 uint64_t MatchingEngine::submit_order(const std::string& symbol, OrderType type, OrderSide side,
-                                     double price, double quantity, const std::string& client_id) {
-    if (!validate_order(symbol, type, side, price, quantity, client_id)) {
+                                     double price, double quantity, const std::string& client_id,
+                                     TimeInForce time_in_force) {
+    if (!validate_order(symbol, type, side, price, quantity, client_id, time_in_force)) {
         return 0;
     }
     
-    uint64_t order_id = next_order_id++;
+    SymbolId symbol_id = symbol_directory().intern(symbol);
+    ClientId client = client_directory().intern(client_id);
     
-    std::lock_guard<std::mutex> lock(engine_mutex);
+    SymbolSlot& slot = book_slot(symbol_id);
+    const auto& book = slot.book;
+    Price order_price = 0;
+    if (type != OrderType::MARKET) {
+        order_price = book->get_config().to_price(price);
+        if (order_price <= 0) return 0;
+    }
     
-    if (order_books.find(symbol) == order_books.end()) {
-        order_books[symbol] = std::make_shared<OrderBook>(symbol);
-        order_books[symbol]->set_trade_callback([this](const std::string& sym, double price, double volume) {
-            feed_trade_to_vwap_calculator(sym, price, volume);
-        });
+    ClientRisk& client_risk = risk.at(client);
+    bool can_rest = type != OrderType::MARKET && !is_immediate(time_in_force);
+    double reference = type != OrderType::MARKET ? price : market_reference(*book, side);
+    if (!admit_order(client, client_risk, reference, quantity, can_rest)) {
+        return 0;
     }
     
-    auto order = std::make_shared<Order>(order_id, symbol, type, side, price, quantity, client_id);
+    uint64_t order_id = next_order_id++;
+    if (can_rest) {
+        remember_location(order_id, OrderLocation{symbol_id, client});
+    }
     
-    if (type == OrderType::MARKET) {
-        if (side == OrderSide::BUY) {
-            execute_market_buy_order(order_books[symbol], order);
-        } else {
-            execute_market_sell_order(order_books[symbol], order);
+    // Journalled on the shard, so the journal holds each book's input in the
+    // order it was applied
+    uint64_t sequence = 0;
+    bool accepted = run_on_shard(symbol_id, [&]() {
+        if (!position_allows(slot, client, side, quantity)) return false;
+        if (journal) {
+            JournalCommand command = order_command(JournalRecordType::ORDER, order_id, symbol_id, client,
+                                                   type, side, order_price, quantity);
+            command.time_in_force = time_in_force;
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
         }
-    } else {
-        order_books[symbol]->add_order(order);
-        thread_pool.enqueue([this, symbol]() {
-            process_matching(symbol);
-        });
+        auto order = book->create_order(order_id, symbol_id, type, side, order_price, quantity, client);
+        order->time_in_force = time_in_force;
+        enter_order(symbol_id, book, std::move(order));
+        return true;
+    });
+    finish_in_flight(client_risk, can_rest);
+    if (!accepted) {
+        forget_location(order_id);
+        return 0;
     }
     
-    client_orders[client_id].push_back(order_id);
+    await_journal(sequence);
     return order_id;
 }
 
+std::vector<uint64_t> MatchingEngine::submit_batch(const std::vector<OrderRequest>& requests) {
+    std::vector<uint64_t> results(requests.size(), 0);
+    
+    // Validate and price the whole batch before anything reaches a shard
+    struct Accepted {
+        size_t index;
+        SymbolId symbol;
+        ClientId client;
+        Price price;
+        uint64_t order_id;
+    };
+    std::vector<Accepted> accepted;
+    accepted.reserve(requests.size());
+    std::unordered_map<SymbolId, SymbolSlot*> slots;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const OrderRequest& request = requests[i];
+        if (!validate_order(request.symbol, request.type, request.side, request.price,
+                            request.quantity, request.client_id, request.time_in_force)) {
+            continue;
+        }
+        
+        SymbolId symbol_id = symbol_directory().intern(request.symbol);
+        SymbolSlot*& slot = slots[symbol_id];
+        if (!slot) {
+            slot = &book_slot(symbol_id);
+        }
+        const auto& book = slot->book;
+        Price order_price = 0;
+        if (request.type != OrderType::MARKET) {
+            order_price = book->get_config().to_price(request.price);
+            if (order_price <= 0) continue;
+        }
+        ClientId client = client_directory().intern(request.client_id);
+        double reference = request.type != OrderType::MARKET ? request.price : market_reference(*book, request.side);
+        if (!admit_order(client, risk.at(client), reference, request.quantity, can_rest(request))) {
+            continue;
+        }
+        accepted.push_back(Accepted{i, symbol_id, client, order_price, 0});
+    }
+    if (accepted.empty()) return results;
+    
+    // Ids follow request order, as if the orders had come in one by one
+    uint64_t first_id = next_order_id.fetch_add(accepted.size());
+    for (size_t i = 0; i < accepted.size(); ++i) {
+        accepted[i].order_id = first_id + i;
+        results[accepted[i].index] = first_id + i;
+        if (can_rest(requests[accepted[i].index])) {
+            remember_location(first_id + i, OrderLocation{accepted[i].symbol, accepted[i].client});
+        }
+    }
+    
+    // One task per symbol; symbols on different shards match in parallel
+    std::stable_sort(accepted.begin(), accepted.end(), [](const Accepted& a, const Accepted& b) {
+        return a.symbol < b.symbol;
+    });
+    std::vector<std::future<uint64_t>> groups;
+    for (size_t begin = 0; begin < accepted.size();) {
+        size_t end = begin;
+        while (end < accepted.size() && accepted[end].symbol == accepted[begin].symbol) {
+            ++end;
+        }
+        
+        SymbolId symbol_id = accepted[begin].symbol;
+        SymbolSlot* slot = slots[symbol_id];
+        groups.push_back(shard_for(symbol_id).executor.enqueue([&, begin, end, symbol_id, slot]() {
+            const auto& book = slot->book;
+            uint64_t sequence = 0;
+            for (size_t i = begin; i < end; ++i) {
+                const OrderRequest& request = requests[accepted[i].index];
+                uint64_t order_id = accepted[i].order_id;
+                if (!position_allows(*slot, accepted[i].client, request.side, request.quantity)) {
+                    results[accepted[i].index] = 0;
+                    continue;
+                }
+                if (journal) {
+                    JournalCommand command = order_command(JournalRecordType::ORDER, order_id, symbol_id,
+                                                           accepted[i].client, request.type, request.side,
+                                                           accepted[i].price, request.quantity);
+                    command.time_in_force = request.time_in_force;
+                    if (!journal_command(command)) {
+                        results[accepted[i].index] = 0;
+                        continue;
+                    }
+                    sequence = command.sequence;
+                }
+                auto order = book->create_order(order_id, symbol_id, request.type, request.side,
+                                                accepted[i].price, request.quantity, accepted[i].client);
+                order->time_in_force = request.time_in_force;
+                enter_order(symbol_id, book, std::move(order));
+            }
+            return sequence;
+        }));
+        begin = end;
+    }
+    
+    // One wait covers the whole batch
+    uint64_t last_sequence = 0;
+    for (auto& group : groups) {
+        last_sequence = std::max(last_sequence, group.get());
+    }
+    for (const auto& entry : accepted) {
+        finish_in_flight(risk.at(entry.client), can_rest(requests[entry.index]));
+        if (results[entry.index] == 0) {
+            forget_location(entry.order_id);
+        }
+    }
+    await_journal(last_sequence);
+    
+    return results;
+}
+
 uint64_t MatchingEngine::submit_stop_limit_order(const std::string& symbol, OrderSide side,
                                                 double stop_price, double limit_price, double quantity, 
                                                 const std::string& client_id) {
@@ -49,26 +496,44 @@ uint64_t MatchingEngine::submit_stop_limit_order(const std::string& symbol, Orde
         return 0;
     }
     
-    uint64_t order_id = next_order_id++;
+    SymbolId symbol_id = symbol_directory().intern(symbol);
+    ClientId client = client_directory().intern(client_id);
     
-    std::lock_guard<std::mutex> lock(engine_mutex);
+    SymbolSlot& slot = book_slot(symbol_id);
+    const auto& book = slot.book;
+    const SymbolConfig& config = book->get_config();
+    Price stop = config.to_price(stop_price);
+    Price limit = config.to_price(limit_price);
+    if (stop <= 0 || limit <= 0) return 0;
     
-    if (order_books.find(symbol) == order_books.end()) {
-        order_books[symbol] = std::make_shared<OrderBook>(symbol);
-        order_books[symbol]->set_trade_callback([this](const std::string& sym, double price, double volume) {
-            feed_trade_to_vwap_calculator(sym, price, volume);
-        });
-    }
+    ClientRisk& client_risk = risk.at(client);
+    if (!admit_order(client, client_risk, limit_price, quantity, true)) return 0;
     
-    auto order = std::make_shared<Order>(order_id, symbol, OrderType::STOP_LIMIT, side, 
-                                        stop_price, limit_price, quantity, client_id, StopLimitOrderTag{});
+    uint64_t order_id = next_order_id++;
+    remember_location(order_id, OrderLocation{symbol_id, client});
     
-    order_books[symbol]->add_order(order);
-    thread_pool.enqueue([this, symbol]() {
-        process_matching(symbol);
+    uint64_t sequence = 0;
+    bool accepted = run_on_shard(symbol_id, [&]() {
+        if (!position_allows(slot, client, side, quantity)) return false;
+        if (journal) {
+            JournalCommand command = order_command(JournalRecordType::STOP_LIMIT_ORDER, order_id, symbol_id, client,
+                                                   OrderType::STOP_LIMIT, side, stop, quantity);
+            command.limit_price = limit;
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
+        }
+        auto matched_orders = book->add_order(book->create_order(order_id, symbol_id, OrderType::STOP_LIMIT, side, 
+                                                                 stop, limit, quantity, client, StopLimitOrderTag{}));
+        process_fills(symbol_id, book, matched_orders);
+        return true;
     });
+    finish_in_flight(client_risk, true);
+    if (!accepted) {
+        forget_location(order_id);
+        return 0;
+    }
     
-    client_orders[client_id].push_back(order_id);
+    await_journal(sequence);
     return order_id;
 }
 
@@ -79,26 +544,41 @@ uint64_t MatchingEngine::submit_trailing_stop_order(const std::string& symbol, O
         return 0;
     }
     
-    uint64_t order_id = next_order_id++;
+    SymbolId symbol_id = symbol_directory().intern(symbol);
+    ClientId client = client_directory().intern(client_id);
     
-    std::lock_guard<std::mutex> lock(engine_mutex);
+    SymbolSlot& slot = book_slot(symbol_id);
+    const auto& book = slot.book;
+    Price trail = book->get_config().to_price(trailing_amount);
+    if (trail <= 0) return 0;
     
-    if (order_books.find(symbol) == order_books.end()) {
-        order_books[symbol] = std::make_shared<OrderBook>(symbol);
-        order_books[symbol]->set_trade_callback([this](const std::string& sym, double price, double volume) {
-            feed_trade_to_vwap_calculator(sym, price, volume);
-        });
-    }
+    ClientRisk& client_risk = risk.at(client);
+    if (!admit_order(client, client_risk, book->get_last_price(), quantity, true)) return 0;
     
-    auto order = std::make_shared<Order>(order_id, symbol, OrderType::TRAILING_STOP, side, 
-                                        trailing_amount, quantity, client_id, TrailingStopOrderTag{});
+    uint64_t order_id = next_order_id++;
+    remember_location(order_id, OrderLocation{symbol_id, client});
     
-    order_books[symbol]->add_order(order);
-    thread_pool.enqueue([this, symbol]() {
-        process_matching(symbol);
+    uint64_t sequence = 0;
+    bool accepted = run_on_shard(symbol_id, [&]() {
+        if (!position_allows(slot, client, side, quantity)) return false;
+        if (journal) {
+            JournalCommand command = order_command(JournalRecordType::TRAILING_STOP_ORDER, order_id, symbol_id, client,
+                                                   OrderType::TRAILING_STOP, side, trail, quantity);
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
+        }
+        auto matched_orders = book->add_order(book->create_order(order_id, symbol_id, OrderType::TRAILING_STOP, side, 
+                                                                 trail, quantity, client, TrailingStopOrderTag{}));
+        process_fills(symbol_id, book, matched_orders);
+        return true;
     });
+    finish_in_flight(client_risk, true);
+    if (!accepted) {
+        forget_location(order_id);
+        return 0;
+    }
     
-    client_orders[client_id].push_back(order_id);
+    await_journal(sequence);
     return order_id;
 }
 
@@ -112,108 +592,682 @@ uint64_t MatchingEngine::submit_vwap_order(const std::string& symbol, OrderSide
         return 0;
     }
     
-    uint64_t order_id = next_order_id++;
+    SymbolId symbol_id = symbol_directory().intern(symbol);
+    ClientId client = client_directory().intern(client_id);
     
-    std::lock_guard<std::mutex> lock(engine_mutex);
+    SymbolSlot& slot = book_slot(symbol_id);
+    Price target = slot.book->get_config().to_price(target_vwap);
+    if (target <= 0) return 0;
     
-    if (vwap_calculators.find(symbol) == vwap_calculators.end()) {
-        vwap_calculators[symbol] = std::make_shared<VWAPCalculator>(start_time, end_time);
-    }
+    // The parent never rests; the children it places count as open orders
+    if (!admit_order(client, risk.at(client), target_vwap, quantity, false)) return 0;
     
-    auto order = std::make_shared<Order>(order_id, symbol, OrderType::VWAP, side, 
-                                        target_vwap, quantity, start_time, end_time, 
-                                        client_id, VWAPOrderTag{});
-    
-    client_orders[client_id].push_back(order_id);
-    vwap_orders[order_id] = order;
+    uint64_t order_id = next_order_id++;
+    remember_location(order_id, OrderLocation{symbol_id, client});
     
-    thread_pool.enqueue([this, symbol, order_id]() {
-        process_vwap_order(symbol, order_id);
+    uint64_t sequence = 0;
+    bool accepted = run_on_shard(symbol_id, [&]() {
+        if (!position_allows(slot, client, side, quantity)) return false;
+        if (journal) {
+            JournalCommand command = order_command(JournalRecordType::VWAP_ORDER, order_id, symbol_id, client,
+                                                   OrderType::VWAP, side, target, quantity);
+            command.start_time = journal_time(start_time);
+            command.end_time = journal_time(end_time);
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
+        }
+        if (!slot.vwap_calculator) {
+            slot.vwap_calculator = std::make_shared<VWAPCalculator>(start_time, end_time);
+        }
+        shard_for(symbol_id).vwap_orders[order_id] =
+            std::make_shared<Order>(order_id, symbol_id, OrderType::VWAP, side, 
+                                    target, quantity, start_time, end_time, 
+                                    client, VWAPOrderTag{});
+        post_to_shard(symbol_id, [this, symbol_id, order_id]() {
+            process_vwap_order(symbol_id, order_id);
+        });
+        return true;
     });
+    if (!accepted) {
+        forget_location(order_id);
+        return 0;
+    }
     
+    await_journal(sequence);
     return order_id;
 }
 
 bool MatchingEngine::cancel_order(uint64_t order_id, const std::string& client_id) {
-    std::lock_guard<std::mutex> lock(engine_mutex);
+    // A client the directory has never seen cannot own any order
+    ClientId client;
+    if (!client_directory().find(client_id, client)) {
+        return false;
+    }
     
-    auto& orders = client_orders[client_id];
-    auto it = std::find(orders.begin(), orders.end(), order_id);
-    if (it == orders.end()) {
+    // Cancels count towards the message rate but are never refused, so a
+    // throttled client can still pull its orders
+    ClientRisk& client_risk = risk.at(client);
+    if (const RiskLimits* limits = risk.limits_for(client_risk)) {
+        ClientRiskTable::admit_message(client_risk, *limits, steady_ns());
+    }
+    
+    OrderLocation location;
+    if (!find_location(order_id, location) || location.client != client) {
         return false;
     }
     
-    auto vwap_it = vwap_orders.find(order_id);
-    if (vwap_it != vwap_orders.end()) {
-        auto vwap_order = vwap_it->second;
-        for (uint64_t child_id : vwap_order->child_order_ids) {
-            for (auto& [symbol, book] : order_books) {
-                book->cancel_order(child_id);
+    uint64_t sequence = 0;
+    bool journal_failed = false;
+    bool cancelled = run_on_shard(location.symbol, [&]() {
+        if (journal) {
+            JournalCommand command(JournalRecordType::CANCEL);
+            command.order_id = order_id;
+            command.symbol = symbol_directory().name(location.symbol);
+            command.client_id = client_id;
+            if (!journal_command(command)) {
+                journal_failed = true;
+                return false;
             }
+            sequence = command.sequence;
+        }
+        return cancel_on_shard(location.symbol, order_id);
+    });
+    
+    if (journal_failed) return false;
+    
+    forget_location(order_id);
+    await_journal(sequence);
+    return cancelled;
+}
+
+bool MatchingEngine::cancel_on_shard(SymbolId symbol, uint64_t order_id) {
+    // Runs on the symbol's shard
+    MatchingShard& shard = shard_for(symbol);
+    auto book = get_or_create_order_book(symbol);
+    
+    auto vwap_it = shard.vwap_orders.find(order_id);
+    if (vwap_it != shard.vwap_orders.end()) {
+        auto vwap_order = vwap_it->second;
+        for (uint64_t child_id : vwap_order->vwap->child_order_ids) {
+            book->cancel_order(child_id);
         }
         
         vwap_order->status = OrderStatus::CANCELLED;
-        vwap_orders.erase(vwap_it);
+        retire_vwap_order(shard, order_id);
         
-        std::cout << "VWAP order " << order_id << " cancelled with " 
-                  << vwap_order->child_order_ids.size() << " child orders" << std::endl;
-    } else {
-        for (auto& [symbol, book] : order_books) {
-            book->cancel_order(order_id);
+        logger().log(LogLevel::INFO, LogEvent::VWAP_CANCELLED, order_id, vwap_order->vwap->child_order_ids.size());
+        return true;
+    }
+    
+    // The book reports whether the order was still live
+    return book->cancel_order(order_id);
+}
+
+bool MatchingEngine::amend_order(uint64_t order_id, double price, double quantity, const std::string& client_id) {
+    ClientId client;
+    if (quantity <= 0 || !client_directory().find(client_id, client)) {
+        return false;
+    }
+    
+    OrderLocation location;
+    if (!find_location(order_id, location) || location.client != client) {
+        return false;
+    }
+    SymbolSlot& slot = book_slot(location.symbol);
+    const auto& book = slot.book;
+    Price amended_price = book->get_config().to_price(price);
+    if (amended_price <= 0) return false;
+    
+    // The order already counts as open, so only the message, size and
+    // notional are checked here
+    if (!admit_order(client, risk.at(client), price, quantity, false)) return false;
+    
+    uint64_t sequence = 0;
+    bool amended = run_on_shard(location.symbol, [&]() {
+        const Order* order = book->find_order(order_id);
+        if (!order || order->type != OrderType::LIMIT || quantity <= order->filled_quantity) return false;
+        // Only an amend that adds to what can still fill can move the position further
+        double remaining = quantity - order->filled_quantity;
+        if (remaining > order->quantity - order->filled_quantity &&
+            !position_allows(slot, client, order->side, remaining)) {
+            return false;
         }
+        if (journal) {
+            JournalCommand command = order_command(JournalRecordType::AMEND, order_id, location.symbol, client,
+                                                   order->type, order->side, amended_price, quantity);
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
+        }
+        return amend_on_shard(location.symbol, order_id, amended_price, quantity);
+    });
+    if (!amended) return false;
+    
+    await_journal(sequence);
+    return true;
+}
+
+bool MatchingEngine::amend_on_shard(SymbolId symbol, uint64_t order_id, Price price, double quantity) {
+    // Runs on the symbol's shard
+    auto book = get_or_create_order_book(symbol);
+    std::vector<std::shared_ptr<Order>> matched_orders;
+    if (!book->amend_order(order_id, price, quantity, matched_orders)) {
+        return false;
     }
+    process_fills(symbol, book, matched_orders);
+    return true;
+}
+
+void MatchingEngine::set_risk_limits(const std::string& client_id, const RiskLimits& limits) {
+    risk.set_limits(client_directory().intern(client_id), limits);
+}
+
+void MatchingEngine::set_default_risk_limits(const RiskLimits& limits) {
+    risk.set_default_limits(limits);
+}
+
+int64_t MatchingEngine::get_open_order_count(const std::string& client_id) {
+    ClientId client;
+    if (!client_directory().find(client_id, client)) return 0;
+    return risk.at(client).open_orders.load(std::memory_order_relaxed);
+}
+
+double MatchingEngine::get_position(const std::string& symbol, const std::string& client_id) {
+    SymbolId symbol_id;
+    ClientId client;
+    if (!symbol_directory().find(symbol, symbol_id) || !client_directory().find(client_id, client)) return 0.0;
+    return run_on_shard(symbol_id, [&]() {
+        auto& positions = symbol_slot(symbol_id).positions;
+        auto it = positions.find(client);
+        return it != positions.end() ? it->second : 0.0;
+    });
+}
+
+bool MatchingEngine::admit_order(ClientId client, ClientRisk& client_risk, double price, double quantity, bool can_rest) {
+    if (can_rest) {
+        client_risk.in_flight.fetch_add(1, std::memory_order_acquire);
+    }
+    const RiskLimits* limits = risk.limits_for(client_risk);
+    if (!limits) return true;
+    
+    RiskCheck failed;
+    if (!ClientRiskTable::admit_message(client_risk, *limits, limits->max_messages_per_second ? steady_ns() : 0)) {
+        failed = RiskCheck::MESSAGE_RATE;
+    } else if (limits->max_order_quantity > 0 && quantity > limits->max_order_quantity) {
+        failed = RiskCheck::ORDER_QUANTITY;
+    } else if (limits->max_notional > 0 && (price <= 0 || price * quantity > limits->max_notional)) {
+        // Without a price to value it at, the order can't be shown to fit
+        failed = RiskCheck::NOTIONAL;
+    } else if (can_rest && limits->max_open_orders > 0 &&
+               client_risk.open_orders.load(std::memory_order_relaxed) +
+               client_risk.in_flight.load(std::memory_order_relaxed) > limits->max_open_orders) {
+        // in_flight includes this order
+        failed = RiskCheck::OPEN_ORDERS;
+    } else {
+        return true;
+    }
+    finish_in_flight(client_risk, can_rest);
+    reject_order(client, failed);
+    return false;
+}
+
+bool MatchingEngine::position_allows(SymbolSlot& slot, ClientId client, OrderSide side, double quantity) {
+    const RiskLimits* limits = risk.limits_for(risk.at(client));
+    if (!limits || limits->max_position <= 0) return true;
     
-    orders.erase(it);
+    auto& positions = slot.positions;
+    auto it = positions.find(client);
+    double position = it != positions.end() ? it->second : 0.0;
+    double projected = position + (side == OrderSide::BUY ? quantity : -quantity);
+    // The position if this order fills in full; one that reduces it always passes
+    if (std::abs(projected) <= limits->max_position || std::abs(projected) < std::abs(position)) return true;
+    reject_order(client, RiskCheck::POSITION);
+    return false;
+}
+
+void MatchingEngine::reject_order(ClientId client, RiskCheck check) {
+    logger().log(LogLevel::WARN, LogEvent::RISK_REJECTED, client, 0, 0.0, 0.0, 0.0, risk_check_name(check));
+}
+
+bool MatchingEngine::set_symbol_config(const std::string& symbol, const SymbolConfig& config) {
+    if (symbol.empty()) return false;
+    SymbolId symbol_id = symbol_directory().intern(symbol);
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(symbols_mutex);
+        if (symbol_id >= symbols.size()) {
+            symbols.resize(symbol_id + 1);
+        }
+        SymbolSlot& slot = symbols[symbol_id];
+        if (slot.book) {
+            return false;
+        }
+        if (journal) {
+            JournalCommand command(JournalRecordType::SYMBOL_CONFIG);
+            command.symbol = symbol;
+            command.config = config;
+            if (!journal_command(command)) return false;
+            sequence = command.sequence;
+        }
+        slot.config = config;
+    }
+    await_journal(sequence);
     return true;
 }
 
 std::shared_ptr<OrderBook> MatchingEngine::get_order_book(const std::string& symbol) {
-    std::lock_guard<std::mutex> lock(engine_mutex);
-    auto it = order_books.find(symbol);
-    return (it != order_books.end()) ? it->second : nullptr;
+    SymbolId symbol_id;
+    SymbolSlot* slot = existing_book_slot(symbol, symbol_id);
+    return slot ? slot->book : nullptr;
+}
+
+DepthSnapshot MatchingEngine::get_depth(const std::string& symbol, size_t levels) {
+    SymbolId symbol_id;
+    SymbolSlot* slot = existing_book_slot(symbol, symbol_id);
+    if (!slot) return DepthSnapshot();
+    const auto& book = slot->book;
+    return run_on_shard(symbol_id, [&]() { return book->get_depth(levels); });
+}
+
+bool MatchingEngine::get_level_updates(const std::string& symbol, uint64_t since, std::vector<LevelUpdate>& out) {
+    SymbolId symbol_id;
+    SymbolSlot* slot = existing_book_slot(symbol, symbol_id);
+    if (!slot) return true;
+    const auto& book = slot->book;
+    return run_on_shard(symbol_id, [&]() { return book->get_level_updates(since, out); });
+}
+
+void MatchingEngine::capture_book(const std::string& symbol, BookImage& image) {
+    SymbolId symbol_id;
+    SymbolSlot* slot = existing_book_slot(symbol, symbol_id);
+    if (!slot) return;
+    const auto& book = slot->book;
+    run_on_shard(symbol_id, [&]() { book->capture(image); });
+}
+
+SymbolSlot* MatchingEngine::existing_book_slot(const std::string& symbol, SymbolId& symbol_id) const {
+    // Reads never intern a name or make a book, so they can't grow the
+    // tables or fix a symbol's config before set_symbol_config
+    if (!symbol_directory().find(symbol, symbol_id)) return nullptr;
+    return published_slot(symbol_id);
+}
+
+void MatchingEngine::post_to_shard(SymbolId symbol, std::function<void()> task) {
+    if (stopping) return;
+    shard_for(symbol).executor.post(std::move(task));
+}
+
+TimerId MatchingEngine::schedule_on_shard(SymbolId symbol, std::chrono::steady_clock::duration delay,
+                                          std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    return timers.schedule_at(std::chrono::steady_clock::now() + delay,
+                              [this, symbol, task = std::move(task)]() { post_to_shard(symbol, task); });
+}
+
+bool MatchingEngine::cancel_timer(TimerId id) {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    return timers.cancel(id);
+}
+
+void MatchingEngine::run_timers() {
+    std::vector<TimerWheel::Callback> due;
+    std::unique_lock<std::mutex> lock(timer_mutex);
+    while (!stopping) {
+        timer_wakeup.wait_for(lock, timers.tick_length());
+        timers.advance(std::chrono::steady_clock::now(), due);
+        
+        // Callbacks only post to shards, but run them unlocked so they may
+        // schedule again
+        lock.unlock();
+        for (auto& callback : due) {
+            callback();
+        }
+        due.clear();
+        lock.lock();
+    }
+}
+
+SymbolSlot& MatchingEngine::symbol_slot(SymbolId symbol) {
+    if (SymbolSlot* slot = published_slot(symbol)) {
+        return *slot;
+    }
+    std::lock_guard<std::mutex> lock(symbols_mutex);
+    if (symbol >= symbols.size()) {
+        symbols.resize(symbol + 1);
+    }
+    return symbols[symbol];
+}
+
+SymbolSlot* MatchingEngine::published_slot(SymbolId symbol) const {
+    size_t chunk = symbol >> SLOT_CHUNK_BITS;
+    if (chunk >= MAX_SLOT_CHUNKS) return nullptr;
+    auto* entries = book_slots[chunk].load(std::memory_order_acquire);
+    return entries ? entries[symbol & (SLOT_CHUNK_SIZE - 1)].load(std::memory_order_acquire) : nullptr;
+}
+
+SymbolSlot& MatchingEngine::book_slot(SymbolId symbol) {
+    if (SymbolSlot* slot = published_slot(symbol)) {
+        return *slot;
+    }
+    
+    std::lock_guard<std::mutex> lock(symbols_mutex);
+    if (symbol >= symbols.size()) {
+        symbols.resize(symbol + 1);
+    }
+    SymbolSlot& slot = symbols[symbol];
+    if (slot.book) {
+        return slot;
+    }
+    
+    slot.book = std::make_shared<OrderBook>(symbol_directory().name(symbol), slot.config);
+    slot.book->enable_trade_events();
+    slot.book->enable_closed_orders();
+    slot.book->track_open_orders(&risk);
+    
+    // Ids past the chunks keep taking the lock
+    size_t chunk = symbol >> SLOT_CHUNK_BITS;
+    if (chunk < MAX_SLOT_CHUNKS) {
+        auto* entries = book_slots[chunk].load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new std::atomic<SymbolSlot*>[SLOT_CHUNK_SIZE]();
+            book_slots[chunk].store(entries, std::memory_order_release);
+        }
+        entries[symbol & (SLOT_CHUNK_SIZE - 1)].store(&slot, std::memory_order_release);
+    }
+    return slot;
+}
+
+size_t MatchingEngine::tracked_order_count() {
+    size_t count = 0;
+    for (auto& stripe : location_stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        count += stripe.locations.size();
+    }
+    return count;
+}
+
+void MatchingEngine::remember_location(uint64_t order_id, const OrderLocation& location) {
+    LocationStripe& stripe = location_stripe(order_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    stripe.locations[order_id] = location;
+}
+
+bool MatchingEngine::find_location(uint64_t order_id, OrderLocation& location) {
+    LocationStripe& stripe = location_stripe(order_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.locations.find(order_id);
+    if (it == stripe.locations.end()) {
+        return false;
+    }
+    location = it->second;
+    return true;
+}
+
+void MatchingEngine::forget_location(uint64_t order_id) {
+    LocationStripe& stripe = location_stripe(order_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    stripe.locations.erase(order_id);
+}
+
+bool MatchingEngine::journal_command(JournalCommand& command) {
+    return !journal || journal->append(command) != 0;
+}
+
+void MatchingEngine::await_journal(uint64_t sequence) {
+    // A sync that fails leaves the journal unhealthy; later input is refused
+    if (journal && sequence != 0) {
+        journal->wait_durable(sequence);
+    }
 }
 
 std::shared_ptr<Order> MatchingEngine::get_vwap_order(uint64_t order_id) {
-    std::lock_guard<std::mutex> lock(engine_mutex);
-    auto it = vwap_orders.find(order_id);
-    return (it != vwap_orders.end()) ? it->second : nullptr;
+    OrderLocation location;
+    if (!find_location(order_id, location)) {
+        return nullptr;
+    }
+    return run_on_shard(location.symbol, [&]() -> std::shared_ptr<Order> {
+        MatchingShard& shard = shard_for(location.symbol);
+        auto it = shard.vwap_orders.find(order_id);
+        return (it != shard.vwap_orders.end()) ? it->second : nullptr;
+    });
 }
 
 std::vector<std::shared_ptr<Order>> MatchingEngine::get_active_vwap_orders() {
-    std::lock_guard<std::mutex> lock(engine_mutex);
     std::vector<std::shared_ptr<Order>> active_orders;
-    for (const auto& [id, order] : vwap_orders) {
-        active_orders.push_back(order);
+    for (auto& shard : shards) {
+        MatchingShard* owner = shard.get();
+        auto orders = owner->executor.call([owner]() {
+            std::vector<std::shared_ptr<Order>> orders;
+            for (const auto& [id, order] : owner->vwap_orders) {
+                orders.push_back(order);
+            }
+            return orders;
+        });
+        active_orders.insert(active_orders.end(), orders.begin(), orders.end());
     }
     return active_orders;
 }
 
-void MatchingEngine::process_matching(const std::string& symbol) {
-    std::lock_guard<std::mutex> lock(engine_mutex);
+void MatchingEngine::capture_symbol(SymbolId symbol, SymbolImage& image) {
+    // Runs on the symbol's shard: every journal record for this symbol up to
+    // the sequence read here has been applied, and no later one has
+    std::shared_ptr<OrderBook> book;
+    {
+        std::lock_guard<std::mutex> lock(symbols_mutex);
+        SymbolSlot& slot = symbols[symbol];
+        book = slot.book;
+        image.config = slot.config;
+        image.journal_sequence = captured_sequence();
+        for (const auto& [client, quantity] : slot.positions) {
+            if (quantity != 0) {
+                image.positions.push_back(PositionImage{client, quantity});
+            }
+        }
+    }
+    image.has_book = book != nullptr;
+    if (book) {
+        book->capture(image.book);
+    }
     
-    auto book = order_books[symbol];
-    if (!book) return;
-        
-    auto matched_orders = book->match_orders();
+    MatchingShard& shard = shard_for(symbol);
+    for (const auto& [order_id, order] : shard.vwap_orders) {
+        if (order->symbol != symbol) continue;
+        const VWAPOrderState& state = *order->vwap;
+        VWAPImage vwap;
+        vwap.id = order_id;
+        vwap.client = order->client;
+        vwap.side = order->side;
+        vwap.status = order->status;
+        vwap.target_vwap = state.target_vwap;
+        vwap.quantity = order->quantity;
+        vwap.filled_quantity = order->filled_quantity;
+        vwap.start_time = journal_time(state.execution_start_time);
+        vwap.end_time = journal_time(state.execution_end_time);
+        vwap.last_child_price = state.last_child_order_price;
+        vwap.last_child_time = journal_time(state.last_child_order_time);
+        vwap.child_ids = state.child_order_ids;
+        for (uint64_t child_id : state.child_order_ids) {
+            auto child_it = shard.vwap_children.find(child_id);
+            if (child_it != shard.vwap_children.end()) {
+                vwap.live_children.push_back(VWAPChildImage{child_id, child_it->second.quantity,
+                                                            child_it->second.filled_quantity});
+            }
+        }
+        image.vwap_orders.push_back(std::move(vwap));
+    }
+}
+
+void MatchingEngine::restore_symbol(SymbolId symbol, SymbolImage& image, const std::vector<ClientId>& clients) {
+    // Runs on the symbol's shard; the configuration has to be in place
+    // before the book is created
+    {
+        std::lock_guard<std::mutex> lock(symbols_mutex);
+        if (symbol >= symbols.size()) {
+            symbols.resize(symbol + 1);
+        }
+        if (!symbols[symbol].book) {
+            symbols[symbol].config = image.config;
+        }
+    }
+    if (!image.has_book) return;
+    
+    auto remap = [&](ClientId client) { return client < clients.size() ? clients[client] : client; };
+    for (auto& order : image.book.orders) {
+        order.client = remap(order.client);
+    }
+    auto book = get_or_create_order_book(symbol);
+    if (!book->restore(image.book)) return;
+    
+    MatchingShard& shard = shard_for(symbol);
+    SymbolSlot& slot = symbol_slot(symbol);
+    for (const auto& position : image.positions) {
+        slot.positions[remap(position.client)] = position.quantity;
+    }
+    for (const auto& vwap : image.vwap_orders) {
+        auto start_time = steady_time(vwap.start_time);
+        auto end_time = steady_time(vwap.end_time);
+        auto order = std::make_shared<Order>(vwap.id, symbol, OrderType::VWAP, vwap.side, vwap.target_vwap,
+                                             vwap.quantity, start_time, end_time, remap(vwap.client), VWAPOrderTag{});
+        order->filled_quantity = vwap.filled_quantity;
+        order->status = vwap.status;
+        order->vwap->child_order_ids = vwap.child_ids;
+        order->vwap->last_child_order_price = vwap.last_child_price;
+        order->vwap->last_child_order_time = steady_time(vwap.last_child_time);
+        for (const auto& child : vwap.live_children) {
+            shard.vwap_children[child.id] = VWAPChild{vwap.id, child.quantity, child.filled_quantity};
+        }
+        shard.vwap_orders[vwap.id] = std::move(order);
+        if (!slot.vwap_calculator) {
+            slot.vwap_calculator = std::make_shared<VWAPCalculator>(start_time, end_time);
+        }
+    }
+    
+    // Clients can cancel what they own; VWAP children belong to their parent
+    for (const auto& vwap : image.vwap_orders) {
+        remember_location(vwap.id, OrderLocation{symbol, remap(vwap.client)});
+    }
+    for (const auto& order : image.book.orders) {
+        if (shard.vwap_children.count(order.id) == 0) {
+            remember_location(order.id, OrderLocation{symbol, order.client});
+        }
+    }
+}
+
+void MatchingEngine::apply_command(SymbolId symbol, const JournalCommand& command) {
+    // Runs on the symbol's shard during recovery; nothing is journalled again
+    ClientId client = client_directory().intern(command.client_id);
+    auto locate = [&]() { remember_location(command.order_id, OrderLocation{symbol, client}); };
     
+    switch (command.type) {
+    case JournalRecordType::ORDER: {
+        auto book = get_or_create_order_book(symbol);
+        if (command.order_type != OrderType::MARKET && !is_immediate(command.time_in_force)) {
+            locate();
+        }
+        auto order = book->create_order(command.order_id, symbol, command.order_type, command.side,
+                                        command.price, command.quantity, client);
+        order->time_in_force = command.time_in_force;
+        enter_order(symbol, book, std::move(order));
+        break;
+    }
+    case JournalRecordType::STOP_LIMIT_ORDER: {
+        auto book = get_or_create_order_book(symbol);
+        locate();
+        process_fills(symbol, book, book->add_order(book->create_order(command.order_id, symbol, OrderType::STOP_LIMIT,
+                                                                       command.side, command.price, command.limit_price,
+                                                                       command.quantity, client, StopLimitOrderTag{})));
+        break;
+    }
+    case JournalRecordType::TRAILING_STOP_ORDER: {
+        auto book = get_or_create_order_book(symbol);
+        locate();
+        process_fills(symbol, book, book->add_order(book->create_order(command.order_id, symbol, OrderType::TRAILING_STOP,
+                                                                       command.side, command.price, command.quantity,
+                                                                       client, TrailingStopOrderTag{})));
+        break;
+    }
+    case JournalRecordType::VWAP_ORDER: {
+        get_or_create_order_book(symbol);
+        locate();
+        auto start_time = steady_time(command.start_time);
+        auto end_time = steady_time(command.end_time);
+        SymbolSlot& slot = symbol_slot(symbol);
+        if (!slot.vwap_calculator) {
+            slot.vwap_calculator = std::make_shared<VWAPCalculator>(start_time, end_time);
+        }
+        shard_for(symbol).vwap_orders[command.order_id] =
+            std::make_shared<Order>(command.order_id, symbol, OrderType::VWAP, command.side, command.price,
+                                    command.quantity, start_time, end_time, client, VWAPOrderTag{});
+        break;
+    }
+    case JournalRecordType::VWAP_SLICE: {
+        auto book = get_or_create_order_book(symbol);
+        MatchingShard& shard = shard_for(symbol);
+        auto parent_it = shard.vwap_orders.find(command.parent_id);
+        if (parent_it != shard.vwap_orders.end()) {
+            place_vwap_slice(symbol, book, parent_it->second, command.order_id, command.price, command.quantity);
+        } else {
+            // The book still has to hold the child it had
+            enter_order(symbol, book, book->create_order(command.order_id, symbol, OrderType::LIMIT, command.side,
+                                                         command.price, command.quantity, client));
+        }
+        break;
+    }
+    case JournalRecordType::CANCEL:
+        cancel_on_shard(symbol, command.order_id);
+        forget_location(command.order_id);
+        break;
+    case JournalRecordType::AMEND:
+        amend_on_shard(symbol, command.order_id, command.price, command.quantity);
+        break;
+    case JournalRecordType::SYMBOL_CONFIG: {
+        std::lock_guard<std::mutex> lock(symbols_mutex);
+        if (symbol >= symbols.size()) {
+            symbols.resize(symbol + 1);
+        }
+        if (!symbols[symbol].book) {
+            symbols[symbol].config = command.config;
+        }
+        break;
+    }
+    }
+}
+
+void MatchingEngine::enter_order(SymbolId symbol, const std::shared_ptr<OrderBook>& book, std::shared_ptr<Order> order) {
+    // Runs on the symbol's shard
+    if (order->type == OrderType::MARKET) {
+        if (order->side == OrderSide::BUY) {
+            execute_market_buy_order(book, order);
+        } else {
+            execute_market_sell_order(book, order);
+        }
+    } else {
+        process_fills(symbol, book, book->add_order(order));
+    }
+}
+
+void MatchingEngine::process_fills(SymbolId symbol, const std::shared_ptr<OrderBook>& book,
+                                   const std::vector<std::shared_ptr<Order>>& matched_orders) {
+    // Runs on the symbol's shard, right after the order that traded
     if (!matched_orders.empty()) {
         book->check_stop_loss_orders();
-        
-        update_vwap_order_progress(matched_orders);
     }
+    // Also credits VWAP parents with their children's fills
+    consume_trades(symbol);
     
     for (const auto& order : matched_orders) {
-        std::cout << "Order " << order->id << " status: " 
-                  << (order->status == OrderStatus::FILLED ? "FILLED" : "PARTIAL") << std::endl;
+        logger().log(LogLevel::DEBUG, LogEvent::ORDER_STATUS, order->id, order->status == OrderStatus::FILLED);
     }
 }
 
 bool MatchingEngine::validate_order(const std::string& symbol, OrderType type, OrderSide side,
-                                   double price, double quantity, const std::string& client_id) {
+                                   double price, double quantity, const std::string& client_id,
+                                   TimeInForce time_in_force) {
     (void)side;
     if (symbol.empty() || client_id.empty()) return false;
     if (quantity <= 0) return false;
     if (type == OrderType::LIMIT && price <= 0) return false;
+    // Stops wait to be triggered, which an immediate order can't
+    if (is_immediate(time_in_force) && type != OrderType::LIMIT && type != OrderType::MARKET) return false;
     
     return true;
 }
@@ -259,15 +1313,18 @@ void MatchingEngine::execute_market_buy_order(std::shared_ptr<OrderBook> book, s
     
     if (executed_quantity == buy_order->quantity) {
         buy_order->status = OrderStatus::FILLED;
-        std::cout << "Market BUY order " << buy_order->id << " fully filled: " << executed_quantity << " shares" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::MARKET_FILLED, buy_order->id, static_cast<uint64_t>(OrderSide::BUY), executed_quantity);
+    } else if (is_immediate(buy_order->time_in_force)) {
+        // The book has expired the rest, as it does for immediate limit orders
     } else if (executed_quantity > 0) {
         buy_order->status = OrderStatus::PARTIAL_FILLED;
-        std::cout << "Market BUY order " << buy_order->id << " partially filled: " << executed_quantity << "/" << buy_order->quantity << " shares" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::MARKET_PARTIAL, buy_order->id, static_cast<uint64_t>(OrderSide::BUY), executed_quantity, buy_order->quantity);
     } else {
         buy_order->status = OrderStatus::REJECTED;
-        std::cout << "Market BUY order " << buy_order->id << " rejected: no liquidity" << std::endl;
+        logger().log(LogLevel::WARN, LogEvent::MARKET_REJECTED, buy_order->id, static_cast<uint64_t>(OrderSide::BUY));
     }
     book->check_stop_loss_orders();
+    consume_trades(book->get_symbol_id());
 }
 
 void MatchingEngine::execute_market_sell_order(std::shared_ptr<OrderBook> book, std::shared_ptr<Order> sell_order) {
@@ -275,105 +1332,171 @@ void MatchingEngine::execute_market_sell_order(std::shared_ptr<OrderBook> book,
     
     if (executed_quantity == sell_order->quantity) {
         sell_order->status = OrderStatus::FILLED;
-        std::cout << "Market SELL order " << sell_order->id << " fully filled: " << executed_quantity << " shares" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::MARKET_FILLED, sell_order->id, static_cast<uint64_t>(OrderSide::SELL), executed_quantity);
+    } else if (is_immediate(sell_order->time_in_force)) {
+        // The book has expired the rest, as it does for immediate limit orders
     } else if (executed_quantity > 0) {
         sell_order->status = OrderStatus::PARTIAL_FILLED;
-        std::cout << "Market SELL order " << sell_order->id << " partially filled: " << executed_quantity << "/" << sell_order->quantity << " shares" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::MARKET_PARTIAL, sell_order->id, static_cast<uint64_t>(OrderSide::SELL), executed_quantity, sell_order->quantity);
     } else {
         sell_order->status = OrderStatus::REJECTED;
-        std::cout << "Market SELL order " << sell_order->id << " rejected: no liquidity" << std::endl;
+        logger().log(LogLevel::WARN, LogEvent::MARKET_REJECTED, sell_order->id, static_cast<uint64_t>(OrderSide::SELL));
     }
     book->check_stop_loss_orders();
+    consume_trades(book->get_symbol_id());
 }
 
-void MatchingEngine::process_vwap_order(const std::string& symbol, uint64_t order_id) {
-    std::lock_guard<std::mutex> lock(engine_mutex);
-    
+void MatchingEngine::process_vwap_order(SymbolId symbol, uint64_t order_id) {
+    // Runs on the symbol's shard
+    MatchingShard& shard = shard_for(symbol);
+    auto& vwap_orders = shard.vwap_orders;
     auto vwap_order_it = vwap_orders.find(order_id);
     if (vwap_order_it == vwap_orders.end()) {
         return;
     }
     
     auto vwap_order = vwap_order_it->second;
-    auto calculator_it = vwap_calculators.find(symbol);
-    if (calculator_it == vwap_calculators.end()) {
+    auto calculator = symbol_slot(symbol).vwap_calculator;
+    if (!calculator) {
         return;
     }
     
-    auto calculator = calculator_it->second;
-    auto book = order_books[symbol];
-    if (!book) {
-        return;
-    }
+    auto book = get_or_create_order_book(symbol);
     
     double remaining_quantity = vwap_order->quantity - vwap_order->filled_quantity;
     if (remaining_quantity <= 0) {
         vwap_order->status = OrderStatus::FILLED;
-        vwap_orders.erase(vwap_order_it);
+        retire_vwap_order(shard, order_id);
         return;
     }
     
-    auto params = calculator->calculate_child_order_params(vwap_order, remaining_quantity, vwap_order->target_vwap);
+    auto params = calculator->calculate_child_order_params(vwap_order, remaining_quantity,
+                                                           price_to_double(vwap_order->vwap->target_vwap));
+    Price child_price = book->get_config().to_price(params.limit_price);
     
-    if (params.should_place && params.quantity > 0) {
+    if (params.should_place && params.quantity > 0 && child_price > 0) {
         uint64_t child_order_id = next_order_id++;
-        auto child_order = std::make_shared<Order>(child_order_id, symbol, OrderType::LIMIT, 
-                                                  vwap_order->side, params.limit_price, 
-                                                  params.quantity, vwap_order->client_id);
-        
-        book->add_order(child_order);
-        
-        vwap_order->child_order_ids.push_back(child_order_id);
-        vwap_order->last_child_order_price = params.limit_price;
-        vwap_order->last_child_order_time = std::chrono::steady_clock::now();
-        
-        thread_pool.enqueue([this, symbol]() {
-            process_matching(symbol);
-        });
+        bool journaled = true;
+        if (journal) {
+            // Slices depend on timing, so a replay places the recorded ones
+            JournalCommand command = order_command(JournalRecordType::VWAP_SLICE, child_order_id, symbol,
+                                                   vwap_order->client, OrderType::LIMIT, vwap_order->side,
+                                                   child_price, params.quantity);
+            command.parent_id = order_id;
+            journaled = journal_command(command);
+        }
+        if (journaled) {
+            place_vwap_slice(symbol, book, vwap_order, child_order_id, child_price, params.quantity);
+            // The child may have completed the parent on entry
+            if (vwap_orders.find(order_id) == vwap_orders.end()) {
+                return;
+            }
+        } else {
+            // A slice that can't be recorded isn't placed; the parent stays
+            // live and tries again on the next tick, as when no slice is due
+            logger().log(LogLevel::WARN, LogEvent::VWAP_SLICE_SKIPPED, order_id, child_order_id);
+        }
     }
     
-    thread_pool.enqueue([this, symbol, order_id]() {
-        std::this_thread::sleep_for(std::chrono::seconds(30));
+    vwap_order->vwap->slice_timer = schedule_on_shard(symbol, std::chrono::seconds(30), [this, symbol, order_id]() {
         process_vwap_order(symbol, order_id);
     });
 }
 
-void MatchingEngine::feed_trade_to_vwap_calculator(const std::string& symbol, double price, double volume) {
-    auto calculator_it = vwap_calculators.find(symbol);
-    if (calculator_it != vwap_calculators.end()) {
-        calculator_it->second->add_trade(price, volume);
-    }
-}
-
-void MatchingEngine::update_vwap_order_progress(const std::vector<std::shared_ptr<Order>>& matched_orders) {
-    for (const auto& matched_order : matched_orders) {
-        for (auto& [vwap_order_id, vwap_order] : vwap_orders) {
-            auto child_it = std::find(vwap_order->child_order_ids.begin(), 
-                                     vwap_order->child_order_ids.end(), 
-                                     matched_order->id);
-            
-            if (child_it != vwap_order->child_order_ids.end()) {
-                double previous_filled = vwap_order->filled_quantity;
-                double child_filled = matched_order->filled_quantity;
-                
-                double child_contribution = std::min(child_filled, matched_order->quantity);
-                
-                vwap_order->filled_quantity = previous_filled + child_contribution;
-                
-                std::cout << "VWAP order " << vwap_order_id << " progress: " 
-                          << vwap_order->filled_quantity << "/" << vwap_order->quantity 
-                          << " (child order " << matched_order->id << " contributed " 
-                          << child_contribution << ")" << std::endl;
-                
-                if (vwap_order->filled_quantity >= vwap_order->quantity) {
-                    vwap_order->status = OrderStatus::FILLED;
-                    std::cout << "VWAP order " << vwap_order_id << " completed!" << std::endl;
-                    
-                    vwap_orders.erase(vwap_order_id);
-                }
-                
-                break;
-            }
+void MatchingEngine::place_vwap_slice(SymbolId symbol, const std::shared_ptr<OrderBook>& book,
+                                      const std::shared_ptr<Order>& vwap_order, uint64_t child_order_id,
+                                      Price child_price, double quantity) {
+    // Runs on the symbol's shard
+    auto child_order = book->create_order(child_order_id, symbol, OrderType::LIMIT, 
+                                          vwap_order->side, child_price, 
+                                          quantity, vwap_order->client);
+    
+    vwap_order->vwap->child_order_ids.push_back(child_order_id);
+    shard_for(symbol).vwap_children[child_order_id] = VWAPChild{vwap_order->id, quantity, 0.0};
+    vwap_order->vwap->last_child_order_price = child_price;
+    vwap_order->vwap->last_child_order_time = std::chrono::steady_clock::now();
+    
+    process_fills(symbol, book, book->add_order(child_order));
+}
+
+void MatchingEngine::consume_trades(SymbolId symbol) {
+    // Runs on the symbol's shard thread once the book call that produced the
+    // trades has returned; the shard is the book's only writer, so no lock
+    SymbolSlot& slot = book_slot(symbol);
+    MatchingShard& shard = shard_for(symbol);
+    const auto& book = slot.book;
+    
+    // Filled and dropped orders can no longer be cancelled
+    auto& closed_batch = shard.closed_batch;
+    closed_batch.clear();
+    book->drain_closed_orders(closed_batch);
+    for (uint64_t order_id : closed_batch) {
+        forget_location(order_id);
+    }
+    
+    auto& trade_batch = shard.trade_batch;
+    trade_batch.clear();
+    if (book->drain_trade_events(trade_batch) == 0) return;
+    
+    for (const auto& trade : trade_batch) {
+        slot.positions[trade.buyer] += trade.quantity;
+        slot.positions[trade.seller] -= trade.quantity;
+    }
+    
+    if (slot.vwap_calculator) {
+        for (const auto& trade : trade_batch) {
+            slot.vwap_calculator->add_trade(price_to_double(trade.price), trade.quantity);
+        }
+    }
+    
+    if (!shard.vwap_children.empty()) {
+        for (const auto& trade : trade_batch) {
+            attribute_vwap_fill(shard, trade.buy_order_id, trade.quantity);
+            attribute_vwap_fill(shard, trade.sell_order_id, trade.quantity);
         }
     }
 }
+
+void MatchingEngine::attribute_vwap_fill(MatchingShard& shard, uint64_t child_id, double quantity) {
+    auto child_it = shard.vwap_children.find(child_id);
+    if (child_it == shard.vwap_children.end()) return;
+    
+    VWAPChild& child = child_it->second;
+    auto parent_it = shard.vwap_orders.find(child.parent_id);
+    if (parent_it == shard.vwap_orders.end()) {
+        shard.vwap_children.erase(child_it);
+        return;
+    }
+    
+    // Trades carry the quantity of this fill alone, so it is added as is
+    auto vwap_order = parent_it->second;
+    uint64_t vwap_order_id = parent_it->first;
+    vwap_order->filled_quantity += quantity;
+    child.filled_quantity += quantity;
+    
+    logger().log(LogLevel::INFO, LogEvent::VWAP_PROGRESS, vwap_order_id, child_id,
+                 vwap_order->filled_quantity, vwap_order->quantity, quantity);
+    
+    if (child.filled_quantity >= child.quantity) {
+        shard.vwap_children.erase(child_it);
+    }
+    
+    if (vwap_order->filled_quantity >= vwap_order->quantity) {
+        vwap_order->status = OrderStatus::FILLED;
+        logger().log(LogLevel::INFO, LogEvent::VWAP_COMPLETED, vwap_order_id);
+        retire_vwap_order(shard, vwap_order_id);
+    }
+}
+
+void MatchingEngine::retire_vwap_order(MatchingShard& shard, uint64_t order_id) {
+    auto it = shard.vwap_orders.find(order_id);
+    if (it == shard.vwap_orders.end()) return;
+    
+    // Children left resting no longer count towards the parent
+    for (uint64_t child_id : it->second->vwap->child_order_ids) {
+        shard.vwap_children.erase(child_id);
+    }
+    cancel_timer(it->second->vwap->slice_timer);
+    shard.vwap_orders.erase(it);
+    forget_location(order_id);
+}
@@ -1,28 +1,191 @@
 #pragma once
 #include "../common/Order.h"
 #include "../common/OrderBook.h"
-#include "../common/ThreadPool.h"
+#include "../common/ShardExecutor.h"
 #include "../common/VWAPCalculator.h"
+#include "../common/TimerWheel.h"
+#include "../common/Journal.h"
+#include "../common/Snapshot.h"
+#include "../common/Replication.h"
+#include "../common/Risk.h"
+#include <deque>
+#include <functional>
 #include <unordered_map>
+#include <vector>
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Engine-wide locator for a live order: which symbol (and so which shard)
+// holds it. The book's own id index resolves the rest in O(1).
+struct OrderLocation {
+    SymbolId symbol;
+    ClientId client;
+};
+
+using LocationMap = std::unordered_map<uint64_t, OrderLocation, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                       PoolAllocator<std::pair<const uint64_t, OrderLocation>>>;
+
+// Order locations split by order id, so a gateway recording one order and
+// a shard dropping another rarely meet on the same lock. Nodes come from
+// the stripe's slab pool.
+struct alignas(64) LocationStripe {
+    std::mutex mutex;
+    SlabPool node_pool;
+    LocationMap locations;
+
+    LocationStripe()
+        : locations(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+                    node_pool.allocator<LocationMap::value_type>()) {}
+};
+
+// Everything the engine keeps per symbol, indexed by SymbolId
+struct SymbolSlot {
+    std::shared_ptr<OrderBook> book;
+    // Only touched by the owning shard's thread
+    std::shared_ptr<VWAPCalculator> vwap_calculator;
+    // Net filled quantity by client, buys positive; owning shard only
+    std::unordered_map<ClientId, double> positions;
+    SymbolConfig config;
+};
+
+// One order of a submit_batch call; the fields submit_order takes
+struct OrderRequest {
+    std::string symbol;
+    OrderType type;
+    OrderSide side;
+    double price;
+    double quantity;
+    std::string client_id;
+    TimeInForce time_in_force = TimeInForce::DAY;
+};
+
+// A live VWAP child order: its parent and how much of it has traded
+struct VWAPChild {
+    uint64_t parent_id;
+    double quantity;
+    double filled_quantity;
+};
+
+// A matcher thread and the state only it touches. Symbols are assigned to
+// shards by id; gateway threads hand work to the owning shard through its
+// queue, so matching on one symbol never blocks entry on another shard.
+struct MatchingShard {
+    ShardExecutor executor;
+    std::unordered_map<uint64_t, std::shared_ptr<Order>> vwap_orders;
+    // Live VWAP children by child id, so each fill finds its parent in O(1)
+    std::unordered_map<uint64_t, VWAPChild> vwap_children;
+    // Reused between drains of the books' trade rings and closed orders
+    std::vector<TradeEvent> trade_batch;
+    std::vector<uint64_t> closed_batch;
+};
 
 class MatchingEngine {
 private:
-    std::unordered_map<std::string, std::shared_ptr<OrderBook>> order_books;
-    std::unordered_map<std::string, std::vector<uint64_t>> client_orders;
-    std::unordered_map<std::string, std::shared_ptr<VWAPCalculator>> vwap_calculators;
-    std::unordered_map<uint64_t, std::shared_ptr<Order>> vwap_orders;
+    static constexpr size_t SLOT_CHUNK_BITS = 10;
+    static constexpr size_t SLOT_CHUNK_SIZE = size_t(1) << SLOT_CHUNK_BITS;
+    static constexpr size_t MAX_SLOT_CHUNKS = size_t(1) << 16;
+    static constexpr size_t LOCATION_STRIPES = 64;
+    
+    // Slots are created, and listed, under symbols_mutex; a deque keeps
+    // references stable as new symbols arrive
+    std::deque<SymbolSlot> symbols;
+    std::mutex symbols_mutex;
+    // Slots that have their book, by SymbolId, so order flow finds them
+    // without symbols_mutex. Each is set once, right after the book is made;
+    // chunks are laid out as in NameDirectory and never move.
+    std::unique_ptr<std::atomic<std::atomic<SymbolSlot*>*>[]> book_slots;
+    LocationStripe location_stripes[LOCATION_STRIPES];
     std::atomic<uint64_t> next_order_id;
-    std::mutex engine_mutex;
-    ThreadPool thread_pool;
+    std::vector<std::unique_ptr<MatchingShard>> shards;
+    std::atomic<bool> stopping;
+    // Delayed work (VWAP re-slicing, expiries). One thread advances the wheel
+    // and posts what comes due to the owning shard; nothing waits on a worker.
+    TimerWheel timers;
+    std::mutex timer_mutex;
+    std::condition_variable timer_wakeup;
+    std::thread timer_thread;
+    // Write-ahead journal of accepted input; null unless enabled
+    std::unique_ptr<Journal> journal;
+    // Streams the journal to backups; null unless enabled
+    std::unique_ptr<ReplicationPublisher> publisher;
+    // Backup side: the last journal sequence applied by recovery or
+    // replication, and where the recovered snapshot left each symbol
+    std::atomic<uint64_t> applied_sequence;
+    std::unordered_map<SymbolId, uint64_t> covered_sequences;
+    std::atomic<bool> stop_following_requested;
+    // Standby kept current from the journal by write_snapshot_from_journal
+    std::mutex snapshot_mutex;
+    std::unique_ptr<MatchingEngine> snapshot_shadow;
+    // Pre-trade limits and per-client counters; books keep the open-order counts
+    ClientRiskTable risk;
     
 public:
-    MatchingEngine();
+    // One matcher thread per shard; defaults to one per hardware thread
+    explicit MatchingEngine(size_t shard_count = 0);
+    ~MatchingEngine();
+    
+    // Journals every accepted command before it is acknowledged. Call before
+    // the first order; false if the journal can't be opened.
+    bool enable_journal(const JournalConfig& config);
     
+    // Writes every book, VWAP parent and the order id counter to a snapshot
+    // file in `directory`. Each symbol is copied by a task on its own shard,
+    // so matching pauses for one book at a time and only while it is copied;
+    // encoding and writing the file happen on the calling thread.
+    bool write_snapshot(const std::string& directory, std::string* path = nullptr);
+    // The same snapshot without pausing this engine's shards at all: a
+    // private standby engine is captured instead. The first call loads it
+    // from the newest snapshot in `directory`; every call then applies the
+    // journal records since its last one, up to the last record durable
+    // when the call started, so each costs only the records in between.
+    // False without a journal.
+    bool write_snapshot_from_journal(const std::string& directory, std::string* path = nullptr);
+    
+    // Loads the newest readable snapshot in `snapshot_directory` and replays
+    // the journal records written after it; either directory may be empty.
+    // Call on a new engine, before enable_journal and any input. A
+    // `standby` engine is about to follow a primary and leaves VWAP orders
+    // idle until resume_vwap_orders().
+    bool recover(const std::string& snapshot_directory, const std::string& journal_directory, bool standby = false);
+    
+    // Applies journalled commands with the ids they were recorded with, as
+    // recovery does; nothing is journalled again. Each symbol's commands run
+    // in order on its shard, shards in parallel, and `applied` is called on
+    // the shard with each command's index once it has taken effect.
+    void replay(const std::vector<JournalCommand>& commands, const std::function<void(size_t)>& applied = nullptr);
+    
+    // Primary: serves the journal to backups connecting on `endpoint` (see
+    // Replication.h). Groups are handed over as the journal flushes them, so
+    // order entry only pays for a copy. Call after enable_journal and before
+    // any input; false without a journal or if `endpoint` can't be bound.
+    bool enable_replication(const std::string& endpoint);
+    
+    // Backup: applies the primary's journal stream as replay() does,
+    // continuing from whatever recover(..., true) restored. Blocks until the stream
+    // ends (the primary closed it, went silent for `silence`, or
+    // stop_following() was called); false if it could not be joined.
+    bool follow(const std::string& endpoint, std::chrono::milliseconds silence = std::chrono::milliseconds(1000));
+    void stop_following();
+    uint64_t replicated_sequence() const { return applied_sequence.load(); }
+    
+    // Restarts slicing of recovered or replicated VWAP orders; a backup
+    // calls it once it takes over
+    void resume_vwap_orders();
+    
+    // IOC and FOK apply to MARKET and LIMIT orders. They match in one pass
+    // on the symbol's shard and never rest, so the id they return can't be
+    // cancelled or amended; a FOK that can't fill in full doesn't trade.
     uint64_t submit_order(const std::string& symbol, OrderType type, OrderSide side,
-                         double price, double quantity, const std::string& client_id);
+                         double price, double quantity, const std::string& client_id,
+                         TimeInForce time_in_force = TimeInForce::DAY);
+    
+    // Submits many orders at once. Orders are grouped by symbol and each
+    // group is matched in request order by a single task on its shard.
+    // Results follow request order; 0 marks a rejected order, as in submit_order.
+    std::vector<uint64_t> submit_batch(const std::vector<OrderRequest>& requests);
     
     uint64_t submit_stop_limit_order(const std::string& symbol, OrderSide side,
                                     double stop_price, double limit_price, double quantity, 
@@ -40,15 +203,105 @@ public:
     
     bool cancel_order(uint64_t order_id, const std::string& client_id);
     
+    // Changes one of the client's resting limit orders to `price` and a
+    // total quantity of `quantity` (filled part included) in one task on its
+    // shard. Lowering the quantity at the same price keeps the order's place
+    // in its queue; a new price or more quantity requeues it behind its new
+    // level, trading first if the price now crosses. Checked against the
+    // client's limits like a new order. False if the order is not resting or
+    // `quantity` does not exceed what has filled.
+    bool amend_order(uint64_t order_id, double price, double quantity, const std::string& client_id);
+    
+    // Pre-trade limits for one client, or for every client without limits of
+    // their own. Orders are checked on the submitting thread against
+    // per-client atomics; only the position check runs on the shard, which
+    // owns the positions. Replayed and replicated input is not checked.
+    void set_risk_limits(const std::string& client_id, const RiskLimits& limits);
+    void set_default_risk_limits(const RiskLimits& limits);
+    // Resting orders and pending stops the client has across all symbols
+    int64_t get_open_order_count(const std::string& client_id);
+    // The client's net filled quantity in `symbol`, buys positive
+    double get_position(const std::string& symbol, const std::string& client_id);
+    
+    // Must be called before the symbol's book is created by its first order.
+    bool set_symbol_config(const std::string& symbol, const SymbolConfig& config);
+    
+    // Null for a symbol without a book; reads never create one
     std::shared_ptr<OrderBook> get_order_book(const std::string& symbol);
+    // Reads of the book's levels and orders; each runs on the symbol's shard,
+    // the only thread that touches them, and is empty without a book. Top of
+    // book is read from the book.
+    DepthSnapshot get_depth(const std::string& symbol, size_t levels);
+    // False if the caller fell too far behind; see OrderBook::get_level_updates
+    bool get_level_updates(const std::string& symbol, uint64_t since, std::vector<LevelUpdate>& out);
+    void capture_book(const std::string& symbol, BookImage& image);
     
     std::shared_ptr<Order> get_vwap_order(uint64_t order_id);
     std::vector<std::shared_ptr<Order>> get_active_vwap_orders();
     
+    size_t shard_count() const { return shards.size(); }
+    // Orders a cancel can still be routed to: resting limits, pending stops
+    // and live VWAP parents
+    size_t tracked_order_count();
+    
 private:
-    void process_matching(const std::string& symbol);
+    MatchingShard& shard_for(SymbolId symbol) { return *shards[symbol % shards.size()]; }
+    // Runs `task` on the symbol's shard and waits for its result
+    template <typename F>
+    auto run_on_shard(SymbolId symbol, F&& task) -> decltype(task()) {
+        return shard_for(symbol).executor.call(std::forward<F>(task));
+    }
+    void post_to_shard(SymbolId symbol, std::function<void()> task);
+    // Runs `task` on the symbol's shard once `delay` has passed
+    TimerId schedule_on_shard(SymbolId symbol, std::chrono::steady_clock::duration delay, std::function<void()> task);
+    bool cancel_timer(TimerId id);
+    void run_timers();
+    SymbolSlot& symbol_slot(SymbolId symbol);
+    // The symbol's slot with its book created; lock-free once it exists
+    SymbolSlot& book_slot(SymbolId symbol);
+    SymbolSlot* published_slot(SymbolId symbol) const;
+    // The slot of a symbol that already has its book; null otherwise
+    SymbolSlot* existing_book_slot(const std::string& symbol, SymbolId& symbol_id) const;
+    std::shared_ptr<OrderBook> get_or_create_order_book(SymbolId symbol) { return book_slot(symbol).book; }
+    // Gateway-side risk checks for one order. One that can rest is counted
+    // in flight until finish_in_flight(), so concurrent sessions of a client
+    // can't overshoot its open-order limit between the check and the book.
+    bool admit_order(ClientId client, ClientRisk& client_risk, double price, double quantity, bool can_rest);
+    void finish_in_flight(ClientRisk& client_risk, bool can_rest) {
+        if (can_rest) client_risk.in_flight.fetch_sub(1, std::memory_order_release);
+    }
+    // Runs on the slot's shard
+    bool position_allows(SymbolSlot& slot, ClientId client, OrderSide side, double quantity);
+    void reject_order(ClientId client, RiskCheck check);
+    LocationStripe& location_stripe(uint64_t order_id) { return location_stripes[order_id % LOCATION_STRIPES]; }
+    void remember_location(uint64_t order_id, const OrderLocation& location);
+    bool find_location(uint64_t order_id, OrderLocation& location);
+    void forget_location(uint64_t order_id);
+    // Appends `command` ahead of applying it; false once the journal has failed
+    bool journal_command(JournalCommand& command);
+    // Blocks until a journalled command is durable, so the ack can go out
+    void await_journal(uint64_t sequence);
+    void capture_symbol(SymbolId symbol, SymbolImage& image);
+    // The journal sequence a capture reflects: a backup's is what it has applied
+    uint64_t captured_sequence() { return journal ? journal->last_sequence() : applied_sequence.load(); }
+    // Floor for what the shards themselves log
+    void set_shard_log_level(LogLevel level);
+    // Applies the journal records in (after, through], skipping those a
+    // restored snapshot already covers, and advances applied_sequence
+    bool replay_journal(const std::string& journal_directory, uint64_t after, uint64_t through);
+    void restore_symbol(SymbolId symbol, SymbolImage& image, const std::vector<ClientId>& clients);
+    // Runs on the symbol's shard
+    void apply_command(SymbolId symbol, const JournalCommand& command);
+    bool cancel_on_shard(SymbolId symbol, uint64_t order_id);
+    bool amend_on_shard(SymbolId symbol, uint64_t order_id, Price price, double quantity);
+    void place_vwap_slice(SymbolId symbol, const std::shared_ptr<OrderBook>& book, const std::shared_ptr<Order>& vwap_order,
+                          uint64_t child_order_id, Price child_price, double quantity);
+    void enter_order(SymbolId symbol, const std::shared_ptr<OrderBook>& book, std::shared_ptr<Order> order);
+    void process_fills(SymbolId symbol, const std::shared_ptr<OrderBook>& book,
+                       const std::vector<std::shared_ptr<Order>>& matched_orders);
     bool validate_order(const std::string& symbol, OrderType type, OrderSide side,
-                       double price, double quantity, const std::string& client_id);
+                       double price, double quantity, const std::string& client_id,
+                       TimeInForce time_in_force);
     bool validate_stop_limit_order(const std::string& symbol, OrderSide side,
                                   double stop_price, double limit_price, double quantity, 
                                   const std::string& client_id);
@@ -62,7 +315,8 @@ private:
                             const std::string& client_id);
     void execute_market_buy_order(std::shared_ptr<OrderBook> book, std::shared_ptr<Order> buy_order);
     void execute_market_sell_order(std::shared_ptr<OrderBook> book, std::shared_ptr<Order> sell_order);
-    void process_vwap_order(const std::string& symbol, uint64_t order_id);
-    void feed_trade_to_vwap_calculator(const std::string& symbol, double price, double volume);
-    void update_vwap_order_progress(const std::vector<std::shared_ptr<Order>>& matched_orders);
+    void process_vwap_order(SymbolId symbol, uint64_t order_id);
+    void consume_trades(SymbolId symbol);
+    void attribute_vwap_fill(MatchingShard& shard, uint64_t child_id, double quantity);
+    void retire_vwap_order(MatchingShard& shard, uint64_t order_id);
 };
\ No newline at end of file
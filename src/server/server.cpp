@@ -7,6 +7,7 @@
 #include <sstream>
 #include <thread>
 #include <cstring>
+#include <cstdlib>
 #include <unordered_map>
 #include <mutex>
 #include <chrono>
@@ -16,11 +17,74 @@ private:
     MatchingEngine engine;
     int server_fd;
     static const int PORT = 8080;
+    static const size_t MAX_BATCH_ORDERS = 1000;
+    // Room for one batch entry (symbol type side price quantity time_in_force);
+    // the largest batch is the longest message a client can send
+    static const size_t MAX_BATCH_ENTRY_BYTES = 128;
+    static const size_t MAX_BATCH_BYTES = (MAX_BATCH_ORDERS + 1) * MAX_BATCH_ENTRY_BYTES;
     std::unordered_map<std::string, int> active_sessions;
     std::mutex sessions_mutex;
+    bool journaled;
     
 public:
-    TradingServer() : server_fd(-1) {}
+    TradingServer() : server_fd(-1), journaled(false) {}
+    
+    bool open_journal(const std::string& directory) {
+        journaled = engine.enable_journal(JournalConfig(directory));
+        return journaled;
+    }
+    
+    // Loads the newest snapshot and replays the journal written after it
+    bool recover(const std::string& snapshot_directory, const std::string& journal_directory, bool standby) {
+        auto started = std::chrono::steady_clock::now();
+        if (!engine.recover(snapshot_directory, journal_directory, standby)) return false;
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "Recovered in " << elapsed.count() << " ms" << std::endl;
+        return true;
+    }
+    
+    void set_default_risk_limits(const RiskLimits& limits) {
+        engine.set_default_risk_limits(limits);
+    }
+    
+    bool serve_replication(const std::string& endpoint) {
+        return engine.enable_replication(endpoint);
+    }
+    
+    // Applies the primary's stream until it is lost, retrying until it has
+    // been joined once
+    void follow(const std::string& endpoint) {
+        std::cout << "Following primary at " << endpoint << std::endl;
+        while (!engine.follow(endpoint)) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        std::cout << "Primary lost after sequence " << engine.replicated_sequence() << ", taking over" << std::endl;
+    }
+    
+    // A backup that took over: VWAP slicing now happens here
+    void resume() {
+        engine.resume_vwap_orders();
+    }
+    
+    bool write_snapshot(const std::string& directory) {
+        return engine.write_snapshot(directory);
+    }
+    
+    // Snapshots the engine every `interval` from a background thread. With a
+    // journal they are rebuilt from it, so matching never pauses for them.
+    void start_snapshots(const std::string& directory, std::chrono::seconds interval) {
+        std::thread snapshot_thread([this, directory, interval]() {
+            while (true) {
+                std::this_thread::sleep_for(interval);
+                bool written = journaled ? engine.write_snapshot_from_journal(directory)
+                                         : engine.write_snapshot(directory);
+                if (!written) {
+                    std::cerr << "Failed to write snapshot to " << directory << std::endl;
+                }
+            }
+        });
+        snapshot_thread.detach();
+    }
     
     bool start() {
         server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -47,7 +111,7 @@ public:
             return false;
         }
         
-        std::cout << "Trading server listening on port " << PORT << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::SERVER_LISTENING, PORT);
         
         while (true) {
             sockaddr_in client_address;
@@ -69,26 +133,36 @@ public:
     void handle_client(int client_fd) {
         char buffer[1024];
         std::string authenticated_client_id = "";
+        // Bytes read but not yet framed. Every message ends with a newline,
+        // wherever the reads happen to split the stream.
+        std::string pending;
         
         while (true) {
-            int bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
+            int bytes_read = read(client_fd, buffer, sizeof(buffer));
             if (bytes_read <= 0) break;
-            
-            buffer[bytes_read] = '\0';
-            std::string response = process_message(std::string(buffer), client_fd, authenticated_client_id);
-            
-            if (response.find("LOGIN_SUCCESS") == 0) {
-                size_t pos = response.find(":");
-                if (pos != std::string::npos) {
-                    authenticated_client_id = response.substr(pos + 1);
-                    if (!authenticated_client_id.empty() && authenticated_client_id.back() == '\n') {
-                        authenticated_client_id.pop_back();
-                    }
-                    std::cout << "DEBUG: Stored authenticated_client_id: [" << authenticated_client_id << "]" << std::endl;
+            pending.append(buffer, bytes_read);
+            
+            size_t start = 0;
+            size_t end;
+            while ((end = pending.find('\n', start)) != std::string::npos) {
+                std::string message = pending.substr(start, end - start);
+                start = end + 1;
+                if (!message.empty() && message.back() == '\r') {
+                    message.pop_back();
+                }
+                if (!message.empty()) {
+                    respond(client_fd, message, authenticated_client_id);
                 }
             }
-            
-            send(client_fd, response.c_str(), response.length(), 0);
+            pending.erase(0, start);
+            
+            if (pending.size() > MAX_BATCH_BYTES) {
+                // The rest of the message can't be told apart from the next
+                // one, so the session ends here
+                std::string response = "ERROR:A message holds at most " + std::to_string(MAX_BATCH_BYTES) + " bytes.\n";
+                send(client_fd, response.c_str(), response.length(), 0);
+                break;
+            }
         }
         
         if (!authenticated_client_id.empty()) {
@@ -97,6 +171,67 @@ public:
         close(client_fd);
     }
     
+    void respond(int client_fd, const std::string& message, std::string& authenticated_client_id) {
+        std::string response = process_message(message, client_fd, authenticated_client_id);
+        
+        if (response.find("LOGIN_SUCCESS") == 0) {
+            size_t pos = response.find(":");
+            if (pos != std::string::npos) {
+                authenticated_client_id = response.substr(pos + 1);
+                if (!authenticated_client_id.empty() && authenticated_client_id.back() == '\n') {
+                    authenticated_client_id.pop_back();
+                }
+                logger().log(LogLevel::DEBUG, LogEvent::SESSION_STORED, 0, 0, 0.0, 0.0, 0.0,
+                             authenticated_client_id.c_str());
+            }
+        }
+        
+        send(client_fd, response.c_str(), response.length(), 0);
+    }
+    
+    static bool parse_order_type(const std::string& type_str, OrderType& type) {
+        if (type_str == "MARKET") {
+            type = OrderType::MARKET;
+        } else if (type_str == "LIMIT") {
+            type = OrderType::LIMIT;
+        } else if (type_str == "STOP_LOSS") {
+            type = OrderType::STOP_LOSS;
+        } else if (type_str == "STOP_LIMIT") {
+            type = OrderType::STOP_LIMIT;
+        } else if (type_str == "TRAILING_STOP") {
+            type = OrderType::TRAILING_STOP;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    static bool parse_time_in_force(const std::string& tif_str, TimeInForce& time_in_force) {
+        if (tif_str == "DAY") {
+            time_in_force = TimeInForce::DAY;
+        } else if (tif_str == "IOC") {
+            time_in_force = TimeInForce::IOC;
+        } else if (tif_str == "FOK") {
+            time_in_force = TimeInForce::FOK;
+        } else if (tif_str == "GTC") {
+            time_in_force = TimeInForce::GTC;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    static bool parse_side(const std::string& side_str, OrderSide& side) {
+        if (side_str == "BUY") {
+            side = OrderSide::BUY;
+        } else if (side_str == "SELL") {
+            side = OrderSide::SELL;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
     bool add_session(const std::string& client_id, int client_fd) {
         std::lock_guard<std::mutex> lock(sessions_mutex);
         
@@ -106,7 +241,7 @@ public:
         }
         
         active_sessions[client_id] = client_fd;
-        std::cout << "Client " << client_id << " logged in (FD: " << client_fd << ")" << std::endl;
+        logger().log(LogLevel::INFO, LogEvent::CLIENT_LOGGED_IN, client_fd, 0, 0.0, 0.0, 0.0, client_id.c_str());
         return true;
     }
     
@@ -115,7 +250,7 @@ public:
         
         auto it = active_sessions.find(client_id);
         if (it != active_sessions.end()) {
-            std::cout << "Client " << client_id << " logged out (FD: " << it->second << ")" << std::endl;
+            logger().log(LogLevel::INFO, LogEvent::CLIENT_LOGGED_OUT, it->second, 0, 0.0, 0.0, 0.0, client_id.c_str());
             active_sessions.erase(it);
         }
     }
@@ -151,36 +286,105 @@ public:
                 return "ERROR:Not authenticated. Please LOGIN first.\n";
             }
             
-            std::string symbol, type_str, side_str, client_id;
+            // An optional last field sets the time in force; DAY if left out
+            std::string symbol, type_str, side_str, client_id, tif_str;
             double price, quantity;
-            iss >> symbol >> type_str >> side_str >> price >> quantity >> client_id;
+            iss >> symbol >> type_str >> side_str >> price >> quantity >> client_id >> tif_str;
             
-            std::cout << "DEBUG: Received client_id: [" << client_id << "], authenticated_client_id: [" << authenticated_client_id << "]" << std::endl;
+            logger().log(LogLevel::DEBUG, LogEvent::SESSION_RECEIVED, 0, 0, 0.0, 0.0, 0.0,
+                         client_id.c_str(), authenticated_client_id.c_str());
             
             if (client_id != authenticated_client_id) {
                 return "ERROR:Client ID mismatch. You can only place orders for your own account.\n";
             }
             
             OrderType type;
-            if (type_str == "MARKET") {
-                type = OrderType::MARKET;
-            } else if (type_str == "LIMIT") {
-                type = OrderType::LIMIT;
-            } else if (type_str == "STOP_LOSS") {
-                type = OrderType::STOP_LOSS;
-            } else if (type_str == "STOP_LIMIT") {
-                type = OrderType::STOP_LIMIT;
-            } else if (type_str == "TRAILING_STOP") {
-                type = OrderType::TRAILING_STOP;
-            } else {
+            if (!parse_order_type(type_str, type)) {
                 return "ERROR:Invalid order type. Use MARKET, LIMIT, STOP_LOSS, STOP_LIMIT, or TRAILING_STOP.\n";
             }
             
-            OrderSide side = (side_str == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+            OrderSide side;
+            if (!parse_side(side_str, side)) {
+                return "ERROR:Invalid side. Use BUY or SELL.\n";
+            }
+            
+            TimeInForce time_in_force = TimeInForce::DAY;
+            if (!tif_str.empty() && !parse_time_in_force(tif_str, time_in_force)) {
+                return "ERROR:Invalid time in force. Use DAY, IOC, FOK, or GTC.\n";
+            }
             
-            uint64_t order_id = engine.submit_order(symbol, type, side, price, quantity, client_id);
+            uint64_t order_id = engine.submit_order(symbol, type, side, price, quantity, client_id, time_in_force);
             return "ORDER_ID:" + std::to_string(order_id) + "\n";
         }
+        else if (command == "BATCH") {
+            if (authenticated_client_id.empty()) {
+                return "ERROR:Not authenticated. Please LOGIN first.\n";
+            }
+            
+            // BATCH client count, then count times: symbol type side price quantity,
+            // each optionally followed by TIF=<time in force>, ended by a newline
+            std::string client_id;
+            size_t count = 0;
+            iss >> client_id >> count;
+            
+            if (client_id != authenticated_client_id) {
+                return "ERROR:Client ID mismatch. You can only place orders for your own account.\n";
+            }
+            
+            if (count == 0 || count > MAX_BATCH_ORDERS) {
+                return "ERROR:A batch holds 1 to " + std::to_string(MAX_BATCH_ORDERS) + " orders.\n";
+            }
+            
+            // Entries that don't parse are rejected on their own and never
+            // reach the engine; `positions` maps each request to its entry
+            std::vector<OrderRequest> requests;
+            std::vector<size_t> positions;
+            requests.reserve(count);
+            positions.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                std::string symbol, type_str, side_str;
+                double price, quantity;
+                if (!(iss >> symbol >> type_str >> side_str >> price >> quantity)) {
+                    return "ERROR:Batch ended after " + std::to_string(i) + " of " + std::to_string(count) + " orders.\n";
+                }
+                
+                // Symbols never hold '=', so a key=value token after the
+                // quantity belongs to this entry; anything else starts the next
+                TimeInForce time_in_force = TimeInForce::DAY;
+                bool fields_valid = true;
+                std::streampos entry_end = iss.tellg();
+                std::string field;
+                if (iss >> field) {
+                    if (field.find('=') == std::string::npos) {
+                        iss.seekg(entry_end);
+                    } else {
+                        fields_valid = field.compare(0, 4, "TIF=") == 0 &&
+                                       parse_time_in_force(field.substr(4), time_in_force);
+                    }
+                }
+                iss.clear();
+                
+                OrderType type;
+                OrderSide side;
+                if (!fields_valid || !parse_order_type(type_str, type) || !parse_side(side_str, side)) {
+                    continue;
+                }
+                requests.push_back(OrderRequest{symbol, type, side, price, quantity, client_id, time_in_force});
+                positions.push_back(i);
+            }
+            
+            // Ids in request order; 0 marks a rejected order
+            std::vector<uint64_t> order_ids(count, 0);
+            std::vector<uint64_t> submitted = engine.submit_batch(requests);
+            for (size_t i = 0; i < submitted.size(); ++i) {
+                order_ids[positions[i]] = submitted[i];
+            }
+            std::string response = "BATCH_IDS:" + std::to_string(order_ids.size());
+            for (uint64_t order_id : order_ids) {
+                response += " " + std::to_string(order_id);
+            }
+            return response + "\n";
+        }
         else if (command == "STOP_LIMIT_ORDER") {
             if (authenticated_client_id.empty()) {
                 return "ERROR:Not authenticated. Please LOGIN first.\n";
@@ -194,7 +398,10 @@ public:
                 return "ERROR:Client ID mismatch. You can only place orders for your own account.\n";
             }
             
-            OrderSide side = (side_str == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+            OrderSide side;
+            if (!parse_side(side_str, side)) {
+                return "ERROR:Invalid side. Use BUY or SELL.\n";
+            }
             
             uint64_t order_id = engine.submit_stop_limit_order(symbol, side, stop_price, limit_price, quantity, client_id);
             return "ORDER_ID:" + std::to_string(order_id) + "\n";
@@ -212,7 +419,10 @@ public:
                 return "ERROR:Client ID mismatch. You can only place orders for your own account.\n";
             }
             
-            OrderSide side = (side_str == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+            OrderSide side;
+            if (!parse_side(side_str, side)) {
+                return "ERROR:Invalid side. Use BUY or SELL.\n";
+            }
             
             uint64_t order_id = engine.submit_trailing_stop_order(symbol, side, trailing_amount, quantity, client_id);
             return "ORDER_ID:" + std::to_string(order_id) + "\n";
@@ -239,7 +449,10 @@ public:
                 return "ERROR:Duration cannot exceed 8 hours (480 minutes).\n";
             }
             
-            OrderSide side = (side_str == "BUY") ? OrderSide::BUY : OrderSide::SELL;
+            OrderSide side;
+            if (!parse_side(side_str, side)) {
+                return "ERROR:Invalid side. Use BUY or SELL.\n";
+            }
             
             auto now = std::chrono::steady_clock::now();
             auto start_time = now + std::chrono::seconds(1);
@@ -270,11 +483,11 @@ public:
             
             bool found_orders = false;
             for (const auto& order : active_vwap_orders) {
-                if (order->symbol == symbol && order->client_id == client_id) {
+                if (order->symbol_name() == symbol && order->client_name() == client_id) {
                     if (found_orders) response += "|";
                     response += "ID:" + std::to_string(order->id) + 
                                " SIDE:" + (order->side == OrderSide::BUY ? "BUY" : "SELL") +
-                               " TARGET:" + std::to_string(order->target_vwap) +
+                               " TARGET:" + std::to_string(price_to_double(order->vwap->target_vwap)) +
                                " PROGRESS:" + std::to_string(order->filled_quantity) + "/" + std::to_string(order->quantity) +
                                " STATUS:" + std::to_string((int)order->status);
                     found_orders = true;
@@ -303,18 +516,91 @@ public:
             bool success = engine.cancel_order(order_id, client_id);
             return success ? "CANCELLED\n" : "CANCEL_FAILED\n";
         }
+        else if (command == "AMEND" || command == "REPLACE") {
+            if (authenticated_client_id.empty()) {
+                return "ERROR:Not authenticated. Please LOGIN first.\n";
+            }
+            
+            // AMEND order_id price quantity client; quantity is the new total
+            uint64_t order_id = 0;
+            double price = 0.0, quantity = 0.0;
+            std::string client_id;
+            iss >> order_id >> price >> quantity >> client_id;
+            
+            if (client_id != authenticated_client_id) {
+                return "ERROR:Client ID mismatch. You can only amend your own orders.\n";
+            }
+            
+            bool success = engine.amend_order(order_id, price, quantity, client_id);
+            return success ? "AMENDED\n" : "AMEND_FAILED\n";
+        }
         else if (command == "BOOK") {
             std::string symbol;
             iss >> symbol;
             
             auto book = engine.get_order_book(symbol);
             if (book) {
-                return "BID:" + std::to_string(book->get_best_bid()) + 
-                       " ASK:" + std::to_string(book->get_best_ask()) + 
-                       " LAST:" + std::to_string(book->get_last_price()) + "\n";
+                // One consistent snapshot; never waits on the matcher
+                TopOfBook top = book->get_top_of_book();
+                return "BID:" + std::to_string(top.bid) + 
+                       " ASK:" + std::to_string(top.ask) + 
+                       " LAST:" + std::to_string(top.last) +
+                       " BID_SIZE:" + std::to_string(top.bid_size) +
+                       " ASK_SIZE:" + std::to_string(top.ask_size) +
+                       " SEQ:" + std::to_string(top.sequence) + "\n";
             }
             return "BOOK_NOT_FOUND\n";
         }
+        else if (command == "DEPTH") {
+            std::string symbol;
+            size_t levels = 10;
+            iss >> symbol >> levels;
+            
+            auto book = engine.get_order_book(symbol);
+            if (!book) {
+                return "BOOK_NOT_FOUND\n";
+            }
+            
+            // Levels as price@quantity/orders; follow up with DELTAS from SEQ
+            DepthSnapshot depth = engine.get_depth(symbol, levels);
+            auto format_side = [](const std::vector<DepthLevel>& side) {
+                std::string out;
+                for (const auto& level : side) {
+                    if (!out.empty()) out += ",";
+                    out += std::to_string(level.price) + "@" + std::to_string(level.quantity) +
+                           "/" + std::to_string(level.order_count);
+                }
+                return out;
+            };
+            return "SEQ:" + std::to_string(depth.sequence) +
+                   " BIDS:" + format_side(depth.bids) +
+                   " ASKS:" + format_side(depth.asks) + "\n";
+        }
+        else if (command == "DELTAS") {
+            std::string symbol;
+            uint64_t since = 0;
+            iss >> symbol >> since;
+            
+            auto book = engine.get_order_book(symbol);
+            if (!book) {
+                return "BOOK_NOT_FOUND\n";
+            }
+            
+            std::vector<LevelUpdate> updates;
+            if (!engine.get_level_updates(symbol, since, updates)) {
+                return "DELTAS_GAP\n";
+            }
+            
+            // A quantity of 0 means the level is gone
+            std::string response = "DELTAS:" + std::to_string(updates.size());
+            for (const auto& update : updates) {
+                response += " " + std::to_string(update.sequence) +
+                            (update.side == OrderSide::BUY ? ":B:" : ":S:") +
+                            std::to_string(update.price) + "@" + std::to_string(update.quantity) +
+                            "/" + std::to_string(update.order_count);
+            }
+            return response + "\n";
+        }
         else if (command == "LOGOUT") {
             if (!authenticated_client_id.empty()) {
                 remove_session(authenticated_client_id);
@@ -334,7 +620,77 @@ public:
 };
 
 int main() {
+    // LOG_LEVEL=DEBUG brings back the per-order and session debug lines
+    const char* log_level = std::getenv("LOG_LEVEL");
+    if (log_level) {
+        LogLevel level;
+        if (parse_log_level(log_level, level)) {
+            logger().set_level(level);
+        } else {
+            std::cerr << "Unknown LOG_LEVEL " << log_level << ", using INFO" << std::endl;
+        }
+    }
+    
     TradingServer server;
+    // RISK_MAX_ORDER_QTY, RISK_MAX_NOTIONAL, RISK_MAX_OPEN_ORDERS,
+    // RISK_MAX_POSITION and RISK_MAX_MSG_RATE set every client's pre-trade
+    // limits; unset ones stay off
+    auto risk_setting = [](const char* name) {
+        const char* value = std::getenv(name);
+        return value ? std::atof(value) : 0.0;
+    };
+    RiskLimits limits(risk_setting("RISK_MAX_ORDER_QTY"), risk_setting("RISK_MAX_NOTIONAL"),
+                      static_cast<uint32_t>(risk_setting("RISK_MAX_OPEN_ORDERS")), risk_setting("RISK_MAX_POSITION"),
+                      static_cast<uint32_t>(risk_setting("RISK_MAX_MSG_RATE")));
+    if (limits.max_order_quantity > 0 || limits.max_notional > 0 || limits.max_open_orders > 0 ||
+        limits.max_position > 0 || limits.max_messages_per_second > 0) {
+        server.set_default_risk_limits(limits);
+    }
+    // JOURNAL_DIR turns on the write-ahead journal; orders are acked once durable.
+    // SNAPSHOT_DIR adds periodic snapshots (SNAPSHOT_INTERVAL seconds, default
+    // 60). On start the engine resumes from the last snapshot and the journal.
+    // REPLICATION_LISTEN ("unix:<path>" or "<host>:<port>") streams the
+    // journal to backups. REPLICATE_FROM makes this process a backup of that
+    // endpoint: it recovers from the directories (the primary's, when they
+    // are shared), follows the primary, and takes over with them once the
+    // primary is gone.
+    const char* journal_dir = std::getenv("JOURNAL_DIR");
+    const char* snapshot_dir = std::getenv("SNAPSHOT_DIR");
+    const char* replication_listen = std::getenv("REPLICATION_LISTEN");
+    const char* replicate_from = std::getenv("REPLICATE_FROM");
+    if ((journal_dir || snapshot_dir) &&
+        !server.recover(snapshot_dir ? snapshot_dir : "", journal_dir ? journal_dir : "", replicate_from != nullptr)) {
+        std::cerr << "Failed to recover from " << (journal_dir ? journal_dir : snapshot_dir) << std::endl;
+        return 1;
+    }
+    if (replicate_from) {
+        server.follow(replicate_from);
+    }
+    if (journal_dir && !server.open_journal(journal_dir)) {
+        std::cerr << "Failed to open journal in " << journal_dir << std::endl;
+        return 1;
+    }
+    if (replicate_from) {
+        // Records the primary streamed but never made durable are only in
+        // memory here; a snapshot makes them part of the recoverable state
+        if (snapshot_dir && !server.write_snapshot(snapshot_dir)) {
+            std::cerr << "Failed to write snapshot to " << snapshot_dir << std::endl;
+            return 1;
+        }
+        server.resume();
+    }
+    if (replication_listen) {
+        if (!journal_dir || !server.serve_replication(replication_listen)) {
+            std::cerr << "Failed to serve replication on " << replication_listen << " (needs JOURNAL_DIR)" << std::endl;
+            return 1;
+        }
+    }
+    if (snapshot_dir) {
+        const char* interval = std::getenv("SNAPSHOT_INTERVAL");
+        long seconds = interval ? std::atol(interval) : 60;
+        server.start_snapshots(snapshot_dir, std::chrono::seconds(seconds > 0 ? seconds : 60));
+    }
+    
     if (!server.start()) {
         std::cerr << "Failed to start server" << std::endl;
         return 1;
@@ -5,9 +5,38 @@
 #include <vector>
 #include <string>
 #include <mutex>
-#include "../src/server/MatchingEngine.h"
-#include "../src/common/Order.h"
-#include "../src/common/OrderBook.h"
+#include <atomic>
+#include <sstream>
+#include <map>
+#include <fstream>
+#include "src/server/MatchingEngine.h"
+#include "src/common/Order.h"
+#include "src/common/OrderBook.h"
+#include "src/common/PriceLadder.h"
+#include "src/common/OrderPool.h"
+#include "src/common/TimerWheel.h"
+#include "src/common/Journal.h"
+#include <filesystem>
+#include <unistd.h>
+
+// A fresh directory under the system temp directory, removed with everything
+// in it when the test that made it returns
+struct ScratchDirectory {
+    std::filesystem::path path;
+
+    explicit ScratchDirectory(const std::string& name)
+        : path(std::filesystem::temp_directory_path() /
+               ("engine_" + name + "_test_" + std::to_string(::getpid()))) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~ScratchDirectory() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path, ignored);
+    }
+    ScratchDirectory(const ScratchDirectory&) = delete;
+    ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+};
 
 class TradingEngineTest {
 private:
@@ -29,6 +58,8 @@ public:
         test_concurrent_operations_realistic();
         test_partial_fills_and_remaining_quantity();
         test_order_status_transitions();
+        test_tick_size_price_levels();
+        test_cancel_routing();
         test_vwap_orders_realistic();
         
         std::cout << "\n=== ALL REALISTIC TESTS PASSED ===" << std::endl;
@@ -286,13 +317,10 @@ public:
     void test_order_book_operations_realistic() {
         std::cout << "\n--- Testing OrderBook Operations (Realistic) ---" << std::endl;
         
+        // No book until the symbol's first order
         auto book = engine.get_order_book("NFLX");
-        assert(book != nullptr);
-        
-        assert(book->get_best_bid() == 0.0);
-        assert(book->get_best_ask() == 0.0);
-        assert(book->get_last_price() == 0.0);
-        
+        assert(book == nullptr);
+
         engine.submit_order("NFLX", OrderType::LIMIT, OrderSide::BUY, 500.0, 100, "book_test_client");
         engine.submit_order("NFLX", OrderType::LIMIT, OrderSide::BUY, 501.0, 50, "book_test_client");
         engine.submit_order("NFLX", OrderType::LIMIT, OrderSide::SELL, 510.0, 75, "book_test_client");
@@ -409,13 +437,13 @@ public:
         assert(vwap_order != nullptr);
         assert(vwap_order->type == OrderType::VWAP);
         assert(vwap_order->side == OrderSide::BUY);
-        assert(vwap_order->target_vwap == 100.0);
+        assert(vwap_order->vwap->target_vwap == price_from_double(100.0));
         assert(vwap_order->quantity == 50);
         assert(vwap_order->status == OrderStatus::PENDING);
         assert(vwap_order->filled_quantity == 0.0);
-        assert(vwap_order->execution_start_time == start_time);
-        assert(vwap_order->execution_end_time == end_time);
-        assert(vwap_order->child_order_ids.empty());
+        assert(vwap_order->vwap->execution_start_time == start_time);
+        assert(vwap_order->vwap->execution_end_time == end_time);
+        assert(vwap_order->vwap->child_order_ids.empty());
         
         std::cout << "✓ VWAP order creation and validation passed" << std::endl;
         
@@ -446,14 +474,14 @@ public:
         vwap_order = engine.get_vwap_order(vwap_order_id);
         assert(vwap_order != nullptr);
         
-        if (!vwap_order->child_order_ids.empty()) {
-            std::cout << "✓ VWAP child orders generated: " << vwap_order->child_order_ids.size() << std::endl;
+        if (!vwap_order->vwap->child_order_ids.empty()) {
+            std::cout << "✓ VWAP child orders generated: " << vwap_order->vwap->child_order_ids.size() << std::endl;
             
-            assert(vwap_order->last_child_order_price > 0.0);
-            assert(vwap_order->last_child_order_time > vwap_order->timestamp);
-            assert(vwap_order->last_child_order_price <= vwap_order->target_vwap);
+            assert(vwap_order->vwap->last_child_order_price > 0.0);
+            assert(vwap_order->vwap->last_child_order_time > vwap_order->timestamp);
+            assert(vwap_order->vwap->last_child_order_price <= vwap_order->vwap->target_vwap);
             
-            for (uint64_t child_id : vwap_order->child_order_ids) {
+            for (uint64_t child_id : vwap_order->vwap->child_order_ids) {
             }
         } else {
             std::cout << "ℹ No child orders generated yet (may be due to timing or market conditions)" << std::endl;
@@ -533,33 +561,118 @@ public:
         
         std::cout << "✓ VWAP orders comprehensive test passed" << std::endl;
     }
+    
+    void test_tick_size_price_levels() {
+        std::cout << "\n--- Testing Tick Size Price Levels ---" << std::endl;
+        
+        // Reading a symbol with no book neither makes one nor fixes its config
+        assert(engine.get_order_book("TICK") == nullptr);
+        assert(engine.get_depth("TICK", 5).bids.empty());
+        assert(engine.get_order_book("TICK") == nullptr);
+        assert(engine.set_symbol_config("TICK", SymbolConfig(price_from_double(0.05))));
+        
+        uint64_t buy1 = engine.submit_order("TICK", OrderType::LIMIT, OrderSide::BUY, 10.01, 10, "tick_buyer1");
+        uint64_t buy2 = engine.submit_order("TICK", OrderType::LIMIT, OrderSide::BUY, 9.99, 10, "tick_buyer2");
+        assert(buy1 > 0 && buy2 > 0);
+        
+        auto book = engine.get_order_book("TICK");
+        assert(book != nullptr);
+        assert(book->get_best_bid() == 10.0);
+        assert(!engine.set_symbol_config("TICK", SymbolConfig(price_from_double(0.01))));
+        
+        uint64_t too_small = engine.submit_order("TICK", OrderType::LIMIT, OrderSide::SELL, 0.01, 10, "tick_seller");
+        assert(too_small == 0);
+        
+        uint64_t sell = engine.submit_order("TICK", OrderType::LIMIT, OrderSide::SELL, 10.02, 20, "tick_seller");
+        assert(sell > 0);
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        assert(book->get_best_bid() == 0.0);
+        assert(book->get_best_ask() == 0.0);
+        assert(book->get_last_price() == 10.0);
+        
+        std::cout << "✓ Tick size price level test passed" << std::endl;
+    }
+    
+    void test_cancel_routing() {
+        std::cout << "\n--- Testing Cancel Routing ---" << std::endl;
+        
+        uint64_t bid_a = engine.submit_order("ROUTE_A", OrderType::LIMIT, OrderSide::BUY, 20.0, 10, "router");
+        uint64_t bid_b = engine.submit_order("ROUTE_B", OrderType::LIMIT, OrderSide::BUY, 20.0, 10, "router");
+        uint64_t stop_a = engine.submit_order("ROUTE_A", OrderType::STOP_LOSS, OrderSide::SELL, 15.0, 10, "router");
+        assert(bid_a > 0 && bid_b > 0 && stop_a > 0);
+        
+        assert(!engine.cancel_order(bid_a, "someone_else"));
+        assert(engine.cancel_order(bid_a, "router"));
+        assert(!engine.cancel_order(bid_a, "router"));
+        assert(engine.cancel_order(stop_a, "router"));
+        
+        assert(engine.get_order_book("ROUTE_A")->get_best_bid() == 0.0);
+        assert(engine.get_order_book("ROUTE_B")->get_best_bid() == 20.0);
+        
+        engine.submit_order("ROUTE_B", OrderType::MARKET, OrderSide::SELL, 0.0, 10, "route_seller");
+        assert(engine.get_order_book("ROUTE_B")->get_best_bid() == 0.0);
+        assert(!engine.cancel_order(bid_b, "router"));
+        
+        std::cout << "✓ Cancel routing test passed" << std::endl;
+    }
 };
 
 void test_order_creation() {
     std::cout << "\n--- Testing Order Creation ---" << std::endl;
     
-    Order order1(1, "AAPL", OrderType::LIMIT, OrderSide::BUY, 150.0, 100, "client1");
+    Order order1(1, "AAPL", OrderType::LIMIT, OrderSide::BUY, price_from_double(150.0), 100, "client1");
     assert(order1.id == 1);
-    assert(order1.symbol == "AAPL");
+    assert(order1.symbol_name() == "AAPL");
     assert(order1.type == OrderType::LIMIT);
     assert(order1.side == OrderSide::BUY);
-    assert(order1.price == 150.0);
+    assert(order1.price == price_from_double(150.0));
     assert(order1.quantity == 100);
-    assert(order1.client_id == "client1");
+    assert(order1.client_name() == "client1");
     assert(order1.status == OrderStatus::PENDING);
+    // Plain orders carry no stop or VWAP state, and matching fields share a line
+    assert(!order1.stop && !order1.vwap);
+    const char* base = reinterpret_cast<const char*>(&order1);
+    assert(reinterpret_cast<const char*>(&order1.client) + sizeof(order1.client) - base <= 64);
     
-    Order order2(2, "AAPL", OrderType::STOP_LIMIT, OrderSide::SELL, 160.0, 155.0, 50, "client2", StopLimitOrderTag{});
-    assert(order2.price == 160.0);
-    assert(order2.limit_price == 155.0);
+    Order order2(2, "AAPL", OrderType::STOP_LIMIT, OrderSide::SELL, price_from_double(160.0), price_from_double(155.0), 50, "client2", StopLimitOrderTag{});
+    assert(order2.price == price_from_double(160.0));
+    assert(order2.stop->limit_price == price_from_double(155.0));
     
-    Order order3(3, "AAPL", OrderType::TRAILING_STOP, OrderSide::SELL, 5.0, 25, "client3", TrailingStopOrderTag{});
-    assert(order3.trailing_amount == 5.0);
-    assert(order3.highest_price == 0.0);
-    assert(order3.lowest_price == 0.0);
+    Order order3(3, "AAPL", OrderType::TRAILING_STOP, OrderSide::SELL, price_from_double(5.0), 25, "client3", TrailingStopOrderTag{});
+    assert(order3.stop->trailing_amount == price_from_double(5.0));
+    assert(order3.stop->highest_price == 0);
+    assert(order3.stop->lowest_price == 0);
     
     std::cout << "✓ Order creation test passed" << std::endl;
 }
 
+void test_name_directory() {
+    std::cout << "\n--- Testing Name Directory ---" << std::endl;
+    
+    NameDirectory directory;
+    uint32_t first = directory.intern("ALPHA");
+    uint32_t second = directory.intern("BETA");
+    assert(first == 0 && second == 1);
+    assert(directory.intern("ALPHA") == first);
+    assert(directory.size() == 2);
+    assert(directory.name(second) == "BETA");
+    
+    uint32_t found = 99;
+    assert(directory.find("BETA", found) && found == second);
+    assert(!directory.find("GAMMA", found));
+    assert(directory.size() == 2);
+    
+    // Orders built by name and by id agree
+    Order by_name(1, "AAPL", OrderType::LIMIT, OrderSide::BUY, price_from_double(1.0), 1, "client1");
+    Order by_id(2, symbol_directory().intern("AAPL"), OrderType::LIMIT, OrderSide::BUY, price_from_double(1.0), 1,
+                client_directory().intern("client1"));
+    assert(by_name.symbol == by_id.symbol && by_name.client == by_id.client);
+    
+    std::cout << "✓ Name directory test passed" << std::endl;
+}
+
 void test_order_book_basic() {
     std::cout << "\n--- Testing OrderBook Basic Operations ---" << std::endl;
     
@@ -569,8 +682,8 @@ void test_order_book_basic() {
     assert(book.get_best_ask() == 0.0);
     assert(book.get_last_price() == 0.0);
     
-    auto order1 = std::make_shared<Order>(1, "AAPL", OrderType::LIMIT, OrderSide::BUY, 150.0, 100, "client1");
-    auto order2 = std::make_shared<Order>(2, "AAPL", OrderType::LIMIT, OrderSide::SELL, 155.0, 50, "client2");
+    auto order1 = std::make_shared<Order>(1, "AAPL", OrderType::LIMIT, OrderSide::BUY, price_from_double(150.0), 100, "client1");
+    auto order2 = std::make_shared<Order>(2, "AAPL", OrderType::LIMIT, OrderSide::SELL, price_from_double(155.0), 50, "client2");
     
     book.add_order(order1);
     book.add_order(order2);
@@ -584,12 +697,1417 @@ void test_order_book_basic() {
     std::cout << "✓ OrderBook basic operations test passed" << std::endl;
 }
 
+void test_stop_trigger_index() {
+    std::cout << "\n--- Testing Stop Trigger Index ---" << std::endl;
+    
+    OrderBook book("STOPS");
+    uint64_t id = 1;
+    auto limit = [&](OrderSide side, double price, double quantity, const std::string& client) {
+        auto order = std::make_shared<Order>(id++, "STOPS", OrderType::LIMIT, side, price_from_double(price), quantity, client);
+        book.add_order(order);
+        book.check_stop_loss_orders();
+        return order;
+    };
+    auto stop = [&](OrderSide side, double price, const std::string& client) {
+        auto order = std::make_shared<Order>(id++, "STOPS", OrderType::STOP_LOSS, side, price_from_double(price), 10, client);
+        book.add_order(order);
+        return order;
+    };
+    
+    limit(OrderSide::BUY, 100.0, 10, "b0");
+    limit(OrderSide::SELL, 100.0, 10, "s0");
+    assert(book.get_last_price() == 100.0);
+    
+    limit(OrderSide::BUY, 98.0, 100, "bidder");
+    limit(OrderSide::BUY, 96.0, 100, "bidder");
+    limit(OrderSide::SELL, 110.0, 100, "asker");
+    
+    auto stop_99 = stop(OrderSide::SELL, 99.0, "s1");
+    auto stop_97 = stop(OrderSide::SELL, 97.0, "s2");
+    auto stop_95 = stop(OrderSide::SELL, 95.0, "s3");
+    auto stop_105 = stop(OrderSide::BUY, 105.0, "b1");
+    
+    assert(book.cancel_order(stop_95->id));
+    assert(!book.cancel_order(stop_95->id));
+    assert(stop_95->status == OrderStatus::CANCELLED);
+    
+    limit(OrderSide::SELL, 98.0, 10, "s4");
+    assert(stop_99->status == OrderStatus::FILLED);
+    assert(stop_97->status == OrderStatus::PENDING);
+    assert(stop_105->status == OrderStatus::PENDING);
+    
+    limit(OrderSide::SELL, 98.0, 80, "s5");
+    limit(OrderSide::SELL, 96.0, 10, "s6");
+    assert(book.get_last_price() == 96.0);
+    assert(stop_97->status == OrderStatus::FILLED);
+    assert(stop_105->status == OrderStatus::PENDING);
+    assert(book.get_best_bid() == 96.0);
+    
+    assert(book.cancel_order(stop_105->id));
+
+    // A stop-limit that triggers on arrival reports its fills, so the engine
+    // fires the stop its trades cross
+    MatchingEngine engine(2);
+    engine.submit_order("CASC", OrderType::LIMIT, OrderSide::BUY, 100.0, 1, "casc_bid");
+    engine.submit_order("CASC", OrderType::LIMIT, OrderSide::SELL, 100.0, 1, "casc_ask");
+    engine.submit_order("CASC", OrderType::LIMIT, OrderSide::BUY, 98.0, 2, "casc_bid");
+    engine.submit_order("CASC", OrderType::LIMIT, OrderSide::BUY, 96.0, 5, "casc_bid");
+    assert(engine.submit_order("CASC", OrderType::STOP_LOSS, OrderSide::SELL, 97.0, 1, "casc_stop") > 0);
+    assert(engine.submit_stop_limit_order("CASC", OrderSide::SELL, 101.0, 96.0, 5, "casc_stop_limit") > 0);
+    assert(engine.get_position("CASC", "casc_stop_limit") == -5);
+    assert(engine.get_position("CASC", "casc_stop") == -1);
+    assert(engine.get_order_book("CASC")->get_top_of_book().bid_size == 1.0);
+
+    std::cout << "✓ Stop trigger index test passed" << std::endl;
+}
+
+void test_trailing_stop_groups() {
+    std::cout << "\n--- Testing Trailing Stop Groups ---" << std::endl;
+
+    OrderBook book("TRAIL");
+    uint64_t id = 1;
+    auto limit = [&](OrderSide side, double price, double quantity, const std::string& client) {
+        auto order = std::make_shared<Order>(id++, "TRAIL", OrderType::LIMIT, side, price_from_double(price), quantity, client);
+        book.add_order(order);
+        book.check_stop_loss_orders();
+        return order;
+    };
+    auto trailing = [&](OrderSide side, double amount, const std::string& client) {
+        auto order = std::make_shared<Order>(id++, "TRAIL", OrderType::TRAILING_STOP, side, price_from_double(amount), 10, client,
+                                             TrailingStopOrderTag{});
+        book.add_order(order);
+        return order;
+    };
+    auto trigger = [](const std::shared_ptr<Order>& order) {
+        const TrailingStopGroup* group = order->stop->trailing_group;
+        return (order->side == OrderSide::SELL) ? group->reference - group->amount : group->reference + group->amount;
+    };
+
+    // Placed before the first trade: picks up its reference from that trade
+    auto early = trailing(OrderSide::SELL, 2.0, "t0");
+    limit(OrderSide::BUY, 100.0, 10, "b0");
+    limit(OrderSide::SELL, 100.0, 10, "s0");
+    assert(early->status == OrderStatus::PENDING);
+    assert(trigger(early) == price_from_double(98.0));
+
+    // A buy trailing stop waits for the price to rise off its low
+    auto buy_stop = trailing(OrderSide::BUY, 5.0, "t1");
+    auto same_group = trailing(OrderSide::SELL, 2.0, "t2");
+    auto wider = trailing(OrderSide::SELL, 4.0, "t3");
+    assert(buy_stop->status == OrderStatus::PENDING);
+    assert(trigger(buy_stop) == price_from_double(105.0));
+    assert(same_group->stop->trailing_group == early->stop->trailing_group);
+
+    limit(OrderSide::BUY, 99.0, 100, "bidder");
+    limit(OrderSide::SELL, 103.0, 10, "a1");
+    limit(OrderSide::BUY, 103.0, 10, "x");
+    assert(trigger(early) == price_from_double(101.0));
+    assert(trigger(wider) == price_from_double(99.0));
+    assert(trigger(buy_stop) == price_from_double(105.0));
+
+    assert(book.cancel_order(same_group->id));
+    assert(same_group->status == OrderStatus::CANCELLED);
+
+    // The trade at 101 fires the 2.00 group; its sale at 99 fires the 4.00 one
+    limit(OrderSide::BUY, 101.0, 10, "b2");
+    limit(OrderSide::SELL, 101.0, 10, "s2");
+    assert(early->status == OrderStatus::FILLED);
+    assert(wider->status == OrderStatus::FILLED);
+    assert(book.get_last_price() == 99.0);
+    assert(buy_stop->status == OrderStatus::PENDING);
+    assert(trigger(buy_stop) == price_from_double(104.0));
+    assert(!book.cancel_order(early->id));
+    assert(book.cancel_order(buy_stop->id));
+
+    // An older, smaller group re-keyed onto a newer, larger one keeps arrival order
+    OrderBook merge_book("TRAIL");
+    auto trade = [&](double price) {
+        merge_book.add_order(std::make_shared<Order>(id++, "TRAIL", OrderType::LIMIT, OrderSide::BUY,
+                                                     price_from_double(price), 1, "mb"));
+        merge_book.add_order(std::make_shared<Order>(id++, "TRAIL", OrderType::LIMIT, OrderSide::SELL,
+                                                     price_from_double(price), 1, "ms"));
+        merge_book.check_stop_loss_orders();
+    };
+    auto merge_trailing = [&](const std::string& client) {
+        auto order = std::make_shared<Order>(id++, "TRAIL", OrderType::TRAILING_STOP, OrderSide::SELL, price_from_double(5.0), 10,
+                                             client, TrailingStopOrderTag{});
+        merge_book.add_order(order);
+        return order;
+    };
+    trade(100.0);
+    auto oldest = merge_trailing("m0");
+    trade(98.0);
+    auto newer = merge_trailing("m1");
+    auto newest = merge_trailing("m2");
+    assert(oldest->stop->trailing_group != newer->stop->trailing_group);
+    trade(101.0);
+    const TrailingStopGroup* merged = oldest->stop->trailing_group;
+    assert(merged == newer->stop->trailing_group && merged == newest->stop->trailing_group);
+    assert(merged->orders.size() == 3);
+    assert(merged->orders.front() == oldest.get());
+    assert(oldest->next_in_level == newer.get());
+    assert(newer->next_in_level == newest.get());
+    assert(newest->next_in_level == nullptr);
+
+    std::cout << "✓ Trailing stop groups test passed" << std::endl;
+}
+
+void test_order_pool() {
+    std::cout << "\n--- Testing Order Pool ---" << std::endl;
+    
+    std::shared_ptr<Order> survivor;
+    {
+        OrderPool pool(4);
+        std::vector<std::shared_ptr<Order>> orders;
+        for (uint64_t i = 1; i <= 10; ++i) {
+            orders.push_back(pool.make_order(i, "POOL", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.0), 1, "c"));
+        }
+        assert(pool.live_count() == 10);
+        assert(pool.slab_count() == 3);
+        assert(orders[9]->id == 10 && orders[9]->client_name() == "c");
+        // The control block sits ahead of each order, which still starts on a cache line
+        for (const auto& order : orders) {
+            assert(reinterpret_cast<uintptr_t>(order.get()) % 64 == 0);
+        }
+        
+        // Released orders are recycled instead of growing the pool
+        orders.clear();
+        assert(pool.live_count() == 0);
+        for (uint64_t i = 11; i <= 20; ++i) {
+            orders.push_back(pool.make_order(i, "POOL", OrderType::LIMIT, OrderSide::SELL, price_from_double(11.0), 1, "c"));
+        }
+        assert(pool.slab_count() == 3);
+        survivor = orders.back();
+    }
+    // An order still held elsewhere outlives its pool
+    assert(survivor->id == 20);
+    assert(survivor->price == price_from_double(11.0));
+    survivor.reset();
+
+    // Each object size gets its own blocks, and blocks freed on other
+    // threads come back to the same lists
+    {
+        SlabPool pool(8);
+        auto small = pool.allocator<uint64_t>();
+        auto large = pool.allocator<Order>();
+        uint64_t* word = small.allocate(1);
+        Order* slot = large.allocate(1);
+        assert(pool.live_count() == 2 && pool.slab_count() == 2);
+        small.deallocate(word, 1);
+        large.deallocate(slot, 1);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&pool]() {
+                auto words = pool.allocator<uint64_t>();
+                for (int round = 0; round < 2000; ++round) {
+                    uint64_t* held[16];
+                    for (auto& block : held) block = words.allocate(1);
+                    for (auto* block : held) words.deallocate(block, 1);
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        assert(pool.live_count() == 0);
+    }
+
+    OrderBook book("POOL");
+    auto order = book.create_order(1, "POOL", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.0), 5, "c");
+    book.add_order(order);
+    assert(book.get_best_bid() == 10.0);
+    assert(book.cancel_order(1));
+    assert(order->status == OrderStatus::CANCELLED);
+    
+    std::cout << "✓ Order pool test passed" << std::endl;
+}
+
+void test_top_of_book_snapshot() {
+    std::cout << "\n--- Testing Top Of Book Snapshot ---" << std::endl;
+    
+    OrderBook book("TOB");
+    TopOfBook empty = book.get_top_of_book();
+    assert(empty.bid == 0.0 && empty.ask == 0.0 && empty.last == 0.0);
+    
+    book.add_order(std::make_shared<Order>(1, "TOB", OrderType::LIMIT, OrderSide::BUY, price_from_double(99.0), 10, "a"));
+    book.add_order(std::make_shared<Order>(2, "TOB", OrderType::LIMIT, OrderSide::BUY, price_from_double(99.0), 15, "b"));
+    book.add_order(std::make_shared<Order>(3, "TOB", OrderType::LIMIT, OrderSide::SELL, price_from_double(101.0), 7, "c"));
+    TopOfBook top = book.get_top_of_book();
+    assert(top.bid == 99.0 && top.bid_size == 25.0);
+    assert(top.ask == 101.0 && top.ask_size == 7.0);
+    assert(top.sequence > empty.sequence);
+    
+    // A partial fill reduces the level's open quantity
+    book.add_order(std::make_shared<Order>(4, "TOB", OrderType::LIMIT, OrderSide::SELL, price_from_double(99.0), 4, "d"));
+    top = book.get_top_of_book();
+    assert(top.bid_size == 21.0 && top.last == 99.0);
+    
+    // Readers racing the writer always see a snapshot from one publish: every
+    // bid the writer rests has quantity equal to its price
+    std::atomic<bool> done(false);
+    std::atomic<size_t> torn(0);
+    OrderBook churn("TOB2");
+    std::thread reader([&]() {
+        while (!done.load()) {
+            TopOfBook seen = churn.get_top_of_book();
+            if (seen.bid != seen.bid_size) torn++;
+        }
+    });
+    for (uint64_t id = 1; id <= 20000; ++id) {
+        double price = 50.0 + static_cast<double>(id % 50);
+        churn.add_order(std::make_shared<Order>(id, "TOB2", OrderType::LIMIT, OrderSide::BUY, price_from_double(price), price, "w"));
+        churn.cancel_order(id);
+    }
+    done = true;
+    reader.join();
+    assert(torn.load() == 0);
+    
+    std::cout << "✓ Top of book snapshot test passed" << std::endl;
+}
+
+void test_depth_and_level_updates() {
+    std::cout << "\n--- Testing Depth Snapshots And Level Updates ---" << std::endl;
+    
+    OrderBook book("L2");
+    book.add_order(std::make_shared<Order>(1, "L2", OrderType::LIMIT, OrderSide::BUY, price_from_double(99.0), 10, "a"));
+    book.add_order(std::make_shared<Order>(2, "L2", OrderType::LIMIT, OrderSide::BUY, price_from_double(99.0), 5, "b"));
+    book.add_order(std::make_shared<Order>(3, "L2", OrderType::LIMIT, OrderSide::BUY, price_from_double(98.0), 8, "a"));
+    book.add_order(std::make_shared<Order>(4, "L2", OrderType::LIMIT, OrderSide::SELL, price_from_double(101.0), 7, "c"));
+    
+    DepthSnapshot start = book.get_depth(10);
+    assert(start.bids.size() == 2 && start.asks.size() == 1);
+    assert(start.bids[0].price == 99.0 && start.bids[0].quantity == 15.0 && start.bids[0].order_count == 2);
+    assert(start.bids[1].price == 98.0 && start.bids[1].quantity == 8.0);
+    assert(book.get_depth(1).bids.size() == 1);
+    
+    // Rebuild the book from the snapshot plus deltas and compare with a fresh snapshot
+    std::map<std::pair<OrderSide, double>, std::pair<double, size_t>> local;
+    for (const auto& level : start.bids) local[{OrderSide::BUY, level.price}] = {level.quantity, level.order_count};
+    for (const auto& level : start.asks) local[{OrderSide::SELL, level.price}] = {level.quantity, level.order_count};
+    
+    book.add_order(std::make_shared<Order>(5, "L2", OrderType::LIMIT, OrderSide::SELL, price_from_double(99.0), 12, "d"));
+    book.cancel_order(3);
+    book.add_order(std::make_shared<Order>(6, "L2", OrderType::LIMIT, OrderSide::SELL, price_from_double(102.0), 4, "c"));
+    
+    std::vector<LevelUpdate> updates;
+    assert(book.get_level_updates(start.sequence, updates));
+    assert(!updates.empty());
+    for (const auto& update : updates) {
+        if (update.quantity == 0.0) {
+            local.erase({update.side, update.price});
+        } else {
+            local[{update.side, update.price}] = {update.quantity, update.order_count};
+        }
+    }
+    
+    DepthSnapshot now = book.get_depth(10);
+    assert(now.sequence == updates.back().sequence);
+    size_t levels = 0;
+    for (const auto* side : {&now.bids, &now.asks}) {
+        OrderSide order_side = (side == &now.bids) ? OrderSide::BUY : OrderSide::SELL;
+        for (const auto& level : *side) {
+            auto it = local.find({order_side, level.price});
+            assert(it != local.end());
+            assert(it->second.first == level.quantity && it->second.second == level.order_count);
+            levels++;
+        }
+    }
+    assert(levels == local.size());
+    assert(now.bids.size() == 1 && now.bids[0].quantity == 3.0);
+    
+    // A reader further behind than the ring must resnapshot
+    LevelUpdateRing ring(4);
+    for (int i = 0; i < 10; ++i) ring.push(OrderSide::BUY, 100.0 + i, 1.0, 1);
+    std::vector<LevelUpdate> recent;
+    assert(!ring.read_since(2, recent));
+    assert(ring.read_since(6, recent) && recent.size() == 4);
+    
+    std::cout << "✓ Depth snapshot and level update test passed" << std::endl;
+}
+
+void test_async_logger() {
+    std::cout << "\n--- Testing Async Logger ---" << std::endl;
+    
+    std::ostringstream captured;
+    logger().set_output(&captured);
+    
+    // Lines come out as the book used to print them
+    OrderBook book("LOG");
+    book.add_order(std::make_shared<Order>(1, "LOG", OrderType::LIMIT, OrderSide::SELL, price_from_double(50.0), 3, "log_seller"));
+    book.add_order(std::make_shared<Order>(2, "LOG", OrderType::LIMIT, OrderSide::BUY, price_from_double(50.0), 3, "log_buyer"));
+    logger().flush();
+    assert(captured.str() == "Trade executed: 3 @ 50 between log_buyer and log_seller\n");
+    
+    // Disabled levels are dropped before a record is built
+    captured.str("");
+    logger().set_level(LogLevel::WARN);
+    logger().log(LogLevel::INFO, LogEvent::VWAP_COMPLETED, 7);
+    logger().log(LogLevel::WARN, LogEvent::STOP_REJECTED, 8);
+    logger().flush();
+    assert(captured.str() == "Stop loss order 8 rejected: no liquidity available\n");
+
+    // Repriced trailing stops are reported per group at DEBUG
+    logger().set_level(LogLevel::DEBUG);
+    OrderBook trailing("LOGT");
+    trailing.add_order(std::make_shared<Order>(1, "LOGT", OrderType::TRAILING_STOP, OrderSide::SELL, price_from_double(1.0),
+                                               5, "log_trailer", TrailingStopOrderTag{}));
+    trailing.add_order(std::make_shared<Order>(2, "LOGT", OrderType::LIMIT, OrderSide::SELL, price_from_double(52.0), 1, "log_seller"));
+    captured.str("");
+    trailing.add_order(std::make_shared<Order>(3, "LOGT", OrderType::LIMIT, OrderSide::BUY, price_from_double(52.0), 1, "log_buyer"));
+    trailing.check_stop_loss_orders();
+    logger().flush();
+    assert(captured.str().find("Trailing stop group of 1 orders updated: highest=52, stop=51\n") != std::string::npos);
+    logger().set_level(LogLevel::INFO);
+
+    // Each thread writes its own ring; nothing is lost or reordered within a thread
+    captured.str("");
+    uint64_t dropped_before = logger().dropped_count();
+    std::vector<std::thread> writers;
+    for (uint64_t t = 0; t < 4; ++t) {
+        writers.emplace_back([t]() {
+            for (uint64_t i = 0; i < 500; ++i) {
+                logger().log(LogLevel::INFO, LogEvent::VWAP_COMPLETED, t * 1000 + i);
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    logger().flush();
+    
+    std::istringstream lines(captured.str());
+    std::string line;
+    std::vector<uint64_t> next_expected(4, 0);
+    size_t count = 0;
+    while (std::getline(lines, line)) {
+        uint64_t id = std::stoull(line.substr(std::string("VWAP order ").size()));
+        assert(id / 1000 < 4 && id % 1000 == next_expected[id / 1000]++);
+        count++;
+    }
+    assert(count == 2000 && logger().dropped_count() == dropped_before);
+    
+    logger().set_output(&std::cout);
+    std::cout << "✓ Async logger test passed" << std::endl;
+}
+
+void test_trade_event_ring() {
+    std::cout << "\n--- Testing Trade Event Ring ---" << std::endl;
+    
+    // Books record nothing until someone will drain them
+    OrderBook quiet("TRQ");
+    quiet.add_order(std::make_shared<Order>(1, "TRQ", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.0), 1, "s"));
+    quiet.add_order(std::make_shared<Order>(2, "TRQ", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.0), 1, "b"));
+    std::vector<TradeEvent> trades;
+    assert(quiet.drain_trade_events(trades) == 0);
+    
+    OrderBook book("TRE");
+    book.enable_trade_events();
+    book.add_order(std::make_shared<Order>(1, "TRE", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.0), 4, "tre_seller"));
+    book.add_order(std::make_shared<Order>(2, "TRE", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.5), 4, "tre_seller"));
+    book.add_order(std::make_shared<Order>(3, "TRE", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.5), 6, "tre_buyer"));
+    
+    assert(book.drain_trade_events(trades) == 2);
+    assert(trades[0].sequence == 1 && trades[0].sell_order_id == 1 && trades[0].buy_order_id == 3);
+    assert(trades[0].price == price_from_double(10.0) && trades[0].quantity == 4.0);
+    assert(trades[1].sequence == 2 && trades[1].sell_order_id == 2 && trades[1].quantity == 2.0);
+    assert(client_directory().name(trades[1].buyer) == "tre_buyer");
+    assert(book.drain_trade_events(trades) == 0);
+    
+    // A full ring spills instead of blocking or dropping, and order is kept
+    // while a consumer drains concurrently
+    TradeRing ring(8);
+    const uint64_t total = 20000;
+    std::vector<TradeEvent> seen;
+    std::atomic<bool> producing(true);
+    std::thread consumer([&]() {
+        while (producing.load() || seen.size() < total) {
+            ring.drain(seen);
+        }
+    });
+    for (uint64_t seq = 1; seq <= total; ++seq) {
+        ring.push(TradeEvent{seq, 0, seq, seq, 0, 0, price_from_double(1.0), 1.0});
+    }
+    producing = false;
+    consumer.join();
+    assert(seen.size() == total);
+    for (uint64_t i = 0; i < total; ++i) {
+        assert(seen[i].sequence == i + 1);
+    }
+    
+    std::cout << "✓ Trade event ring test passed" << std::endl;
+}
+
+void test_aggressor_matching() {
+    std::cout << "\n--- Testing Aggressor Matching On Entry ---" << std::endl;
+    
+    OrderBook book("AGG");
+    book.add_order(std::make_shared<Order>(1, "AGG", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.0), 5, "maker1"));
+    book.add_order(std::make_shared<Order>(2, "AGG", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.5), 5, "maker2"));
+    book.add_order(std::make_shared<Order>(3, "AGG", OrderType::LIMIT, OrderSide::SELL, price_from_double(11.0), 5, "maker3"));
+    
+    // Takes the levels its limit reaches at their prices; the rest rests
+    auto taker = std::make_shared<Order>(4, "AGG", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.5), 12, "taker");
+    auto matched = book.add_order(taker);
+    assert(matched.size() == 3);
+    assert(matched[0]->id == 1 && matched[1]->id == 2 && matched[2]->id == 4);
+    assert(taker->filled_quantity == 10.0 && taker->status != OrderStatus::FILLED);
+    assert(book.get_last_price() == 10.5);
+    TopOfBook top = book.get_top_of_book();
+    assert(top.bid == 10.5 && top.bid_size == 2.0 && top.ask == 11.0);
+    
+    // An order that does not cross just rests
+    assert(book.add_order(std::make_shared<Order>(5, "AGG", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.75), 1, "maker4")).empty());
+    assert(book.get_best_ask() == 10.75);
+    
+    // A triggered stop-limit takes liquidity up to its limit as well
+    book.add_order(std::make_shared<Order>(6, "AGG", OrderType::STOP_LIMIT, OrderSide::SELL, price_from_double(10.5),
+                                           price_from_double(10.25), 4, "stopper", StopLimitOrderTag{}));
+    top = book.get_top_of_book();
+    assert(top.bid == 0.0 && top.ask == 10.25 && top.ask_size == 2.0);
+    assert(taker->status == OrderStatus::FILLED);
+    
+    std::cout << "✓ Aggressor matching test passed" << std::endl;
+}
+
+void test_timer_wheel() {
+    std::cout << "\n--- Testing Timer Wheel ---" << std::endl;
+    
+    using Clock = TimerWheel::Clock;
+    const auto tick = std::chrono::milliseconds(10);
+    Clock::time_point start = Clock::now();
+    TimerWheel wheel(tick, start);
+    
+    // Delays spanning every level, each recorded with the tick it fired on
+    std::vector<std::pair<uint64_t, uint64_t>> fired;
+    uint64_t now_tick = 0;
+    auto schedule = [&](uint64_t ticks) {
+        return wheel.schedule_at(start + ticks * tick, [&fired, &now_tick, ticks]() { fired.emplace_back(ticks, now_tick); });
+    };
+    for (uint64_t ticks : {1ull, 5ull, 255ull, 256ull, 300ull, 65535ull, 65536ull, 70000ull, 16777216ull + 3}) {
+        schedule(ticks);
+    }
+    TimerId cancelled = schedule(1000);
+    assert(wheel.pending() == 10);
+    assert(wheel.cancel(cancelled));
+    assert(!wheel.cancel(cancelled));
+    
+    std::vector<TimerWheel::Callback> due;
+    auto advance_to = [&](uint64_t ticks) {
+        now_tick = ticks;
+        wheel.advance(start + ticks * tick, due);
+        for (auto& callback : due) callback();
+        due.clear();
+    };
+    // Irregular steps, as a late driver thread would make
+    for (uint64_t t = 0; t <= 70100; t += (t % 7) + 1) {
+        advance_to(t);
+    }
+    advance_to(16777216ull + 2);
+    assert(fired.size() == 8);
+    advance_to(16777216ull + 3);
+    assert(fired.size() == 9 && wheel.pending() == 0);
+    for (const auto& [ticks, at] : fired) {
+        // Never early, and no later than the first advance past the expiry
+        assert(at >= ticks && at <= ticks + 8);
+    }
+    
+    // Many pending timers: every one fires exactly once, none early
+    TimerWheel bulk(tick, start);
+    const size_t count = 200000;
+    std::vector<uint32_t> fire_count(count, 0);
+    std::vector<uint64_t> expiry(count);
+    bool early = false;
+    uint64_t bulk_now = 0;
+    for (size_t i = 0; i < count; ++i) {
+        expiry[i] = 1 + (i * 7919) % 100000;
+        bulk.schedule_at(start + expiry[i] * tick, [&, i]() {
+            fire_count[i]++;
+            if (bulk_now < expiry[i]) early = true;
+        });
+    }
+    for (bulk_now = 0; bulk_now <= 100000; bulk_now += 97) {
+        bulk.advance(start + bulk_now * tick, due);
+        for (auto& callback : due) callback();
+        due.clear();
+    }
+    bulk.advance(start + bulk_now * tick, due);
+    for (auto& callback : due) callback();
+    assert(!early && bulk.pending() == 0);
+    for (uint32_t n : fire_count) assert(n == 1);
+    
+    std::cout << "✓ Timer wheel test passed" << std::endl;
+}
+
+void test_dense_price_ladder() {
+    std::cout << "\n--- Testing Dense Price Ladder ---" << std::endl;
+    
+    SymbolConfig dense_config(price_from_double(0.01), BookBackend::DENSE, 128);
+    PriceLadder bids(OrderSide::BUY, dense_config);
+    
+    auto level_price = [](double price) { return price_from_double(price); };
+    Order a(1, "LADDER", OrderType::LIMIT, OrderSide::BUY, level_price(100.00), 1, "c");
+    Order b(2, "LADDER", OrderType::LIMIT, OrderSide::BUY, level_price(99.50), 1, "c");
+    Order c(3, "LADDER", OrderType::LIMIT, OrderSide::BUY, level_price(90.00), 1, "c");
+    Order d(4, "LADDER", OrderType::LIMIT, OrderSide::BUY, level_price(100.37), 1, "c");
+    
+    bids.get_or_create(a.price).push_back(&a);
+    bids.get_or_create(b.price).push_back(&b);
+    bids.get_or_create(c.price).push_back(&c);
+    bids.get_or_create(d.price).push_back(&d);
+    assert(bids.level_count() == 4);
+    assert(bids.best_price() == level_price(100.37));
+    
+    Price next;
+    assert(bids.next_price(level_price(100.37), next) && next == level_price(100.00));
+    assert(bids.next_price(level_price(100.00), next) && next == level_price(99.50));
+    assert(bids.next_price(level_price(99.50), next) && next == level_price(90.00));
+    assert(!bids.next_price(level_price(90.00), next));
+    
+    bids.find(d.price)->erase(&d);
+    bids.erase(d.price);
+    assert(bids.find(d.price) == nullptr);
+    assert(bids.best_price() == level_price(100.00));
+    
+    bids.find(a.price)->erase(&a);
+    bids.erase(a.price);
+    bids.find(b.price)->erase(&b);
+    bids.erase(b.price);
+    assert(bids.best_price() == level_price(90.00));
+    
+    // Band is empty again, so it re-centres and pulls the sparse level in
+    Order e(5, "LADDER", OrderType::LIMIT, OrderSide::BUY, level_price(90.10), 1, "c");
+    bids.get_or_create(e.price).push_back(&e);
+    assert(bids.best_price() == level_price(90.10));
+    assert(bids.next_price(level_price(90.10), next) && next == level_price(90.00));
+    
+    PriceLadder asks(OrderSide::SELL, dense_config);
+    Order f(6, "LADDER", OrderType::LIMIT, OrderSide::SELL, level_price(101.00), 1, "c");
+    Order g(7, "LADDER", OrderType::LIMIT, OrderSide::SELL, level_price(100.01), 1, "c");
+    asks.get_or_create(f.price).push_back(&f);
+    asks.get_or_create(g.price).push_back(&g);
+    assert(asks.best_price() == level_price(100.01));
+    assert(asks.next_price(level_price(100.01), next) && next == level_price(101.00));
+
+    // The touch walks below the band while deeper levels still rest in it:
+    // the band follows and the old levels stay reachable in order
+    Order h(8, "LADDER", OrderType::LIMIT, OrderSide::SELL, level_price(98.00), 1, "c");
+    Order i(9, "LADDER", OrderType::LIMIT, OrderSide::SELL, level_price(97.99), 1, "c");
+    asks.get_or_create(h.price).push_back(&h);
+    asks.get_or_create(i.price).push_back(&i);
+    assert(asks.level_count() == 4);
+    assert(asks.best_price() == level_price(97.99));
+    assert(asks.next_price(level_price(97.99), next) && next == level_price(98.00));
+    assert(asks.next_price(level_price(98.00), next) && next == level_price(100.01));
+    assert(asks.next_price(level_price(100.01), next) && next == level_price(101.00));
+    assert(asks.find(g.price) && asks.find(g.price)->front() == &g);
+
+    std::cout << "✓ Dense price ladder test passed" << std::endl;
+}
+
+void test_book_backends_agree() {
+    std::cout << "\n--- Testing Map and Dense Backends Agree ---" << std::endl;
+    
+    OrderBook map_book("AGREE", SymbolConfig(price_from_double(0.01), BookBackend::MAP));
+    OrderBook dense_book("AGREE", SymbolConfig(price_from_double(0.01), BookBackend::DENSE, 256));
+    
+    std::cout.setstate(std::ios::badbit);
+    
+    uint64_t next_id = 1;
+    std::vector<uint64_t> live_ids;
+    uint64_t seed = 12345;
+    auto next_random = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed >> 33;
+    };
+    
+    for (int step = 0; step < 5000; ++step) {
+        uint64_t action = next_random() % 10;
+        if (action < 6 || live_ids.empty()) {
+            OrderSide side = (next_random() % 2) ? OrderSide::BUY : OrderSide::SELL;
+            // Mostly near 100.00, occasionally far outside the dense band
+            double offset = static_cast<double>(next_random() % 400) / 100.0 - 2.0;
+            if (next_random() % 20 == 0) offset *= 50.0;
+            Price price = price_from_double(100.0 + offset);
+            std::string client = "client" + std::to_string(next_random() % 5);
+            double quantity = static_cast<double>(1 + next_random() % 10);
+            
+            map_book.add_order(std::make_shared<Order>(next_id, "AGREE", OrderType::LIMIT, side, price, quantity, client));
+            dense_book.add_order(std::make_shared<Order>(next_id, "AGREE", OrderType::LIMIT, side, price, quantity, client));
+            live_ids.push_back(next_id++);
+        } else {
+            size_t index = next_random() % live_ids.size();
+            uint64_t id = live_ids[index];
+            live_ids[index] = live_ids.back();
+            live_ids.pop_back();
+            assert(map_book.cancel_order(id) == dense_book.cancel_order(id));
+        }
+        
+        assert(map_book.get_best_bid() == dense_book.get_best_bid());
+        assert(map_book.get_best_ask() == dense_book.get_best_ask());
+        assert(map_book.get_last_price() == dense_book.get_last_price());
+    }
+    
+    std::cout.clear();
+    std::cout << "✓ Map and dense backends agree test passed" << std::endl;
+}
+
+void test_sharded_engine() {
+    std::cout << "\n--- Testing Sharded Matching Engine ---" << std::endl;
+    
+    MatchingEngine engine(2);
+    assert(engine.shard_count() == 2);
+    
+    // Gateways on four threads; each symbol gets 200 crossing pairs
+    const std::vector<std::string> names = {"SHA", "SHB", "SHC", "SHD"};
+    std::vector<std::thread> gateways;
+    std::atomic<size_t> rejected(0);
+    for (const auto& name : names) {
+        gateways.emplace_back([&engine, &rejected, name]() {
+            for (int i = 0; i < 200; ++i) {
+                if (engine.submit_order(name, OrderType::LIMIT, OrderSide::BUY, 50.0, 1, name + "_buyer") == 0) rejected++;
+                if (engine.submit_order(name, OrderType::LIMIT, OrderSide::SELL, 50.0, 1, name + "_seller") == 0) rejected++;
+            }
+        });
+    }
+    for (auto& gateway : gateways) gateway.join();
+    assert(rejected.load() == 0);
+    
+    // Matching runs on the shards after entry returns
+    for (const auto& name : names) {
+        auto book = engine.get_order_book(name);
+        for (int wait = 0; wait < 200 && (book->get_best_bid() != 0.0 || book->get_best_ask() != 0.0); ++wait) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        assert(book->get_best_bid() == 0.0 && book->get_best_ask() == 0.0);
+        assert(book->get_last_price() == 50.0);
+    }
+    
+    // Cancels are routed to the owning shard
+    uint64_t resting = engine.submit_order("SHA", OrderType::LIMIT, OrderSide::BUY, 40.0, 5, "SHA_buyer");
+    assert(engine.get_order_book("SHA")->get_best_bid() == 40.0);
+    assert(!engine.cancel_order(resting, "SHB_buyer"));
+    assert(engine.cancel_order(resting, "SHA_buyer"));
+    assert(engine.get_order_book("SHA")->get_best_bid() == 0.0);
+    
+    std::cout << "✓ Sharded engine test passed" << std::endl;
+}
+
+void test_vwap_fill_attribution() {
+    std::cout << "\n--- Testing VWAP Fill Attribution ---" << std::endl;
+    
+    MatchingEngine engine(1);
+    auto now = std::chrono::steady_clock::now();
+    // A short window makes the first slice the whole parent
+    uint64_t parent_id = engine.submit_vwap_order("VWAP_FILLS", OrderSide::BUY, 100.0, 50,
+                                                  now, now + std::chrono::seconds(20), "vwap_fills");
+    assert(parent_id > 0);
+    
+    auto parent = engine.get_vwap_order(parent_id);
+    assert(parent != nullptr);
+    assert(parent->vwap->child_order_ids.size() == 1);
+    assert(engine.get_order_book("VWAP_FILLS")->get_best_bid() == 100.0);
+    
+    // Each fill adds only its own quantity, however often the child trades
+    engine.submit_order("VWAP_FILLS", OrderType::MARKET, OrderSide::SELL, 0.0, 10, "seller");
+    assert(engine.get_vwap_order(parent_id)->filled_quantity == 10.0);
+    engine.submit_order("VWAP_FILLS", OrderType::LIMIT, OrderSide::SELL, 100.0, 5, "seller");
+    assert(engine.get_vwap_order(parent_id)->filled_quantity == 15.0);
+    assert(parent->status == OrderStatus::PENDING);
+    
+    engine.submit_order("VWAP_FILLS", OrderType::MARKET, OrderSide::SELL, 0.0, 35, "seller");
+    assert(parent->filled_quantity == 50.0);
+    assert(parent->status == OrderStatus::FILLED);
+    assert(engine.get_vwap_order(parent_id) == nullptr);
+    assert(engine.get_active_vwap_orders().empty());
+    
+    std::cout << "✓ VWAP fill attribution test passed" << std::endl;
+}
+
+void test_batch_submission() {
+    std::cout << "\n--- Testing Batch Order Submission ---" << std::endl;
+    
+    MatchingEngine engine(2);
+    std::vector<OrderRequest> batch = {
+        {"BATA", OrderType::LIMIT, OrderSide::BUY, 100.0, 10, "basket"},
+        {"BATB", OrderType::LIMIT, OrderSide::SELL, 50.0, 5, "basket"},
+        {"BATA", OrderType::LIMIT, OrderSide::BUY, 101.0, 0, "basket"},
+        {"BATA", OrderType::LIMIT, OrderSide::SELL, 100.0, 4, "rebalance"},
+        {"BATB", OrderType::MARKET, OrderSide::BUY, 0.0, 5, "rebalance"},
+        {"", OrderType::LIMIT, OrderSide::BUY, 10.0, 1, "basket"},
+        {"BATA", OrderType::LIMIT, OrderSide::BUY, 99.0, 3, "basket"},
+    };
+    
+    std::vector<uint64_t> ids = engine.submit_batch(batch);
+    assert(ids.size() == batch.size());
+    // Rejected orders get 0; the rest get ids in request order
+    assert(ids[2] == 0 && ids[5] == 0);
+    assert(ids[0] > 0 && ids[1] == ids[0] + 1 && ids[3] == ids[1] + 1 &&
+           ids[4] == ids[3] + 1 && ids[6] == ids[4] + 1);
+    
+    // Orders on the same symbol match in request order
+    auto book_a = engine.get_order_book("BATA");
+    TopOfBook top_a = book_a->get_top_of_book();
+    assert(top_a.bid == 100.0 && top_a.bid_size == 6.0 && top_a.last == 100.0);
+    auto book_b = engine.get_order_book("BATB");
+    assert(book_b->get_best_ask() == 0.0 && book_b->get_last_price() == 50.0);
+    
+    // Batch orders are live orders like any other
+    assert(engine.cancel_order(ids[6], "basket"));
+    assert(!engine.cancel_order(ids[4], "rebalance"));
+    assert(engine.submit_batch({}).empty());
+    
+    std::cout << "✓ Batch order submission test passed" << std::endl;
+}
+
+void test_command_journal() {
+    std::cout << "\n--- Testing Command Journal ---" << std::endl;
+    
+    namespace fs = std::filesystem;
+    ScratchDirectory scratch("journal");
+    const fs::path& root = scratch.path;
+    
+    // Records from two writers, across several 1 MB segments, in both write modes
+    for (bool use_mmap : {false, true}) {
+        std::string directory = (root / (use_mmap ? "mmap" : "pwrite")).string();
+        const uint64_t per_writer = 10000;
+        {
+            Journal journal(JournalConfig(directory, 1u << 20, std::chrono::microseconds(50), 64, use_mmap));
+            assert(journal.open());
+            std::vector<std::thread> writers;
+            for (int w = 0; w < 2; ++w) {
+                writers.emplace_back([&journal, w]() {
+                    for (uint64_t i = 1; i <= per_writer; ++i) {
+                        JournalCommand command(JournalRecordType::ORDER);
+                        command.order_id = i * 2 + w;
+                        command.side = w ? OrderSide::SELL : OrderSide::BUY;
+                        command.price = price_from_double(100.0 + static_cast<double>(i % 7));
+                        command.quantity = static_cast<double>(i);
+                        command.symbol = "JRNL";
+                        command.client_id = "writer_with_a_fairly_long_name_" + std::to_string(w);
+                        uint64_t sequence = journal.append(command);
+                        assert(sequence > 0);
+                        if (i % 1000 == 0) assert(journal.wait_durable(sequence));
+                    }
+                });
+            }
+            for (auto& writer : writers) writer.join();
+            assert(journal.last_sequence() == per_writer * 2);
+            assert(journal.wait_durable(journal.last_sequence()));
+        }
+        size_t segments = std::distance(fs::directory_iterator(directory), fs::directory_iterator());
+        assert(segments >= 3);
+        
+        uint64_t expected = 1;
+        bool replayed = Journal::replay(directory, 0, [&](const JournalCommand& command) {
+            assert(command.sequence == expected++);
+            assert(command.type == JournalRecordType::ORDER && command.symbol == "JRNL");
+            int writer = command.side == OrderSide::SELL ? 1 : 0;
+            uint64_t i = (command.order_id - writer) / 2;
+            assert(command.quantity == static_cast<double>(i));
+            assert(command.price == price_from_double(100.0 + static_cast<double>(i % 7)));
+            assert(command.client_id == "writer_with_a_fairly_long_name_" + std::to_string(writer));
+        });
+        assert(replayed && expected == per_writer * 2 + 1);
+        
+        // Reopening continues the sequence; replay can start from any point
+        {
+            Journal journal(JournalConfig(directory, 1u << 20));
+            assert(journal.open());
+            JournalCommand command(JournalRecordType::CANCEL);
+            command.order_id = 7;
+            assert(journal.append(command) == per_writer * 2 + 1);
+        }
+        size_t tail = 0;
+        Journal::replay(directory, per_writer * 2 - 10, [&](const JournalCommand&) { tail++; });
+        assert(tail == 11);
+    }
+    
+    // A segment whose first record is torn is reused from scratch; records
+    // written after the torn one are not replayed behind the new ones
+    std::string torn_directory = (root / "torn").string();
+    auto cancel_command = [](uint64_t order_id) {
+        JournalCommand command(JournalRecordType::CANCEL);
+        command.order_id = order_id;
+        return command;
+    };
+    {
+        Journal journal(JournalConfig(torn_directory, 1u << 20));
+        assert(journal.open());
+        for (uint64_t id = 1; id <= 3; ++id) {
+            JournalCommand command = cancel_command(id);
+            journal.append(command);
+        }
+        assert(journal.wait_durable(3));
+    }
+    {
+        fs::path segment = fs::directory_iterator(torn_directory)->path();
+        std::fstream file(segment, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(24);
+        file.put('\x7f');
+    }
+    {
+        Journal journal(JournalConfig(torn_directory, 1u << 20));
+        assert(journal.open());
+        JournalCommand command = cancel_command(9);
+        assert(journal.append(command) == 1);
+        assert(journal.wait_durable(1));
+    }
+    std::vector<uint64_t> torn_ids;
+    Journal::replay(torn_directory, 0, [&](const JournalCommand& command) { torn_ids.push_back(command.order_id); });
+    assert(torn_ids.size() == 1 && torn_ids[0] == 9);
+    
+    // The engine journals each accepted command with the id it assigned
+    std::string engine_directory = (root / "engine").string();
+    std::vector<uint64_t> ids;
+    {
+        MatchingEngine engine(2);
+        assert(engine.enable_journal(JournalConfig(engine_directory)));
+        assert(engine.set_symbol_config("JRNA", SymbolConfig(price_from_double(0.05))));
+        ids.push_back(engine.submit_order("JRNA", OrderType::LIMIT, OrderSide::BUY, 10.02, 5, "journal_client"));
+        ids.push_back(engine.submit_stop_limit_order("JRNA", OrderSide::SELL, 9.0, 8.5, 3, "journal_client"));
+        assert(engine.cancel_order(ids[0], "journal_client"));
+        assert(engine.submit_order("JRNA", OrderType::LIMIT, OrderSide::BUY, 0.0, 5, "journal_client") == 0);
+        auto batch = engine.submit_batch({{"JRNA", OrderType::LIMIT, OrderSide::SELL, 11.0, 1, "journal_client"},
+                                          {"JRNB", OrderType::MARKET, OrderSide::BUY, 0.0, 1, "journal_client"}});
+        ids.insert(ids.end(), batch.begin(), batch.end());
+    }
+    std::vector<JournalCommand> commands;
+    Journal::replay(engine_directory, 0, [&](const JournalCommand& command) { commands.push_back(command); });
+    assert(commands.size() == 6);
+    assert(commands[0].type == JournalRecordType::SYMBOL_CONFIG && commands[0].config.tick_size == price_from_double(0.05));
+    assert(commands[1].type == JournalRecordType::ORDER && commands[1].order_id == ids[0] &&
+           commands[1].price == price_from_double(10.0));
+    assert(commands[2].type == JournalRecordType::STOP_LIMIT_ORDER && commands[2].order_id == ids[1] &&
+           commands[2].limit_price == price_from_double(8.5));
+    assert(commands[3].type == JournalRecordType::CANCEL && commands[3].order_id == ids[0]);
+    // Batch orders on different shards may reach the journal in either order
+    assert(commands[4].order_id + commands[5].order_id == ids[2] + ids[3]);
+    
+    std::cout << "✓ Command journal test passed" << std::endl;
+}
+
+void test_snapshot_recovery() {
+    std::cout << "\n--- Testing Snapshot Recovery ---" << std::endl;
+    
+    ScratchDirectory scratch("snapshot");
+    const std::filesystem::path& root = scratch.path;
+    std::string journal_dir = (root / "journal").string();
+    std::string snapshot_dir = (root / "snapshots").string();
+    std::string shadow_dir = (root / "shadow").string();
+    
+    auto capture = [](MatchingEngine& engine, const std::string& symbol) {
+        BookImage image;
+        engine.capture_book(symbol, image);
+        return image;
+    };
+    auto same_book = [](const BookImage& a, const BookImage& b) {
+        if (a.last_trade_price != b.last_trade_price || a.next_sequence != b.next_sequence ||
+            a.next_trade_sequence != b.next_trade_sequence || a.orders.size() != b.orders.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.orders.size(); ++i) {
+            const OrderImage& x = a.orders[i];
+            const OrderImage& y = b.orders[i];
+            if (x.id != y.id || x.sequence != y.sequence || x.placement != y.placement || x.price != y.price ||
+                x.filled_quantity != y.filled_quantity || x.client != y.client || x.reference != y.reference) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const std::vector<std::string> books = {"SNPA", "SNPB", "SNPC"};
+    
+    std::map<std::string, BookImage> at_snapshot, at_end;
+    uint64_t vwap_id, resting_id, last_id;
+    std::string first, first_shadow, last_shadow;
+    {
+        MatchingEngine engine(2);
+        assert(engine.enable_journal(JournalConfig(journal_dir)));
+        assert(engine.set_symbol_config("SNPA", SymbolConfig(price_from_double(0.05), BookBackend::DENSE, 256)));
+        
+        // Several orders per level, a partial fill, pending stops of every kind
+        for (int i = 0; i < 20; ++i) {
+            std::string client = (i % 2) ? "snap_even" : "snap_odd";
+            engine.submit_order("SNPA", OrderType::LIMIT, OrderSide::BUY, 99.0 - 0.05 * (i % 4), 10, client);
+            engine.submit_order("SNPA", OrderType::LIMIT, OrderSide::SELL, 101.0 + 0.05 * (i % 4), 10, client);
+            engine.submit_order("SNPB", OrderType::LIMIT, OrderSide::BUY, 50.0 - 0.01 * (i % 3), 5, client);
+        }
+        resting_id = engine.submit_order("SNPB", OrderType::LIMIT, OrderSide::SELL, 52.0, 5, "snap_odd");
+        engine.submit_order("SNPA", OrderType::MARKET, OrderSide::SELL, 0.0, 15, "snap_taker");
+        engine.submit_stop_limit_order("SNPA", OrderSide::SELL, 98.0, 97.5, 4, "snap_odd");
+        engine.submit_trailing_stop_order("SNPA", OrderSide::SELL, 2.0, 3, "snap_even");
+        engine.submit_trailing_stop_order("SNPA", OrderSide::BUY, 1.5, 3, "snap_even");
+        auto now = std::chrono::steady_clock::now();
+        vwap_id = engine.submit_vwap_order("SNPV", OrderSide::BUY, 20.0, 100, now, now + std::chrono::hours(1), "snap_vwap");
+        assert(vwap_id > 0);
+        // Its first slice is posted to the shard; let it land in the journal
+        // before the snapshot takes its sequence
+        assert(engine.get_vwap_order(vwap_id));
+        
+        assert(engine.write_snapshot(snapshot_dir, &first));
+        for (const auto& symbol : books) {
+            at_snapshot[symbol] = capture(engine, symbol);
+        }
+        // Shadow snapshots start from the journal alone
+        assert(engine.write_snapshot_from_journal(shadow_dir, &first_shadow));
+        
+        // Input after the snapshot only reaches the journal
+        assert(engine.cancel_order(resting_id, "snap_odd"));
+        engine.submit_order("SNPA", OrderType::LIMIT, OrderSide::SELL, 99.0, 12, "snap_taker");
+        engine.submit_order("SNPC", OrderType::LIMIT, OrderSide::BUY, 7.0, 1, "snap_even");
+        last_id = engine.submit_order("SNPB", OrderType::LIMIT, OrderSide::BUY, 50.0, 2, "snap_even");
+        for (const auto& symbol : books) {
+            at_end[symbol] = capture(engine, symbol);
+        }
+        
+        std::string second;
+        assert(engine.write_snapshot(snapshot_dir, &second));
+        assert(list_snapshots(snapshot_dir).front() == second && second != first);
+        // The next shadow builds on the last one plus the journal after it
+        assert(engine.write_snapshot_from_journal(shadow_dir, &last_shadow));
+        assert(list_snapshots(shadow_dir).size() == 2 && list_snapshots(shadow_dir).front() == last_shadow);
+    }
+    assert(!at_snapshot["SNPA"].orders.empty() && at_snapshot["SNPC"].orders.empty());
+    
+    // A shadow snapshot holds exactly the records up to the sequence it carries
+    auto same_books = [&](const EngineSnapshot& snapshot, std::map<std::string, BookImage>& expected) {
+        for (const auto& symbol : books) {
+            BookImage image;
+            for (const auto& symbol_image : snapshot.symbols) {
+                if (symbol_image.symbol == symbol) image = symbol_image.book;
+            }
+            if (!same_book(image, expected[symbol])) return false;
+        }
+        return true;
+    };
+    {
+        EngineSnapshot live, early, late;
+        assert(load_snapshot(first, live) && load_snapshot(first_shadow, early) && load_snapshot(last_shadow, late));
+        assert(early.journal_sequence == live.journal_sequence && same_books(early, at_snapshot));
+        uint64_t journalled = 0;
+        assert(Journal::replay(journal_dir, 0, [&](const JournalCommand&) { journalled++; }));
+        assert(late.journal_sequence == journalled && same_books(late, at_end));
+        for (const auto& image : late.symbols) {
+            assert(image.journal_sequence <= late.journal_sequence);
+        }
+        uint64_t bounded = 0;
+        assert(Journal::replay(journal_dir, early.journal_sequence, [&](const JournalCommand&) { bounded++; },
+                               early.journal_sequence + 2));
+        assert(bounded == 2);
+    }
+    
+    auto check_recovered = [&](MatchingEngine& engine, std::map<std::string, BookImage>& expected) {
+        for (const auto& symbol : books) {
+            assert(same_book(capture(engine, symbol), expected[symbol]));
+        }
+        assert(engine.get_order_book("SNPA")->get_config().backend == BookBackend::DENSE);
+        auto vwap = engine.get_vwap_order(vwap_id);
+        assert(vwap && vwap->quantity == 100);
+    };
+    
+    // Newest snapshot; nothing left to replay
+    {
+        MatchingEngine engine(2);
+        assert(engine.recover(snapshot_dir, journal_dir));
+        check_recovered(engine, at_end);
+        // Ids continue past everything recovered, and restored orders stay cancellable
+        assert(engine.submit_order("SNPB", OrderType::LIMIT, OrderSide::BUY, 49.0, 1, "snap_even") > last_id);
+        const OrderImage& best_bid = at_end["SNPB"].orders.front();
+        assert(engine.cancel_order(best_bid.id, client_directory().name(best_bid.client)));
+    }
+    
+    // A damaged snapshot is skipped in favour of the one before it plus the journal
+    {
+        std::string newest = list_snapshots(snapshot_dir).front();
+        std::fstream file(newest, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(64);
+        file.put('\x7f');
+    }
+    {
+        MatchingEngine engine(3);
+        assert(engine.recover(snapshot_dir, journal_dir));
+        check_recovered(engine, at_end);
+    }
+    {
+        MatchingEngine engine(1);
+        assert(engine.recover(snapshot_dir, ""));
+        check_recovered(engine, at_snapshot);
+    }
+    // The journal alone rebuilds the same books from scratch
+    {
+        MatchingEngine engine(2);
+        assert(engine.recover("", journal_dir));
+        check_recovered(engine, at_end);
+    }
+    // A shadow snapshot holds the same state as the live engine's
+    {
+        MatchingEngine engine(1);
+        assert(engine.recover(shadow_dir, ""));
+        check_recovered(engine, at_end);
+    }
+    
+    std::cout << "✓ Snapshot recovery test passed" << std::endl;
+}
+
+void test_replication() {
+    std::cout << "\n--- Testing Primary/Backup Replication ---" << std::endl;
+    
+    ScratchDirectory scratch("replication");
+    const std::filesystem::path& root = scratch.path;
+    std::string endpoint = "unix:" + (root / "primary.sock").string();
+    const std::vector<std::string> books = {"REPA", "REPB"};
+    
+    auto same_books = [&](MatchingEngine& a, MatchingEngine& b) {
+        for (const auto& symbol : books) {
+            BookImage x, y;
+            a.capture_book(symbol, x);
+            b.capture_book(symbol, y);
+            if (x.last_trade_price != y.last_trade_price || x.next_sequence != y.next_sequence ||
+                x.next_trade_sequence != y.next_trade_sequence || x.orders.size() != y.orders.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < x.orders.size(); ++i) {
+                if (x.orders[i].id != y.orders[i].id || x.orders[i].sequence != y.orders[i].sequence ||
+                    x.orders[i].price != y.orders[i].price || x.orders[i].filled_quantity != y.orders[i].filled_quantity) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    // Each accepted command is one journal record
+    auto caught_up = [](MatchingEngine& engine, uint64_t records) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (engine.replicated_sequence() < records && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return engine.replicated_sequence() == records;
+    };
+    
+    auto primary = std::make_unique<MatchingEngine>(2);
+    assert(!primary->enable_replication(endpoint));   // needs the journal
+    assert(primary->enable_journal(JournalConfig((root / "primary").string())));
+    assert(primary->enable_replication(endpoint));
+    
+    MatchingEngine backup(3);
+    std::atomic<bool> followed{false};
+    std::thread follower([&]() { followed = backup.follow(endpoint); });
+    
+    uint64_t records = 0, last_id = 0, resting_id = 0;
+    for (int i = 0; i < 200; ++i) {
+        const std::string& symbol = books[i % 2];
+        OrderSide side = (i % 3) ? OrderSide::BUY : OrderSide::SELL;
+        double price = side == OrderSide::BUY ? 100.0 - 0.01 * (i % 7) : 99.97 + 0.01 * (i % 5);
+        last_id = primary->submit_order(symbol, OrderType::LIMIT, side, price, 1 + i % 4, "repl_client");
+        assert(last_id > 0);
+        ++records;
+        if (i % 25 == 0) {
+            resting_id = primary->submit_order(symbol, OrderType::LIMIT, OrderSide::BUY, 90.0, 3, "repl_client");
+            ++records;
+        }
+    }
+    assert(primary->submit_stop_limit_order("REPA", OrderSide::SELL, 95.0, 94.0, 2, "repl_client") > 0);
+    assert(primary->submit_trailing_stop_order("REPB", OrderSide::SELL, 1.0, 2, "repl_client") > 0);
+    assert(primary->submit_order("REPA", OrderType::MARKET, OrderSide::SELL, 0.0, 5, "repl_taker") > 0);
+    assert(primary->cancel_order(resting_id, "repl_client"));
+    records += 4;
+    
+    assert(caught_up(backup, records));
+    assert(same_books(*primary, backup));
+    
+    // A backup joining late starts from the primary's history
+    {
+        MatchingEngine late(1);
+        bool late_followed = false;
+        std::thread late_follower([&]() { late_followed = late.follow(endpoint); });
+        assert(caught_up(late, records));
+        assert(same_books(*primary, late));
+        late.stop_following();
+        late_follower.join();
+        assert(late_followed);
+    }
+    
+    // Failover: the stream ends with the primary and the backup takes over
+    uint64_t live_id = primary->submit_order("REPB", OrderType::LIMIT, OrderSide::BUY, 80.0, 1, "repl_client");
+    ++records;
+    primary.reset();
+    follower.join();
+    assert(followed && backup.replicated_sequence() == records);
+    assert(backup.enable_journal(JournalConfig((root / "backup").string())));
+    backup.resume_vwap_orders();
+    assert(backup.submit_order("REPA", OrderType::LIMIT, OrderSide::BUY, 90.0, 1, "repl_client") > live_id);
+    assert(backup.cancel_order(live_id, "repl_client"));
+    assert(live_id > last_id);
+    
+    // Nothing to follow once the primary is gone
+    MatchingEngine orphan(1);
+    assert(!orphan.follow(endpoint));
+    
+    std::cout << "✓ Replication test passed" << std::endl;
+}
+
+void test_pre_trade_risk() {
+    std::cout << "\n--- Testing Pre-Trade Risk ---" << std::endl;
+    
+    MatchingEngine engine(2);
+    engine.set_risk_limits("risk_a", RiskLimits(10, 1000, 3, 15));
+    
+    // Size and notional
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 50.0, 11, "risk_a") == 0);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 101.0, 10, "risk_a") == 0);
+    // A market order is valued at the best price it takes; with nothing to take it can't be valued
+    engine.set_risk_limits("risk_c", RiskLimits(0, 1000));
+    assert(engine.submit_order("RISKM", OrderType::MARKET, OrderSide::BUY, 0.0, 1, "risk_c") == 0);
+    engine.submit_order("RISKM", OrderType::LIMIT, OrderSide::SELL, 150.0, 10, "risk_mm");
+    assert(engine.submit_order("RISKM", OrderType::MARKET, OrderSide::BUY, 0.0, 7, "risk_c") == 0);
+    assert(engine.submit_order("RISKM", OrderType::MARKET, OrderSide::BUY, 0.0, 6, "risk_c") > 0);
+    assert(engine.get_position("RISKM", "risk_c") == 6);
+
+    // Open orders: resting limits and pending stops count, cancels and fills free a slot
+    uint64_t first = engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 90.0, 5, "risk_a");
+    assert(first > 0);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 89.0, 5, "risk_a") > 0);
+    assert(engine.submit_stop_limit_order("RISK", OrderSide::SELL, 80.0, 79.0, 5, "risk_a") > 0);
+    assert(engine.get_open_order_count("risk_a") == 3);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 88.0, 5, "risk_a") == 0);
+    assert(engine.cancel_order(first, "risk_a"));
+    assert(engine.get_open_order_count("risk_a") == 2);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 91.0, 10, "risk_a") > 0);
+    
+    // Positions follow the trade stream
+    assert(engine.submit_order("RISK", OrderType::MARKET, OrderSide::SELL, 0.0, 10, "risk_mm") > 0);
+    assert(engine.get_position("RISK", "risk_a") == 10 && engine.get_position("RISK", "risk_mm") == -10);
+    assert(engine.get_open_order_count("risk_a") == 2);
+    // 10 long: another 10 would pass 15, a sale brings it back
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 60.0, 6, "risk_a") == 0);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 60.0, 5, "risk_a") > 0);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::SELL, 95.0, 10, "risk_a") == 0);  // open orders
+    
+    // Defaults cover clients without limits of their own; message rate per second
+    engine.set_default_risk_limits(RiskLimits(0, 0, 0, 0, 5));
+    size_t accepted = 0;
+    for (int i = 0; i < 20; ++i) {
+        if (engine.submit_order("RISK", OrderType::LIMIT, OrderSide::SELL, 120.0, 1, "risk_b") > 0) ++accepted;
+    }
+    // A second boundary during the loop opens a fresh window
+    assert(accepted >= 5 && accepted <= 10);
+    assert(engine.submit_order("RISK", OrderType::LIMIT, OrderSide::BUY, 50.0, 11, "risk_a") == 0);
+    
+    // Positions and open orders survive a snapshot
+    ScratchDirectory scratch("risk");
+    const std::filesystem::path& root = scratch.path;
+    assert(engine.write_snapshot(root.string()));
+    {
+        MatchingEngine recovered(1);
+        assert(recovered.recover(root.string(), ""));
+        assert(recovered.get_position("RISK", "risk_a") == 10);
+        assert(recovered.get_open_order_count("risk_a") == 3);
+        assert(recovered.get_open_order_count("risk_b") == static_cast<int64_t>(accepted));
+    }
+    
+    std::cout << "✓ Pre-trade risk test passed" << std::endl;
+}
+
+void test_order_location_cleanup() {
+    std::cout << "\n--- Testing Order Location Cleanup ---" << std::endl;
+    
+    MatchingEngine engine(2);
+    std::vector<uint64_t> makers;
+    for (int i = 0; i < 100; ++i) {
+        makers.push_back(engine.submit_order("LOCS", OrderType::LIMIT, OrderSide::SELL, 10.0, 1, "loc_maker"));
+    }
+    assert(engine.tracked_order_count() == 100);
+    
+    // Filled makers and an aggressor filled on arrival are forgotten
+    assert(engine.submit_order("LOCS", OrderType::LIMIT, OrderSide::BUY, 10.0, 60, "loc_taker") > 0);
+    assert(engine.tracked_order_count() == 40);
+    assert(!engine.cancel_order(makers[0], "loc_maker"));
+    // The remainder of a partial fill stays
+    uint64_t partial = engine.submit_order("LOCS", OrderType::LIMIT, OrderSide::BUY, 10.0, 50, "loc_taker");
+    assert(engine.tracked_order_count() == 1);
+    
+    // An order cancelled by its own client's aggressor, then one filled by a market order
+    assert(engine.submit_order("LOCS", OrderType::LIMIT, OrderSide::SELL, 9.0, 5, "loc_taker") > 0);
+    assert(!engine.cancel_order(partial, "loc_taker") && engine.tracked_order_count() == 1);
+    assert(engine.submit_order("LOCS", OrderType::MARKET, OrderSide::BUY, 0.0, 5, "loc_maker") > 0);
+    assert(engine.tracked_order_count() == 0);
+    
+    // A stop that triggers into an empty side
+    assert(engine.submit_order("LOCS", OrderType::STOP_LOSS, OrderSide::SELL, 9.5, 3, "loc_stop") > 0);
+    assert(engine.tracked_order_count() == 0);
+    
+    std::cout << "✓ Order location cleanup test passed" << std::endl;
+}
+
+void test_order_amend() {
+    std::cout << "\n--- Testing Order Amend ---" << std::endl;
+    
+    OrderBook book("AMND");
+    for (uint64_t id = 1; id <= 3; ++id) {
+        book.add_order(std::make_shared<Order>(id, "AMND", OrderType::LIMIT, OrderSide::SELL, price_from_double(10.0), 5,
+                                               "maker" + std::to_string(id)));
+    }
+    std::vector<std::shared_ptr<Order>> matched;
+    
+    // Less quantity at the same price stays in place; more goes to the back
+    assert(book.amend_order(1, price_from_double(10.0), 2, matched) && matched.empty());
+    assert(book.get_top_of_book().ask_size == 12.0);
+    assert(book.amend_order(2, price_from_double(10.0), 6, matched) && matched.empty());
+    auto taker = std::make_shared<Order>(4, "AMND", OrderType::LIMIT, OrderSide::BUY, price_from_double(10.0), 7, "taker");
+    matched = book.add_order(taker);
+    assert(matched.size() == 3 && matched[0]->id == 1 && matched[1]->id == 3);
+    assert(book.find_order(2)->filled_quantity == 0 && book.get_top_of_book().ask_size == 6.0);
+    
+    // A new price that crosses trades first and rests the remainder
+    book.add_order(std::make_shared<Order>(5, "AMND", OrderType::LIMIT, OrderSide::BUY, price_from_double(9.5), 4, "bidder"));
+    matched.clear();
+    assert(book.amend_order(2, price_from_double(9.5), 6, matched));
+    assert(matched.size() == 2 && book.get_last_price() == 9.5);
+    TopOfBook top = book.get_top_of_book();
+    assert(top.bid == 0.0 && top.ask == 9.5 && top.ask_size == 2.0);
+    
+    // Nothing at or below the filled part, and only resting limits
+    assert(!book.amend_order(2, price_from_double(9.5), 4, matched));
+    assert(!book.amend_order(1, price_from_double(10.0), 1, matched));
+    book.add_order(std::make_shared<Order>(6, "AMND", OrderType::STOP_LOSS, OrderSide::SELL, price_from_double(8.0), 1, "stopper"));
+    assert(!book.amend_order(6, price_from_double(7.0), 1, matched));
+    
+    // Through the engine: only the owner amends, and a journal replays it
+    ScratchDirectory scratch("amend");
+    const std::filesystem::path& root = scratch.path;
+    TopOfBook live;
+    {
+        MatchingEngine engine(2);
+        assert(engine.enable_journal(JournalConfig(root.string())));
+        uint64_t first = engine.submit_order("AMNE", OrderType::LIMIT, OrderSide::BUY, 50.0, 10, "quoter");
+        uint64_t second = engine.submit_order("AMNE", OrderType::LIMIT, OrderSide::BUY, 50.0, 10, "other");
+        assert(!engine.amend_order(first, 50.0, 5, "other"));
+        assert(engine.amend_order(first, 50.0, 5, "quoter"));
+        assert(engine.submit_order("AMNE", OrderType::LIMIT, OrderSide::SELL, 50.0, 5, "seller") > 0);
+        assert(!engine.cancel_order(first, "quoter"));
+        assert(engine.amend_order(second, 51.0, 12, "other"));
+        assert(engine.submit_order("AMNE", OrderType::LIMIT, OrderSide::SELL, 52.0, 1, "seller") > 0);
+        assert(engine.amend_order(second, 52.0, 12, "other"));
+        live = engine.get_order_book("AMNE")->get_top_of_book();
+        assert(live.bid == 52.0 && live.bid_size == 11.0 && engine.get_position("AMNE", "other") == 1);
+        assert(engine.get_open_order_count("other") == 1);
+    }
+    {
+        MatchingEngine recovered(1);
+        assert(recovered.recover("", root.string()));
+        TopOfBook top = recovered.get_order_book("AMNE")->get_top_of_book();
+        assert(top.bid == live.bid && top.bid_size == live.bid_size && top.last == live.last);
+    }
+    
+    std::cout << "✓ Order amend test passed" << std::endl;
+}
+
+void test_time_in_force() {
+    std::cout << "\n--- Testing Time In Force ---" << std::endl;
+    
+    OrderBook book("TIF");
+    auto rest = [&](uint64_t id, OrderSide side, double price, double quantity, const std::string& client) {
+        book.add_order(std::make_shared<Order>(id, "TIF", OrderType::LIMIT, side, price_from_double(price), quantity, client));
+    };
+    auto immediate = [&](uint64_t id, TimeInForce time_in_force, double price, double quantity, const std::string& client) {
+        auto order = std::make_shared<Order>(id, "TIF", OrderType::LIMIT, OrderSide::BUY, price_from_double(price),
+                                             quantity, client);
+        order->time_in_force = time_in_force;
+        book.add_order(order);
+        return order;
+    };
+    rest(1, OrderSide::SELL, 10.0, 5, "own");
+    rest(2, OrderSide::SELL, 10.0, 5, "maker");
+    rest(3, OrderSide::SELL, 10.5, 5, "maker");
+    rest(4, OrderSide::SELL, 11.0, 5, "maker");
+    
+    // A FOK beyond what others offer within its price doesn't trade at all;
+    // the client's own order is not counted and stays in place
+    auto killed = immediate(5, TimeInForce::FOK, 10.5, 11, "own");
+    assert(killed->status == OrderStatus::CANCELLED && killed->filled_quantity == 0);
+    assert(book.get_top_of_book().ask_size == 10.0 && book.get_last_price() == 0.0);
+    
+    // A FOK that fits passes over its own resting order and fills in full
+    auto filled = immediate(6, TimeInForce::FOK, 10.5, 8, "own");
+    assert(filled->status == OrderStatus::FILLED);
+    assert(book.find_order(1) != nullptr && book.find_order(2) == nullptr);
+    
+    // An IOC takes what its price reaches and drops the rest, never resting
+    auto partial = immediate(7, TimeInForce::IOC, 10.5, 10, "taker");
+    assert(partial->status == OrderStatus::PARTIAL_FILLED && partial->filled_quantity == 5 + 2);
+    assert(book.find_order(7) == nullptr && book.get_best_bid() == 0.0);
+    auto missed = immediate(8, TimeInForce::IOC, 9.0, 1, "taker");
+    assert(missed->status == OrderStatus::CANCELLED && book.get_best_bid() == 0.0);
+    
+    // Immediate market orders end the same way
+    auto market = [&](uint64_t id, TimeInForce time_in_force, double quantity) {
+        auto order = std::make_shared<Order>(id, "TIF", OrderType::MARKET, OrderSide::BUY, 0, quantity, "taker");
+        order->time_in_force = time_in_force;
+        book.execute_market_order(order, OrderSide::SELL, quantity);
+        return order;
+    };
+    auto killed_market = market(9, TimeInForce::FOK, 6);
+    assert(killed_market->status == OrderStatus::CANCELLED && killed_market->filled_quantity == 0);
+    assert(book.get_top_of_book().ask_size == 5.0);
+    auto partial_market = market(10, TimeInForce::IOC, 6);
+    assert(partial_market->status == OrderStatus::PARTIAL_FILLED && partial_market->filled_quantity == 5);
+    assert(book.get_best_ask() == 0.0);
+    
+    // Through the engine: immediate orders are never left to cancel, GTC
+    // rests, and stops can't be immediate
+    MatchingEngine engine(2);
+    engine.submit_order("TIFE", OrderType::LIMIT, OrderSide::SELL, 20.0, 5, "tif_maker");
+    assert(engine.submit_order("TIFE", OrderType::LIMIT, OrderSide::BUY, 20.0, 6, "tif_taker", TimeInForce::FOK) > 0);
+    assert(engine.get_order_book("TIFE")->get_last_price() == 0.0);
+    uint64_t ioc = engine.submit_order("TIFE", OrderType::LIMIT, OrderSide::BUY, 20.0, 6, "tif_taker", TimeInForce::IOC);
+    assert(ioc > 0 && engine.get_position("TIFE", "tif_taker") == 5);
+    assert(!engine.cancel_order(ioc, "tif_taker") && engine.tracked_order_count() == 0);
+    assert(engine.submit_order("TIFE", OrderType::LIMIT, OrderSide::SELL, 21.0, 5, "tif_maker", TimeInForce::GTC) > 0);
+    std::ostringstream captured;
+    logger().set_output(&captured);
+    uint64_t fok_market = engine.submit_order("TIFE", OrderType::MARKET, OrderSide::BUY, 0.0, 6, "tif_taker", TimeInForce::FOK);
+    logger().flush();
+    logger().set_output(&std::cout);
+    assert(fok_market > 0 && engine.get_order_book("TIFE")->get_best_ask() == 21.0);
+    // Expired like a limit FOK, not rejected
+    assert(captured.str().find("FOK order " + std::to_string(fok_market) + " done: 0/6") != std::string::npos);
+    assert(captured.str().find("rejected") == std::string::npos);
+    assert(engine.submit_order("TIFE", OrderType::STOP_LOSS, OrderSide::SELL, 19.0, 1, "tif_taker", TimeInForce::IOC) == 0);
+    std::vector<uint64_t> ids = engine.submit_batch({
+        {"TIFE", OrderType::LIMIT, OrderSide::BUY, 21.0, 2, "tif_taker", TimeInForce::IOC},
+        {"TIFE", OrderType::LIMIT, OrderSide::BUY, 20.5, 2, "tif_taker", TimeInForce::IOC},
+    });
+    assert(ids[0] > 0 && ids[1] > 0 && engine.get_position("TIFE", "tif_taker") == 7);
+    assert(engine.get_order_book("TIFE")->get_best_bid() == 0.0 && engine.tracked_order_count() == 1);
+    
+    std::cout << "✓ Time in force test passed" << std::endl;
+}
+
 int main() {
     std::cout << "Starting Realistic Trading Engine Test Suite..." << std::endl;
     
     try {
         test_order_creation();
+        test_name_directory();
         test_order_book_basic();
+        test_stop_trigger_index();
+        test_trailing_stop_groups();
+        test_order_pool();
+        test_top_of_book_snapshot();
+        test_depth_and_level_updates();
+        test_async_logger();
+        test_trade_event_ring();
+        test_aggressor_matching();
+        test_timer_wheel();
+        test_dense_price_ladder();
+        test_book_backends_agree();
+        test_sharded_engine();
+        test_vwap_fill_attribution();
+        test_batch_submission();
+        test_command_journal();
+        test_snapshot_recovery();
+        test_replication();
+        test_pre_trade_risk();
+        test_order_location_cleanup();
+        test_order_amend();
+        test_time_in_force();
         
         TradingEngineTest test_suite;
         test_suite.run_all_tests();